@@ -0,0 +1,352 @@
+#include "../src/common.h"
+#include "../src/device/console.h"
+#include "../src/device/datetime.h"
+#include "../src/device/drawlist.h"
+#include "../src/device/framebuffer.h"
+#include "../src/device/file.h"
+#include "../src/device/system.h"
+#include "../src/uxn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Instruction throughput benchmark.
+ *
+ * Runs the reset vector of each ROM through uxn_eval and reports the best
+ * wall time over a number of runs as JSON on stdout, with a readable summary
+ * on stderr. Build with UXN_STATS so that uxn_eval counts instructions and
+ * handler dispatches, which differ by the instructions run as part of a
+ * superinstruction.
+ *
+ * The system, file and datetime devices are real, console output is
+ * discarded and every other device (screen included) is stubbed out, so the
+ * sprite ROM measures the VM side of drawing only. The drawing side is timed
+ * separately, by blitting sprites and fills straight into a framebuffer, and
+ * by recording small fills and sprites into a draw list as the screen does.
+ * Bank copies through the System/expansion port are timed on their own too.
+ */
+
+#define DEFAULT_RUNS 3
+
+#define SPRITE_BENCH_COUNT 2000000
+#define FILL_BENCH_COUNT 20000
+#define RECORD_BENCH_COUNT 20000
+#define COPY_BENCH_COUNT 4000
+// Almost a whole bank, so the copies wrap around its end
+#define COPY_BENCH_LENGTH 0xff00
+
+typedef struct BenchResult {
+  const char *rom;
+  uint64_t instructions;
+  uint64_t dispatches;
+  double seconds;
+} BenchResult;
+
+static double elapsed(struct timespec start, struct timespec end) {
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static int bench_rom(const char *rom, int runs, BenchResult *result) {
+  *result = (BenchResult){
+      .rom = rom, .instructions = 0, .dispatches = 0, .seconds = 0};
+
+  for (int i = 0; i < runs; i++) {
+    Uxn *uxn = uxn_new(NULL);
+    system_register(uxn);
+    file_register(uxn);
+    datetime_register(uxn);
+
+    if (!system_boot(uxn, (char *)rom)) {
+      uxn_delete(uxn);
+      return 0;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uxn_eval(uxn, RESET_VECTOR);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = elapsed(start, end);
+    if (i == 0 || seconds < result->seconds) {
+      result->seconds = seconds;
+    }
+    result->instructions = uxn->instructions;
+    result->dispatches = uxn->dispatches;
+
+    uxn_delete(uxn);
+  }
+
+  return 1;
+}
+
+// Best time of `runs` to draw SPRITE_BENCH_COUNT sprites over a default sized
+// screen, cycling through positions, both sprite modes, colours and flips
+static double bench_sprites(int runs) {
+  Byte sprite[SPRITE_2BPP_BUFFER_SIZE];
+  for (size_t i = 0; i < sizeof(sprite); i++) {
+    sprite[i] = (Byte)(0x3c ^ (i * 0x25));
+  }
+
+  double best = 0;
+  for (int i = 0; i < runs; i++) {
+    Framebuffer *fb = framebuffer_new(512, 320);
+    uint32_t seed = 1;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int n = 0; n < SPRITE_BENCH_COUNT; n++) {
+      seed = seed * 1664525 + 1013904223;
+      int x = (int)(seed >> 8) % 520 - 4;
+      int y = (int)(seed >> 20) % 328 - 4;
+      Byte control = seed >> 24;
+      framebuffer_sprite(fb, control & 0x40 ? FG_LAYER : BG_LAYER, x, y, sprite,
+                         control & 0x80, control & 0x0f, control & 0x10,
+                         control & 0x20);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    framebuffer_delete(fb);
+
+    double seconds = elapsed(start, end);
+    if (i == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+
+  return best;
+}
+
+// Best time of `runs` to do FILL_BENCH_COUNT pixel port fills over a default
+// sized screen, from random corners to the edges as the port does, and the
+// number of pixels they cover
+static double bench_fills(int runs, uint64_t *pixels) {
+  double best = 0;
+  for (int i = 0; i < runs; i++) {
+    Framebuffer *fb = framebuffer_new(512, 320);
+    uint32_t seed = 1;
+    *pixels = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int n = 0; n < FILL_BENCH_COUNT; n++) {
+      seed = seed * 1664525 + 1013904223;
+      int x = (seed >> 8) % 512;
+      int y = (seed >> 20) % 320;
+      // Every fourth fill clears the whole screen
+      if (n % 4 == 0)
+        x = y = 0;
+
+      framebuffer_fill(fb, n & 1 ? FG_LAYER : BG_LAYER, x, y, 512 - x, 320 - y,
+                       seed >> 30);
+      *pixels += (uint64_t)(512 - x) * (320 - y);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    framebuffer_delete(fb);
+
+    double seconds = elapsed(start, end);
+    if (i == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+
+  return best;
+}
+
+// Best time of `runs` to record RECORD_BENCH_COUNT small fills, each followed
+// by a sprite, into one frame's draw list over a default sized screen, and
+// replay it
+static double bench_recorded_fills(int runs) {
+  Byte sprite[SPRITE_1BPP_BUFFER_SIZE];
+  for (size_t i = 0; i < sizeof(sprite); i++) {
+    sprite[i] = (Byte)(0x3c ^ (i * 0x25));
+  }
+
+  double best = 0;
+  for (int i = 0; i < runs; i++) {
+    Framebuffer *fb = framebuffer_new(512, 320);
+    DrawList *list = drawlist_new();
+    uint32_t seed = 1;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int n = 0; n < RECORD_BENCH_COUNT; n++) {
+      seed = seed * 1664525 + 1013904223;
+      int x = (seed >> 8) % 512;
+      int y = (seed >> 20) % 320;
+      DrawLayer layer = n & 1 ? FG_LAYER : BG_LAYER;
+      drawlist_fill(list, fb, layer, x, y, 6, 6, seed >> 30);
+      drawlist_sprite(list, fb, layer, y, x, sprite, false, seed >> 28, false,
+                      false);
+    }
+    drawlist_flush(list, fb);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    drawlist_delete(list);
+    framebuffer_delete(fb);
+
+    double seconds = elapsed(start, end);
+    if (i == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+
+  return best;
+}
+
+// Best time of `runs` to do COPY_BENCH_COUNT bank to bank copies through the
+// System/expansion port, alternating between copying left and right
+static double bench_copies(int runs) {
+  double best = 0;
+  for (int i = 0; i < runs; i++) {
+    Uxn *uxn = uxn_new(NULL);
+    system_register(uxn);
+
+    Short op = RESET_VECTOR;
+    uxn_mem_write_short(uxn, op + 1, COPY_BENCH_LENGTH);
+    uxn_page_fill(uxn, 1, 0, 0xffff, 0x5a);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int n = 0; n < COPY_BENCH_COUNT; n++) {
+      uxn_mem_write(uxn, op, n & 1 ? CPYR : CPYL);
+      uxn_mem_write_short(uxn, op + 3, 1 + (n & 1));
+      uxn_mem_write_short(uxn, op + 5, n * 0x101);
+      uxn_mem_write_short(uxn, op + 7, 2 - (n & 1));
+      uxn_mem_write_short(uxn, op + 9, n * 0x0203);
+      uxn_dev_write_short(uxn, SYSTEM_EXPANSION_PORT, op);
+      uxn_deo(uxn, SYSTEM_EXPANSION_PORT);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    uxn_delete(uxn);
+
+    double seconds = elapsed(start, end);
+    if (i == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+
+  return best;
+}
+
+static const char *basename_of(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+int main(int argc, char *argv[]) {
+  int runs = DEFAULT_RUNS;
+  const char *commit = "";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:c:")) != -1) {
+    switch (opt) {
+    case 'n':
+      runs = atoi(optarg);
+      break;
+    case 'c':
+      commit = optarg;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-n runs] [-c commit] <rom>...\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (runs < 1)
+    runs = 1;
+
+  printf("{\n  \"commit\": \"%s\",\n  \"runs\": %d,\n  \"roms\": [", commit,
+         runs);
+
+  int status = EXIT_SUCCESS;
+  bool first = true;
+
+  for (int i = optind; i < argc; i++) {
+    BenchResult result;
+    if (!bench_rom(argv[i], runs, &result)) {
+      status = EXIT_FAILURE;
+      continue;
+    }
+
+    double ns_per_instruction =
+        result.instructions ? result.seconds * 1e9 / result.instructions : 0;
+    double instructions_per_second =
+        result.seconds > 0 ? result.instructions / result.seconds : 0;
+    double dispatch_reduction =
+        result.instructions
+            ? 1.0 - (double)result.dispatches / result.instructions
+            : 0;
+
+    printf("%s\n    {\"rom\": \"%s\", \"instructions\": %llu, "
+           "\"dispatches\": %llu, \"wall_ms\": %.3f, "
+           "\"ns_per_instruction\": %.3f, "
+           "\"instructions_per_second\": %.0f}",
+           first ? "" : ",", basename_of(result.rom),
+           (unsigned long long)result.instructions,
+           (unsigned long long)result.dispatches, result.seconds * 1e3,
+           ns_per_instruction, instructions_per_second);
+    first = false;
+
+    fprintf(stderr,
+            "%-16s %12llu instr %5.1f%% fused %10.2f ms %8.3f ns/instr "
+            "%8.1f Minstr/s\n",
+            basename_of(result.rom), (unsigned long long)result.instructions,
+            dispatch_reduction * 100, result.seconds * 1e3,
+            ns_per_instruction, instructions_per_second / 1e6);
+  }
+
+  double sprite_seconds = bench_sprites(runs);
+  double sprites_per_second =
+      sprite_seconds > 0 ? SPRITE_BENCH_COUNT / sprite_seconds : 0;
+
+  uint64_t fill_pixels = 0;
+  double fill_seconds = bench_fills(runs, &fill_pixels);
+  double fills_per_second =
+      fill_seconds > 0 ? FILL_BENCH_COUNT / fill_seconds : 0;
+  double fill_pixels_per_second =
+      fill_seconds > 0 ? fill_pixels / fill_seconds : 0;
+
+  double record_seconds = bench_recorded_fills(runs);
+  double records_per_second =
+      record_seconds > 0 ? RECORD_BENCH_COUNT / record_seconds : 0;
+
+  double copy_seconds = bench_copies(runs);
+  uint64_t copy_bytes = (uint64_t)COPY_BENCH_COUNT * COPY_BENCH_LENGTH;
+  double copy_bytes_per_second =
+      copy_seconds > 0 ? copy_bytes / copy_seconds : 0;
+
+  printf("\n  ],\n  \"sprites\": {\"count\": %d, \"wall_ms\": %.3f, "
+         "\"sprites_per_second\": %.0f},\n",
+         SPRITE_BENCH_COUNT, sprite_seconds * 1e3, sprites_per_second);
+  printf("  \"fills\": {\"count\": %d, \"pixels\": %llu, \"wall_ms\": %.3f, "
+         "\"fills_per_second\": %.0f, \"pixels_per_second\": %.0f},\n",
+         FILL_BENCH_COUNT, (unsigned long long)fill_pixels, fill_seconds * 1e3,
+         fills_per_second, fill_pixels_per_second);
+  printf("  \"recorded_fills\": {\"count\": %d, \"wall_ms\": %.3f, "
+         "\"fills_per_second\": %.0f},\n",
+         RECORD_BENCH_COUNT, record_seconds * 1e3, records_per_second);
+  printf("  \"copies\": {\"count\": %d, \"bytes\": %llu, \"wall_ms\": %.3f, "
+         "\"bytes_per_second\": %.0f}\n}\n",
+         COPY_BENCH_COUNT, (unsigned long long)copy_bytes, copy_seconds * 1e3,
+         copy_bytes_per_second);
+
+  fprintf(stderr, "%-16s %12d sprites %10.2f ms %8.1f Msprites/s\n",
+          "framebuffer", SPRITE_BENCH_COUNT, sprite_seconds * 1e3,
+          sprites_per_second / 1e6);
+  fprintf(stderr, "%-16s %12d fills   %10.2f ms %8.1f Mpixels/s\n",
+          "framebuffer", FILL_BENCH_COUNT, fill_seconds * 1e3,
+          fill_pixels_per_second / 1e6);
+  fprintf(stderr, "%-16s %12d fills   %10.2f ms %8.1f Mfills/s\n",
+          "drawlist", RECORD_BENCH_COUNT, record_seconds * 1e3,
+          records_per_second / 1e6);
+  fprintf(stderr, "%-16s %12d copies  %10.2f ms %8.1f MB/s\n", "expansion",
+          COPY_BENCH_COUNT, copy_seconds * 1e3, copy_bytes_per_second / 1e6);
+
+  return status;
+}
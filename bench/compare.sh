@@ -0,0 +1,25 @@
+#!/usr/bin/env bash
+
+# Runs each ROM with a reference and a candidate uxncli and fails if their
+# output or exit status differ.
+#
+# Usage: bench/compare.sh <reference uxncli> <uxncli> <rom>...
+
+REFERENCE="$1"
+CANDIDATE="$2"
+shift 2
+
+status=0
+for rom in "$@"; do
+  expected=$("$REFERENCE" "$rom" 2>&1; echo "exit $?")
+  actual=$("$CANDIDATE" "$rom" 2>&1; echo "exit $?")
+  if [ "$expected" == "$actual" ]; then
+    printf "%-24s ok\n" "$(basename "$rom")"
+  else
+    printf "%-24s DIFFERS\n" "$(basename "$rom")"
+    diff <(echo "$expected") <(echo "$actual") | head -20
+    status=1
+  fi
+done
+
+exit $status
@@ -0,0 +1,43 @@
+#!/usr/bin/env bash
+
+# Times each ROM with a baseline and a candidate uxncli and prints the speedup.
+#
+# Usage: bench/speedup.sh <baseline uxncli> <uxncli> <rom>...
+
+BASE="$1"
+CANDIDATE="$2"
+shift 2
+
+RUNS=3
+
+# Best wall time of $RUNS runs, in milliseconds
+best_time() {
+  local best=""
+  for _ in $(seq $RUNS); do
+    local start end
+    start=$(date +%s%N)
+    "$1" "$2" > /dev/null
+    end=$(date +%s%N)
+    local ms=$(( (end - start) / 1000000 ))
+    if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+      best=$ms
+    fi
+  done
+  echo "$best"
+}
+
+printf "%-24s %12s %12s %8s\n" "rom" "baseline ms" "ms" "speedup"
+
+total_base=0
+total=0
+for rom in "$@"; do
+  b=$(best_time "$BASE" "$rom")
+  c=$(best_time "$CANDIDATE" "$rom")
+  total_base=$(( total_base + b ))
+  total=$(( total + c ))
+  printf "%-24s %12d %12d %7.2fx\n" "$(basename "$rom")" "$b" "$c" \
+    "$(awk "BEGIN { print $b / ($c > 0 ? $c : 1) }")"
+done
+
+printf "%-24s %12d %12d %7.2fx\n" "total" "$total_base" "$total" \
+  "$(awk "BEGIN { print $total_base / ($total > 0 ? $total : 1) }")"
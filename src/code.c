@@ -0,0 +1,26 @@
+#include "code.h"
+#include "fuse.h"
+#include "jit.h"
+
+static void count_watchers(Uxn *uxn, Short addr, Short length, int delta) {
+  size_t first = addr / CODE_PAGE_SIZE;
+  size_t last = (addr + length - 1) / CODE_PAGE_SIZE;
+  for (size_t page = first; page <= last; page++) {
+    uxn->code_watchers[page % CODE_PAGES] += delta;
+  }
+}
+
+void uxn_code_watch(Uxn *uxn, Short addr, Short length) {
+  count_watchers(uxn, addr, length, 1);
+}
+
+void uxn_code_unwatch(Uxn *uxn, Short addr, Short length) {
+  count_watchers(uxn, addr, length, -1);
+}
+
+void uxn_code_changed(Uxn *uxn, Short addr, size_t length) {
+  uxn_fuse_scan(uxn, addr, length);
+#ifdef UXN_JIT
+  jit_invalidate(uxn, addr, length);
+#endif
+}
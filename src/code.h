@@ -0,0 +1,127 @@
+#include "common.h"
+#include "uxn.h"
+
+#ifndef code_h
+#define code_h
+
+/**
+ * Code tracking.
+ *
+ * The superinstruction table (fuse.h) and the JIT (jit.h) cache code decoded
+ * from page 0, and are only valid while those bytes stay the same. Page 0 is
+ * split into CODE_PAGES pages of CODE_PAGE_SIZE bytes, and the Uxn keeps two
+ * numbers for each of them:
+ *
+ * - a generation, bumped by every write to the page, so that anything holding
+ *   on to decoded code can tell whether the page changed since it last looked
+ *   with a single load;
+ * - the number of cached decodings that read bytes from the page.
+ *
+ * Every function in uxn.c that writes page 0 reports the write here. Stores to
+ * pages no cache has read from cost an increment and a load, the caches are
+ * only called for the others.
+ */
+
+/**
+ * @brief Generation of the code page holding an address.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param addr Address in page 0.
+ * @return A counter that changes whenever the page is written.
+ */
+static inline uint32_t uxn_code_generation(Uxn *uxn, Short addr) {
+  return uxn->code_generations[addr / CODE_PAGE_SIZE];
+}
+
+/**
+ * @brief Whether any cache has decoded code from the page holding an address.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param addr Address in page 0.
+ */
+static inline bool uxn_code_watched(Uxn *uxn, Short addr) {
+  return uxn->code_watchers[addr / CODE_PAGE_SIZE] != 0;
+}
+
+/**
+ * @brief Record that a cache decoded code from a range of page 0.
+ *
+ * Each call must be matched by a call to `uxn_code_unwatch` with the same
+ * range once the cache drops the code. Ranges wrap around at the end of the
+ * page.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param addr First address read.
+ * @param length Number of bytes read, at least 1.
+ */
+void uxn_code_watch(Uxn *uxn, Short addr, Short length);
+
+/**
+ * @brief Undo a call to `uxn_code_watch`.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param addr First address read.
+ * @param length Number of bytes read, at least 1.
+ */
+void uxn_code_unwatch(Uxn *uxn, Short addr, Short length);
+
+/**
+ * @brief Tell the caches that a range of page 0 has changed.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param addr First address written.
+ * @param length Number of bytes written, anything from 0x10000 up covers the
+ * whole page.
+ */
+void uxn_code_changed(Uxn *uxn, Short addr, size_t length);
+
+// Bumps the generation of every page in the range, returns whether any of
+// them is watched
+static inline bool uxn_code_touch(Uxn *uxn, Short addr, size_t length) {
+  if (length >= RAM_PAGE_SIZE) {
+    addr = 0;
+    length = RAM_PAGE_SIZE;
+  }
+
+  bool watched = false;
+  size_t first = addr / CODE_PAGE_SIZE;
+  size_t last = (addr + length - 1) / CODE_PAGE_SIZE;
+  for (size_t page = first; page <= last; page++) {
+    uxn->code_generations[page % CODE_PAGES]++;
+    watched |= uxn->code_watchers[page % CODE_PAGES] != 0;
+  }
+  return watched;
+}
+
+/**
+ * @brief Report a store to page 0.
+ *
+ * Only calls into the caches when the store hit a watched page.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param addr First address written.
+ * @param length Number of bytes written.
+ */
+static inline void uxn_code_written(Uxn *uxn, Short addr, size_t length) {
+  if (length && uxn_code_touch(uxn, addr, length))
+    uxn_code_changed(uxn, addr, length);
+}
+
+/**
+ * @brief Report a block of data, such as a ROM, loaded into page 0.
+ *
+ * Unlike a store this always calls into the caches, which scan newly loaded
+ * code for idioms.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param addr First address written.
+ * @param length Number of bytes written.
+ */
+static inline void uxn_code_loaded(Uxn *uxn, Short addr, size_t length) {
+  if (length) {
+    uxn_code_touch(uxn, addr, length);
+    uxn_code_changed(uxn, addr, length);
+  }
+}
+
+#endif // code_h
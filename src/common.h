@@ -16,7 +16,11 @@ typedef int16_t SignedShort;
 #define STACK_SIZE 0x100
 #define RAM_PAGES 0x10
 #define RAM_PAGE_SIZE 0x10000
-#define DEV_PAGE_SIZE 0x10000
+#define DEV_PAGE_SIZE 0x100
+
+// Granularity of code tracking in page 0, see code.h
+#define CODE_PAGE_SIZE 0x100
+#define CODE_PAGES (RAM_PAGE_SIZE / CODE_PAGE_SIZE)
 
 #define DEVICE_PAGE_SYSTEM 0x00
 #define DEVICE_PAGE_CONSOLE 0x10
@@ -35,6 +39,13 @@ typedef int16_t SignedShort;
 // No device at 0xe0
 // No device at 0xf0
 
+// Forces inlining so that constant arguments fold away in the caller
+#if defined(__GNUC__)
+#define UXN_INLINE static inline __attribute__((always_inline))
+#else
+#define UXN_INLINE static inline
+#endif
+
 static inline int high_nibble(Byte byte) { return (byte & 0xf0) >> 4; }
 
 static inline int low_nibble(Byte byte) { return byte & 0x0f; }
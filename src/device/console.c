@@ -30,9 +30,13 @@ void console_poll(Uxn *uxn) {
 
   if (fds[0].revents & POLLIN) {
     char buffer[CONSOLE_INPUT_BUFFER_SIZE] = {0};
-    size_t read_size = read(STDIN_FILENO, buffer, CONSOLE_INPUT_BUFFER_SIZE);
+    ssize_t read_size = read(STDIN_FILENO, buffer, CONSOLE_INPUT_BUFFER_SIZE);
 
-    for (size_t i = 0; i < read_size - 1; i++) {
+    // Closed, stdin stays readable but never has anything in it
+    if (read_size <= 0)
+      return;
+
+    for (ssize_t i = 0; i < read_size - 1; i++) {
       console_input_event(uxn, buffer[i], CONSOLE_TYPE_STDIN);
     }
 
@@ -64,4 +68,9 @@ void console_deo(Uxn *uxn, Byte addr) {
   default:
     break;
   }
-}
\ No newline at end of file
+}
+
+void console_register(Uxn *uxn) {
+  uxn_set_deo(uxn, CONSOLE_WRITE_PORT, console_deo);
+  uxn_set_deo(uxn, CONSOLE_ERROR_PORT, console_deo);
+}
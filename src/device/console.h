@@ -23,4 +23,11 @@ void console_poll(Uxn *uxn);
 int console_input_event(Uxn *uxn, Byte c, Byte type);
 void console_deo(Uxn *uxn, Byte addr);
 
+/**
+ * @brief Register the console's output ports.
+ *
+ * @param uxn Pointer to the Uxn VM.
+ */
+void console_register(Uxn *uxn);
+
 #endif // console_h
\ No newline at end of file
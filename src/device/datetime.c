@@ -37,4 +37,10 @@ Byte datetime_dei(Uxn *uxn, Byte addr) {
   }
 
   free(tm);
-}
\ No newline at end of file
+}
+
+void datetime_register(Uxn *uxn) {
+  for (Byte addr = DATETIME_YEAR_PORT; addr <= DATETIME_ISDST_PORT; addr++) {
+    uxn_set_dei(uxn, addr, datetime_dei);
+  }
+}
@@ -16,4 +16,11 @@
 
 Byte datetime_dei(Uxn *uxn, Byte addr);
 
+/**
+ * @brief Register every datetime port, as they are all read from the clock.
+ *
+ * @param uxn Pointer to the Uxn VM.
+ */
+void datetime_register(Uxn *uxn);
+
 #endif // datetime_h
\ No newline at end of file
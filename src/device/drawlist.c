@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "drawlist.h"
+
+#define T DrawList
+
+#define INITIAL_COMMANDS 256
+#define INITIAL_DATA 4096
+// Commands a fill looks back over when it doesn't cover everything on its
+// layer
+#define COVER_SCAN 64
+
+T *drawlist_new(void) {
+  T *list = (T *)malloc(sizeof(T));
+  *list = (T){
+      .commands = malloc(INITIAL_COMMANDS * sizeof(DrawCommand)),
+      .length = 0,
+      .capacity = INITIAL_COMMANDS,
+      .data = malloc(INITIAL_DATA),
+      .data_length = 0,
+      .data_capacity = INITIAL_DATA,
+      .sprites = 0,
+      .culled = 0,
+      .covered = 0,
+      .bounds = {{0}},
+      .start = {0},
+  };
+  return list;
+}
+
+void drawlist_delete(T *list) {
+  free(list->commands);
+  free(list->data);
+  free(list);
+}
+
+static DrawCommand *last_command(T *list) {
+  return list->length ? &list->commands[list->length - 1] : NULL;
+}
+
+static DrawCommand *push_command(T *list, DrawCommand command) {
+  if (list->length == list->capacity) {
+    list->capacity *= 2;
+    list->commands =
+        realloc(list->commands, list->capacity * sizeof(DrawCommand));
+  }
+
+  list->commands[list->length] = command;
+  return &list->commands[list->length++];
+}
+
+static void push_data(T *list, const Byte *data, size_t length) {
+  while (list->data_length + length > list->data_capacity) {
+    list->data_capacity *= 2;
+    list->data = realloc(list->data, list->data_capacity);
+  }
+
+  memcpy(list->data + list->data_length, data, length);
+  list->data_length += length;
+}
+
+// Whether a rectangle misses the framebuffer entirely
+static bool culled(Framebuffer *fb, int x, int y, int width, int height) {
+  return width <= 0 || height <= 0 || x >= fb->width || y >= fb->height ||
+         x + width <= 0 || y + height <= 0;
+}
+
+// Bounds of everything a command draws
+static FramebufferRect command_bounds(DrawCommand *command) {
+  if (command->kind == DRAW_FILL)
+    return (FramebufferRect){command->x, command->y, command->width,
+                             command->height};
+
+  int last_x = command->x + (int)(command->count - 1) * command->width;
+  int last_y = command->y + (int)(command->count - 1) * command->height;
+  return (FramebufferRect){
+      command->x < last_x ? command->x : last_x,
+      command->y < last_y ? command->y : last_y,
+      abs(last_x - command->x) + SPRITE_WIDTH,
+      abs(last_y - command->y) + SPRITE_HEIGHT,
+  };
+}
+
+static FramebufferRect clip(Framebuffer *fb, FramebufferRect rect) {
+  int x1 = rect.x + rect.width > fb->width ? fb->width : rect.x + rect.width;
+  int y1 = rect.y + rect.height > fb->height ? fb->height : rect.y + rect.height;
+  int x0 = rect.x < 0 ? 0 : rect.x;
+  int y0 = rect.y < 0 ? 0 : rect.y;
+  return (FramebufferRect){x0, y0, x1 - x0, y1 - y0};
+}
+
+// Whether a holds all of b
+static bool contains(FramebufferRect a, FramebufferRect b) {
+  return b.x >= a.x && b.y >= a.y && b.x + b.width <= a.x + a.width &&
+         b.y + b.height <= a.y + a.height;
+}
+
+// Grows the bounds of the drawing on a command's layer to hold the command
+static void grow_bounds(T *list, Framebuffer *fb, DrawCommand *command) {
+  FramebufferRect drawn = clip(fb, command_bounds(command));
+  FramebufferRect *bounds = &list->bounds[command->layer];
+  if (bounds->width <= 0 || bounds->height <= 0) {
+    *bounds = drawn;
+    return;
+  }
+
+  int x0 = bounds->x < drawn.x ? bounds->x : drawn.x;
+  int y0 = bounds->y < drawn.y ? bounds->y : drawn.y;
+  int x1 = bounds->x + bounds->width > drawn.x + drawn.width
+               ? bounds->x + bounds->width
+               : drawn.x + drawn.width;
+  int y1 = bounds->y + bounds->height > drawn.y + drawn.height
+               ? bounds->y + bounds->height
+               : drawn.y + drawn.height;
+  *bounds = (FramebufferRect){x0, y0, x1 - x0, y1 - y0};
+}
+
+void drawlist_pixel(T *list, Framebuffer *fb, DrawLayer layer, int x, int y,
+                    Byte color) {
+  if (culled(fb, x, y, 1, 1)) {
+    list->culled++;
+    return;
+  }
+
+  color &= 0x03;
+
+  // Extend a run of pixels drawn left to right
+  DrawCommand *last = last_command(list);
+  if (last && last->kind == DRAW_FILL && last->layer == layer &&
+      last->color == color && last->height == 1 && last->y == y &&
+      last->x + last->width == x) {
+    last->width++;
+    grow_bounds(list, fb, last);
+    return;
+  }
+
+  DrawCommand *command = push_command(list, (DrawCommand){.kind = DRAW_FILL,
+                                                          .layer = layer,
+                                                          .color = color,
+                                                          .x = x,
+                                                          .y = y,
+                                                          .width = 1,
+                                                          .height = 1});
+  grow_bounds(list, fb, command);
+}
+
+// Drops the commands on a layer whose visible part a fill draws over
+static void cover(T *list, Framebuffer *fb, DrawLayer layer,
+                  FramebufferRect fill) {
+  fill = clip(fb, fill);
+
+  // Everything on the layer before start is covered already, and everything
+  // after it lies in bounds. A fill over all of that covers it without
+  // checking each command, and moves start past it, so no command is looked
+  // at this way twice.
+  bool everything = contains(fill, list->bounds[layer]);
+  size_t first = list->start[layer];
+  if (!everything && list->length - first > COVER_SCAN)
+    first = list->length - COVER_SCAN;
+
+  for (size_t i = first; i < list->length; i++) {
+    DrawCommand *command = &list->commands[i];
+    if (command->kind == DRAW_COVERED || command->layer != layer)
+      continue;
+
+    if (everything || contains(fill, clip(fb, command_bounds(command)))) {
+      command->kind = DRAW_COVERED;
+      list->covered++;
+    }
+  }
+
+  // Covered commands at the end of the list can go, with their sprite data
+  while (list->length &&
+         list->commands[list->length - 1].kind == DRAW_COVERED) {
+    DrawCommand *command = &list->commands[--list->length];
+    // Only sprite runs have a count
+    if (command->count)
+      list->data_length = command->data;
+  }
+
+  // The fill goes next
+  if (everything) {
+    list->start[layer] = list->length;
+    list->bounds[layer] = (FramebufferRect){0};
+  }
+  for (int i = 0; i < 2; i++) {
+    if (list->start[i] > list->length)
+      list->start[i] = list->length;
+  }
+}
+
+void drawlist_fill(T *list, Framebuffer *fb, DrawLayer layer, int x, int y,
+                   int width, int height, Byte color) {
+  if (culled(fb, x, y, width, height)) {
+    list->culled++;
+    return;
+  }
+
+  cover(list, fb, layer, (FramebufferRect){x, y, width, height});
+
+  DrawCommand *command = push_command(list, (DrawCommand){.kind = DRAW_FILL,
+                                                          .layer = layer,
+                                                          .color = color & 0x03,
+                                                          .x = x,
+                                                          .y = y,
+                                                          .width = width,
+                                                          .height = height});
+  grow_bounds(list, fb, command);
+}
+
+// Whether a sprite at dx, dy from the last one sits right next to it
+static bool sprite_step(int dx, int dy) {
+  return (dy == 0 && (dx == SPRITE_WIDTH || dx == -SPRITE_WIDTH)) ||
+         (dx == 0 && (dy == SPRITE_HEIGHT || dy == -SPRITE_HEIGHT));
+}
+
+void drawlist_sprite(T *list, Framebuffer *fb, DrawLayer layer, int x, int y,
+                     const Byte *sprite, bool two_bit, Byte color, bool flip_x,
+                     bool flip_y) {
+  if (culled(fb, x, y, SPRITE_WIDTH, SPRITE_HEIGHT)) {
+    list->culled++;
+    return;
+  }
+
+  list->sprites++;
+
+  Byte flags = (two_bit ? DRAW_TWO_BIT : 0) | (flip_x ? DRAW_FLIP_X : 0) |
+               (flip_y ? DRAW_FLIP_Y : 0);
+  size_t size = two_bit ? SPRITE_2BPP_BUFFER_SIZE : SPRITE_1BPP_BUFFER_SIZE;
+  color &= 0x0f;
+
+  // Join the run of the last command when this sprite continues it. The run's
+  // data is always at the end of the list's, as fills don't have any.
+  DrawCommand *last = last_command(list);
+  if (last && last->kind == DRAW_SPRITES && last->layer == layer &&
+      last->color == color && last->flags == flags) {
+    int dx = x - (last->x + (int)(last->count - 1) * last->width);
+    int dy = y - (last->y + (int)(last->count - 1) * last->height);
+
+    bool continues = last->count == 1
+                         ? sprite_step(dx, dy)
+                         : dx == last->width && dy == last->height;
+    if (continues) {
+      last->width = dx;
+      last->height = dy;
+      last->count++;
+      push_data(list, sprite, size);
+      grow_bounds(list, fb, last);
+      return;
+    }
+  }
+
+  DrawCommand *command =
+      push_command(list, (DrawCommand){.kind = DRAW_SPRITES,
+                                       .layer = layer,
+                                       .color = color,
+                                       .flags = flags,
+                                       .count = 1,
+                                       .x = x,
+                                       .y = y,
+                                       .data = list->data_length});
+  push_data(list, sprite, size);
+  grow_bounds(list, fb, command);
+}
+
+void drawlist_touch(T *list, Framebuffer *fb) {
+  for (size_t i = 0; i < list->length; i++) {
+    DrawCommand *command = &list->commands[i];
+
+    if (command->kind == DRAW_COVERED)
+      continue;
+
+    FramebufferRect bounds = command_bounds(command);
+    framebuffer_touch(fb, command->layer, bounds.x, bounds.y, bounds.width,
+                      bounds.height);
+  }
+}
+
+void drawlist_draw_rows(T *list, Framebuffer *fb, int top, int bottom) {
+  for (size_t i = 0; i < list->length; i++) {
+    DrawCommand *command = &list->commands[i];
+
+    if (command->kind == DRAW_FILL) {
+      if (command->y < bottom && command->y + command->height > top)
+        framebuffer_fill_rows(fb, command->layer, command->x, command->y,
+                              command->width, command->height, command->color,
+                              top, bottom);
+      continue;
+    }
+
+    if (command->kind == DRAW_COVERED)
+      continue;
+
+    bool two_bit = command->flags & DRAW_TWO_BIT;
+    size_t size = two_bit ? SPRITE_2BPP_BUFFER_SIZE : SPRITE_1BPP_BUFFER_SIZE;
+    const Byte *sprite = list->data + command->data;
+
+    for (uint32_t n = 0; n < command->count; n++, sprite += size) {
+      int y = command->y + (int)n * command->height;
+      if (y >= bottom || y + SPRITE_HEIGHT <= top)
+        continue;
+
+      framebuffer_sprite_rows(fb, command->layer,
+                              command->x + (int)n * command->width, y, sprite,
+                              two_bit, command->color,
+                              command->flags & DRAW_FLIP_X,
+                              command->flags & DRAW_FLIP_Y, top, bottom);
+    }
+  }
+}
+
+void drawlist_clear(T *list) {
+  list->length = 0;
+  list->data_length = 0;
+  list->sprites = 0;
+  list->culled = 0;
+  list->covered = 0;
+  for (int i = 0; i < 2; i++) {
+    list->bounds[i] = (FramebufferRect){0};
+    list->start[i] = 0;
+  }
+}
+
+void drawlist_flush(T *list, Framebuffer *fb) {
+  drawlist_touch(list, fb);
+  drawlist_draw_rows(list, fb, 0, fb->height);
+  drawlist_clear(list);
+}
+
+void drawlist_dump(T *list, FILE *out) {
+  static const char *layers[] = {"bg", "fg"};
+
+  fprintf(out,
+          "draw list: %zu commands, %llu sprites, %llu culled, %llu covered\n",
+          list->length, (unsigned long long)list->sprites,
+          (unsigned long long)list->culled,
+          (unsigned long long)list->covered);
+
+  for (size_t i = 0; i < list->length; i++) {
+    DrawCommand *command = &list->commands[i];
+
+    if (command->kind == DRAW_COVERED)
+      continue;
+
+    if (command->kind == DRAW_FILL) {
+      fprintf(out, "  fill    %s %d,%d %dx%d color %d\n",
+              layers[command->layer], command->x, command->y, command->width,
+              command->height, command->color);
+      continue;
+    }
+
+    fprintf(out, "  sprites %s %d,%d x%u step %d,%d color %x%s%s%s\n",
+            layers[command->layer], command->x, command->y, command->count,
+            command->width, command->height, command->color,
+            command->flags & DRAW_TWO_BIT ? " 2bpp" : "",
+            command->flags & DRAW_FLIP_X ? " flip_x" : "",
+            command->flags & DRAW_FLIP_Y ? " flip_y" : "");
+  }
+}
@@ -0,0 +1,177 @@
+#include "../common.h"
+#include "framebuffer.h"
+#include <stdio.h>
+
+#ifndef drawlist_h
+#define drawlist_h
+
+#define T DrawList
+
+/**
+ * The screen device's drawing for one frame, recorded as it happens and
+ * replayed into the framebuffer in one pass at the end of the frame.
+ *
+ * Recording culls anything that lands entirely off the framebuffer, and
+ * merges commands that continue the previous one: a pixel next to the last
+ * one becomes a wider fill, and a sprite 8 pixels on from the last one, with
+ * the same colour, layer and flips, joins its run. A fill that covers
+ * everything drawn on its layer so far drops all of it, such as last frame's
+ * drawing under a clear of the whole screen. Other fills only drop those of
+ * the last few commands that they cover entirely, so that recording stays
+ * linear. Sprite data is copied when it is recorded, so later writes to RAM
+ * don't change the frame.
+ */
+typedef struct T T;
+
+// DRAW_COVERED marks a command hidden by a later fill
+typedef enum { DRAW_FILL, DRAW_SPRITES, DRAW_COVERED } DrawKind;
+
+#define DRAW_TWO_BIT 0x01
+#define DRAW_FLIP_X 0x02
+#define DRAW_FLIP_Y 0x04
+
+typedef struct {
+  Byte kind;
+  Byte layer;
+  // Palette index of a fill, or colour nibble of a sprite run
+  Byte color;
+  // DRAW_TWO_BIT, DRAW_FLIP_X and DRAW_FLIP_Y for sprites
+  Byte flags;
+  // Sprites in a run
+  uint32_t count;
+  int32_t x;
+  int32_t y;
+  // Size of a fill, or the step from one sprite of a run to the next
+  int32_t width;
+  int32_t height;
+  // Offset of the first sprite's data
+  uint32_t data;
+} DrawCommand;
+
+struct T {
+  DrawCommand *commands;
+  size_t length;
+  size_t capacity;
+  // Sprite data of every sprite command, one after the other
+  Byte *data;
+  size_t data_length;
+  size_t data_capacity;
+  // Per layer, bounds of everything recorded since the last fill that covered
+  // all of the layer, and where that fill is in the list
+  FramebufferRect bounds[2];
+  size_t start[2];
+  // Sprites recorded, commands dropped by culling and commands hidden by a
+  // later fill, this frame
+  uint64_t sprites;
+  uint64_t culled;
+  uint64_t covered;
+};
+
+/**
+ * @brief Allocate an empty draw list.
+ *
+ * @return A pointer to the new draw list.
+ */
+T *drawlist_new(void);
+
+/**
+ * @brief Free a draw list.
+ *
+ * @param list Pointer to the draw list.
+ */
+void drawlist_delete(T *list);
+
+/**
+ * @brief Record setting one pixel.
+ *
+ * @param list Pointer to the draw list.
+ * @param fb Framebuffer the list will be replayed into, for culling.
+ * @param layer Layer to draw on.
+ * @param x Column.
+ * @param y Row.
+ * @param color Index from 0 to 3.
+ */
+void drawlist_pixel(T *list, Framebuffer *fb, DrawLayer layer, int x, int y,
+                    Byte color);
+
+/**
+ * @brief Record a fill, see `framebuffer_fill`.
+ *
+ * @param list Pointer to the draw list.
+ * @param fb Framebuffer the list will be replayed into, for culling.
+ * @param layer Layer to draw on.
+ * @param x Left edge.
+ * @param y Top edge.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @param color Index from 0 to 3.
+ */
+void drawlist_fill(T *list, Framebuffer *fb, DrawLayer layer, int x, int y,
+                   int width, int height, Byte color);
+
+/**
+ * @brief Record a sprite, see `framebuffer_sprite`.
+ *
+ * @param list Pointer to the draw list.
+ * @param fb Framebuffer the list will be replayed into, for culling.
+ * @param layer Layer to draw on.
+ * @param x Left edge.
+ * @param y Top edge.
+ * @param sprite 8 or 16 bytes of sprite data, copied into the list.
+ * @param two_bit Whether the sprite has a high bit plane.
+ * @param color Colour nibble from the sprite port.
+ * @param flip_x Mirror the sprite horizontally.
+ * @param flip_y Mirror the sprite vertically.
+ */
+void drawlist_sprite(T *list, Framebuffer *fb, DrawLayer layer, int x, int y,
+                     const Byte *sprite, bool two_bit, Byte color, bool flip_x,
+                     bool flip_y);
+
+/**
+ * @brief Draw every recorded command into a framebuffer, in order, and empty
+ * the list.
+ *
+ * @param list Pointer to the draw list.
+ * @param fb Framebuffer to draw into.
+ */
+void drawlist_flush(T *list, Framebuffer *fb);
+
+/**
+ * @brief Mark everything the recorded commands draw dirty, ahead of
+ * `drawlist_draw_rows`.
+ *
+ * @param list Pointer to the draw list.
+ * @param fb Framebuffer the list will be drawn into.
+ */
+void drawlist_touch(T *list, Framebuffer *fb);
+
+/**
+ * @brief Draw the part of every recorded command that falls in a band of rows,
+ * in order, without marking it dirty.
+ *
+ * Calls for bands that don't overlap may run concurrently.
+ *
+ * @param list Pointer to the draw list.
+ * @param fb Framebuffer to draw into.
+ * @param top First row of the band.
+ * @param bottom Row after the last row of the band.
+ */
+void drawlist_draw_rows(T *list, Framebuffer *fb, int top, int bottom);
+
+/**
+ * @brief Empty the list for the next frame.
+ *
+ * @param list Pointer to the draw list.
+ */
+void drawlist_clear(T *list);
+
+/**
+ * @brief Print the recorded commands, one per line.
+ *
+ * @param list Pointer to the draw list.
+ * @param out Stream to print to.
+ */
+void drawlist_dump(T *list, FILE *out);
+
+#undef T
+#endif // drawlist_h
@@ -566,7 +566,8 @@ void file_name_port_deo(Uxn *uxn, UxnStream *stream, Byte page) {
   stream_init(stream, name);
 }
 
-void file_deo(Uxn *uxn, Byte addr) {
+// Returns both streams, allocating them the first time
+static UxnStream *open_files(Uxn *uxn) {
   UxnStream *streams = uxn_get_open_files(uxn);
 
   if (!streams) {
@@ -582,6 +583,12 @@ void file_deo(Uxn *uxn, Byte addr) {
     }
   }
 
+  return streams;
+}
+
+void file_deo(Uxn *uxn, Byte addr) {
+  UxnStream *streams = open_files(uxn);
+
   UxnStream *stream = &streams[FILE_IDX(addr)];
   const Byte page = addr & 0xf0;
   const Byte port = addr & 0x0f;
@@ -622,3 +629,147 @@ void file_deo(Uxn *uxn, Byte addr) {
 }
 
 Byte file_dei(Uxn *uxn, Byte addr) { return uxn_dev_read(uxn, addr); }
+
+void file_register(Uxn *uxn) {
+  const Byte pages[] = {FILE_A_PAGE, FILE_B_PAGE};
+  const Byte ports[] = {FILE_STAT_PORT, FILE_DELETE_PORT, FILE_NAME_PORT,
+                        FILE_READ_PORT, FILE_WRITE_PORT};
+
+  for (size_t page = 0; page < sizeof(pages); page++) {
+    for (size_t port = 0; port < sizeof(ports); port++) {
+      uxn_set_deo(uxn, pages[page] | ports[port], file_deo);
+    }
+  }
+}
+
+// Snapshots
+
+static bool stream_save(UxnStream *stream, FILE *out) {
+  char *name = stream->file.name;
+  if (!name)
+    return snapshot_write_byte(out, 0);
+
+  Short name_length = strlen(name);
+  uint32_t position = 0;
+  if (stream->file.type == UXN_DIR_TYPE)
+    position = stream->dir.read_offset;
+  else if (stream->file.fp)
+    position = ftello(stream->file.fp);
+
+  bool ok = snapshot_write_byte(out, 1) &&
+            snapshot_write_byte(out, stream->file.type) &&
+            snapshot_write_byte(out, stream->file.state) &&
+            snapshot_write_short(out, name_length) &&
+            snapshot_write(out, name, name_length) &&
+            snapshot_write_long(out, position);
+
+  // A directory's listing is kept, so reading it carries on where it was
+  if (ok && stream->file.type == UXN_DIR_TYPE) {
+    char *content = stream->dir.content;
+    uint32_t content_length = content ? strlen(content) : 0;
+    ok = snapshot_write_long(out, content_length) &&
+         snapshot_write(out, content, content_length);
+  }
+  return ok;
+}
+
+static bool file_save(Uxn *uxn, FILE *out) {
+  UxnStream *streams = uxn_get_open_files(uxn);
+
+  for (int i = 0; i < FILE_COUNT; i++) {
+    if (!(streams ? stream_save(&streams[i], out)
+                  : snapshot_write_byte(out, 0)))
+      return false;
+  }
+  return true;
+}
+
+// Reopens a file the way it was open when the snapshot was taken, without
+// truncating what was written to it
+static void file_resume(UxnFile *file, UxnFileState state, off_t position) {
+  switch (state) {
+  case STATE_READ:
+    file->fp = fopen(file->name, "r");
+    break;
+  case STATE_WRITE:
+    file->fp = fopen(file->name, "r+");
+    break;
+  case STATE_APPEND:
+    file->fp = fopen(file->name, "a");
+    break;
+  default:
+    break;
+  }
+
+  file->state = state;
+  if (file->fp && state != STATE_APPEND)
+    fseeko(file->fp, position, SEEK_SET);
+}
+
+static bool stream_load(UxnStream *stream, FILE *in) {
+  stream_close(stream);
+  *stream = (union UxnStream){0};
+
+  Byte present, type, state;
+  if (!snapshot_read_byte(in, &present))
+    return false;
+  if (!present)
+    return true;
+
+  Short name_length;
+  uint32_t position;
+  if (!snapshot_read_byte(in, &type) || !snapshot_read_byte(in, &state) ||
+      !snapshot_read_short(in, &name_length) || state >= STATE_COUNT)
+    return false;
+
+  char *name = calloc(name_length + 1, 1);
+  if (!snapshot_read(in, name, name_length) ||
+      !snapshot_read_long(in, &position)) {
+    free(name);
+    return false;
+  }
+
+  if (type == UXN_DIR_TYPE) {
+    uint32_t content_length;
+    if (!snapshot_read_long(in, &content_length)) {
+      free(name);
+      return false;
+    }
+    char *content = calloc(content_length + 1, 1);
+    if (!snapshot_read(in, content, content_length)) {
+      free(content);
+      free(name);
+      return false;
+    }
+
+    dir_init(&stream->dir, name);
+    if (state == STATE_READ && dir_open(&stream->dir)) {
+      stream->dir.state = STATE_READ;
+      stream->dir.content = content_length ? content : NULL;
+      stream->dir.read_offset = position;
+    }
+    if (stream->dir.content != content)
+      free(content);
+    return true;
+  }
+
+  file_init(&stream->file, name);
+  file_resume(&stream->file, state, position);
+  return true;
+}
+
+static bool file_load(Uxn *uxn, FILE *in, uint32_t length) {
+  (void)length;
+  UxnStream *streams = open_files(uxn);
+  if (!streams)
+    return false;
+
+  for (int i = 0; i < FILE_COUNT; i++) {
+    if (!stream_load(&streams[i], in))
+      return false;
+  }
+  return true;
+}
+
+const SnapshotDevice file_snapshot = {
+    .tag = "FILE", .save = file_save, .load = file_load};
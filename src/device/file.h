@@ -1,4 +1,5 @@
 #include "../common.h"
+#include "../snapshot.h"
 #include "../uxn.h"
 
 #ifndef file_h
@@ -19,4 +20,17 @@
 void file_deo(Uxn *uxn, Byte addr);
 Byte file_dei(Uxn *uxn, Byte addr);
 
+/**
+ * @brief Register the ports of both file devices that act on files.
+ *
+ * @param uxn Pointer to the Uxn VM.
+ */
+void file_register(Uxn *uxn);
+
+/**
+ * Saves the name, state and position of both file devices' streams, which are
+ * reopened where they were when loading.
+ */
+extern const SnapshotDevice file_snapshot;
+
 #endif // file_h
\ No newline at end of file
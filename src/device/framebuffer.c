@@ -0,0 +1,356 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "framebuffer.h"
+
+#define T Framebuffer
+
+// clang-format off
+
+// From the Varvara spec:
+// c = !ch
+//    ? (color % 5 ? color >> 2 : 0)
+//    : color % 4 + ch == 1 ? 0 : (ch - 2 + (color & 3)) % 3 + 1;
+static const Byte color_table[16][4] = {
+    {0, 0, 1, 2}, // In 1bpp mode index 0 = clear and index 1 = transparent
+    {0, 1, 2, 3},
+    {0, 2, 3, 1},
+    {0, 3, 1, 2},
+    {1, 0, 1, 2},
+    {0, 1, 2, 3}, // 0 in this mode is transparent
+    {1, 2, 3, 1},
+    {1, 3, 1, 2},
+    {2, 0, 1, 2},
+    {2, 1, 2, 3},
+    {0, 2, 3, 1}, // 0 in this mode is transparent
+    {2, 3, 1, 2},
+    {3, 0, 1, 2},
+    {3, 1, 2, 3},
+    {3, 2, 3, 1},
+    {0, 3, 1, 2}, // 0 in this mode is transparent
+};
+
+// clang-format on
+
+// The low bit of every pixel in a packed row of 8
+#define PIXEL_LOW_BITS 0x5555
+
+// Moves bit `bit` of a sprite row to the low bit of pixel `i`
+#define SPREAD(b, i, bit) ((((b) >> (bit)) & 1) << (2 * (i)))
+
+// The leftmost pixel of a sprite row is its top bit
+#define EXPAND(b)                                                              \
+  (SPREAD(b, 0, 7) | SPREAD(b, 1, 6) | SPREAD(b, 2, 5) | SPREAD(b, 3, 4) |    \
+   SPREAD(b, 4, 3) | SPREAD(b, 5, 2) | SPREAD(b, 6, 1) | SPREAD(b, 7, 0))
+#define EXPAND_FLIPPED(b)                                                      \
+  (SPREAD(b, 0, 0) | SPREAD(b, 1, 1) | SPREAD(b, 2, 2) | SPREAD(b, 3, 3) |    \
+   SPREAD(b, 4, 4) | SPREAD(b, 5, 5) | SPREAD(b, 6, 6) | SPREAD(b, 7, 7))
+
+#define TABLE4(F, n) F(n), F(n + 1), F(n + 2), F(n + 3)
+#define TABLE16(F, n)                                                          \
+  TABLE4(F, n), TABLE4(F, n + 4), TABLE4(F, n + 8), TABLE4(F, n + 12)
+#define TABLE64(F, n)                                                          \
+  TABLE16(F, n), TABLE16(F, n + 16), TABLE16(F, n + 32), TABLE16(F, n + 48)
+#define TABLE256(F)                                                            \
+  TABLE64(F, 0), TABLE64(F, 64), TABLE64(F, 128), TABLE64(F, 192)
+
+/**
+ * A sprite row expanded to 8 packed pixels, each 1 where the row has a bit
+ * set, indexed by flip_x and the row.
+ */
+static const uint16_t expand_table[2][256] = {
+    {TABLE256(EXPAND)},
+    {TABLE256(EXPAND_FLIPPED)},
+};
+
+/**
+ * Four packed sprite colours mapped to four packed palette indices, indexed by
+ * the colour nibble. Filled in by the first framebuffer_new.
+ */
+static Byte blend_table[16][256];
+
+static void init_blend_table(void) {
+  for (size_t color = 0; color < 16; color++) {
+    for (size_t packed = 0; packed < 256; packed++) {
+      Byte blended = 0;
+      for (size_t pixel = 0; pixel < FRAMEBUFFER_PIXELS_PER_BYTE; pixel++) {
+        Byte ch = (packed >> (2 * pixel)) & 0x03;
+        blended |= color_table[color][ch] << (2 * pixel);
+      }
+      blend_table[color][packed] = blended;
+    }
+  }
+}
+
+static void alloc_layers(T *fb, Short width, Short height) {
+  fb->width = width;
+  fb->height = height;
+  fb->stride =
+      (width + FRAMEBUFFER_PIXELS_PER_BYTE - 1) / FRAMEBUFFER_PIXELS_PER_BYTE;
+
+  for (size_t i = 0; i < 2; i++) {
+    // One spare byte so that zero sized layers are still valid pointers
+    fb->layers[i] = calloc(fb->stride * height + 1, 1);
+  }
+
+  framebuffer_touch_all(fb);
+}
+
+static bool rect_empty(FramebufferRect rect) {
+  return rect.width <= 0 || rect.height <= 0;
+}
+
+// Smallest rectangle holding both
+static FramebufferRect rect_union(FramebufferRect a, FramebufferRect b) {
+  if (rect_empty(a))
+    return b;
+  if (rect_empty(b))
+    return a;
+
+  int x0 = a.x < b.x ? a.x : b.x;
+  int y0 = a.y < b.y ? a.y : b.y;
+  int x1 = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+  int y1 = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+  return (FramebufferRect){x0, y0, x1 - x0, y1 - y0};
+}
+
+static void touch(T *fb, DrawLayer layer, int x0, int y0, int x1, int y1) {
+  fb->dirty[layer] = rect_union(fb->dirty[layer],
+                                (FramebufferRect){x0, y0, x1 - x0, y1 - y0});
+}
+
+T *framebuffer_new(Short width, Short height) {
+  static bool blend_ready = false;
+  if (!blend_ready) {
+    init_blend_table();
+    blend_ready = true;
+  }
+
+  T *fb = (T *)malloc(sizeof(T));
+  alloc_layers(fb, width, height);
+  return fb;
+}
+
+void framebuffer_delete(T *fb) {
+  free(fb->layers[BG_LAYER]);
+  free(fb->layers[FG_LAYER]);
+  free(fb);
+}
+
+void framebuffer_resize(T *fb, Short width, Short height) {
+  free(fb->layers[BG_LAYER]);
+  free(fb->layers[FG_LAYER]);
+  alloc_layers(fb, width, height);
+}
+
+void framebuffer_copy(T *dst, T *src) {
+  if (dst->width != src->width || dst->height != src->height)
+    framebuffer_resize(dst, src->width, src->height);
+
+  size_t size = src->stride * src->height;
+  memcpy(dst->layers[BG_LAYER], src->layers[BG_LAYER], size);
+  memcpy(dst->layers[FG_LAYER], src->layers[FG_LAYER], size);
+  dst->dirty[BG_LAYER] = src->dirty[BG_LAYER];
+  dst->dirty[FG_LAYER] = src->dirty[FG_LAYER];
+}
+
+static inline void set_pixel(T *fb, DrawLayer layer, int x, int y,
+                             Byte color) {
+  Byte *packed =
+      &fb->layers[layer][y * fb->stride + x / FRAMEBUFFER_PIXELS_PER_BYTE];
+  Byte shift = x % FRAMEBUFFER_PIXELS_PER_BYTE * 2;
+  *packed = (*packed & ~(0x03 << shift)) | (color << shift);
+}
+
+void framebuffer_pixel(T *fb, DrawLayer layer, int x, int y, Byte color) {
+  if (x < 0 || y < 0 || x >= fb->width || y >= fb->height)
+    return;
+
+  set_pixel(fb, layer, x, y, color & 0x03);
+  touch(fb, layer, x, y, x + 1, y + 1);
+}
+
+void framebuffer_touch(T *fb, DrawLayer layer, int x, int y, int width,
+                       int height) {
+  int x1 = x + width > fb->width ? fb->width : x + width;
+  int y1 = y + height > fb->height ? fb->height : y + height;
+  x = x < 0 ? 0 : x;
+  y = y < 0 ? 0 : y;
+
+  if (x < x1 && y < y1)
+    touch(fb, layer, x, y, x1, y1);
+}
+
+void framebuffer_fill(T *fb, DrawLayer layer, int x, int y, int width,
+                      int height, Byte color) {
+  framebuffer_touch(fb, layer, x, y, width, height);
+  framebuffer_fill_rows(fb, layer, x, y, width, height, color, 0, fb->height);
+}
+
+// Fills the pixels from x0 up to x1 of a layer row
+static void fill_row(T *fb, DrawLayer layer, int row, int x0, int x1,
+                     Byte color) {
+  // Pixels before the first whole byte, and after the last one
+  int head = (x0 + FRAMEBUFFER_PIXELS_PER_BYTE - 1) /
+             FRAMEBUFFER_PIXELS_PER_BYTE * FRAMEBUFFER_PIXELS_PER_BYTE;
+  int tail = x1 / FRAMEBUFFER_PIXELS_PER_BYTE * FRAMEBUFFER_PIXELS_PER_BYTE;
+
+  if (head >= tail)
+    head = tail = x1;
+
+  for (int col = x0; col < head; col++) {
+    set_pixel(fb, layer, col, row, color);
+  }
+  Byte *bytes = fb->layers[layer] + row * fb->stride;
+  memset(bytes + head / FRAMEBUFFER_PIXELS_PER_BYTE, color * 0x55,
+         (tail - head) / FRAMEBUFFER_PIXELS_PER_BYTE);
+  for (int col = tail; col < x1; col++) {
+    set_pixel(fb, layer, col, row, color);
+  }
+}
+
+void framebuffer_fill_rows(T *fb, DrawLayer layer, int x, int y, int width,
+                           int height, Byte color, int top, int bottom) {
+  top = top < 0 ? 0 : top;
+  bottom = bottom > fb->height ? fb->height : bottom;
+  color &= 0x03;
+
+  int x1 = x + width > fb->width ? fb->width : x + width;
+  int y1 = y + height > bottom ? bottom : y + height;
+  x = x < 0 ? 0 : x;
+  y = y < top ? top : y;
+
+  if (x >= x1 || y >= y1)
+    return;
+
+  // Whole rows are contiguous, padding pixels at the end of a row included
+  if (x == 0 && x1 == fb->width) {
+    memset(fb->layers[layer] + y * fb->stride, color * 0x55,
+           (y1 - y) * fb->stride);
+    return;
+  }
+
+  for (int row = y; row < y1; row++) {
+    fill_row(fb, layer, row, x, x1, color);
+  }
+}
+
+// Writes the pixels of a packed row of 8 selected by mask to the `bytes`
+// bytes of a layer row starting at dst, shifted left by `shift` bits
+static inline void blit_row(Byte *dst, size_t bytes, Byte shift,
+                            uint16_t pixels, uint16_t mask) {
+  uint32_t value = (uint32_t)pixels << shift;
+  uint32_t bits = (uint32_t)mask << shift;
+
+  for (size_t i = 0; i < bytes; i++, value >>= 8, bits >>= 8) {
+    dst[i] = (dst[i] & ~bits) | (value & bits);
+  }
+}
+
+void framebuffer_sprite(T *fb, DrawLayer layer, int x, int y,
+                        const Byte *sprite, bool two_bit, Byte color,
+                        bool flip_x, bool flip_y) {
+  framebuffer_touch(fb, layer, x, y, SPRITE_WIDTH, SPRITE_HEIGHT);
+  framebuffer_sprite_rows(fb, layer, x, y, sprite, two_bit, color, flip_x,
+                          flip_y, 0, fb->height);
+}
+
+void framebuffer_sprite_rows(T *fb, DrawLayer layer, int x, int y,
+                             const Byte *sprite, bool two_bit, Byte color,
+                             bool flip_x, bool flip_y, int top, int bottom) {
+  top = top < 0 ? 0 : top;
+  bottom = bottom > fb->height ? fb->height : bottom;
+
+  const Byte *blend = blend_table[color & 0x0f];
+  bool opaque = color % 5 != 0;
+
+  int x0 = x < 0 ? 0 : x;
+  int y0 = y < top ? top : y;
+  int x1 = x + SPRITE_WIDTH > fb->width ? fb->width : x + SPRITE_WIDTH;
+  int y1 = y + SPRITE_HEIGHT > bottom ? bottom : y + SPRITE_HEIGHT;
+  if (x0 >= x1 || y0 >= y1)
+    return;
+
+  // Pixels of the row that land on the framebuffer, and how far to shift the
+  // row right to drop the ones off the left edge
+  uint16_t clip = 0xffff >> (2 * (SPRITE_WIDTH - (x1 - x0)));
+  Byte skip = 2 * (x0 - x);
+
+  // Where the visible pixels go in each layer row: never past its end, so
+  // that rows can be drawn concurrently
+  Byte shift = x0 % FRAMEBUFFER_PIXELS_PER_BYTE * 2;
+  size_t offset = x0 / FRAMEBUFFER_PIXELS_PER_BYTE;
+  size_t bytes = (x1 - 1) / FRAMEBUFFER_PIXELS_PER_BYTE - offset + 1;
+
+  const uint16_t *expand = expand_table[flip_x ? 1 : 0];
+
+  Byte *dst = fb->layers[layer] + y0 * fb->stride + offset;
+
+  for (int py = y0; py < y1; py++, dst += fb->stride) {
+    int row = flip_y ? SPRITE_HEIGHT - 1 - (py - y) : py - y;
+
+    // Sprite colour of each of the 8 pixels
+    uint16_t ch = expand[sprite[row]];
+    if (two_bit)
+      ch |= expand[sprite[row + SPRITE_BUFFER_SIZE]] << 1;
+
+    uint16_t pixels = blend[ch & 0xff] | blend[ch >> 8] << 8;
+    uint16_t mask = opaque ? 0xffff : ((ch | ch >> 1) & PIXEL_LOW_BITS) * 3;
+
+    blit_row(dst, bytes, shift, pixels >> skip, (mask >> skip) & clip);
+  }
+}
+
+void framebuffer_touch_all(T *fb) {
+  for (size_t i = 0; i < 2; i++) {
+    fb->dirty[i] = (FramebufferRect){0, 0, fb->width, fb->height};
+  }
+}
+
+FramebufferRect framebuffer_dirty(T *fb) {
+  return rect_union(fb->dirty[BG_LAYER], fb->dirty[FG_LAYER]);
+}
+
+void framebuffer_clean(T *fb) {
+  fb->dirty[BG_LAYER] = (FramebufferRect){0};
+  fb->dirty[FG_LAYER] = (FramebufferRect){0};
+}
+
+void framebuffer_composite(T *fb, const uint32_t palette[4],
+                           FramebufferRect rect, uint32_t *pixels) {
+  // Colour of every foreground and background index pair
+  uint32_t colors[16];
+  for (size_t fg = 0; fg < 4; fg++) {
+    for (size_t bg = 0; bg < 4; bg++) {
+      colors[fg << 2 | bg] = palette[fg ? fg : bg];
+    }
+  }
+
+  for (int y = rect.y; y < rect.y + rect.height; y++) {
+    const Byte *bg_row = fb->layers[BG_LAYER] + y * fb->stride;
+    const Byte *fg_row = fb->layers[FG_LAYER] + y * fb->stride;
+    uint32_t *out = pixels + (y - rect.y) * rect.width;
+
+    for (int x = rect.x; x < rect.x + rect.width; x++) {
+      Byte shift = x % FRAMEBUFFER_PIXELS_PER_BYTE * 2;
+      Byte bg = (bg_row[x / FRAMEBUFFER_PIXELS_PER_BYTE] >> shift) & 0x03;
+      Byte fg = (fg_row[x / FRAMEBUFFER_PIXELS_PER_BYTE] >> shift) & 0x03;
+      out[x - rect.x] = colors[fg << 2 | bg];
+    }
+  }
+}
+
+void framebuffer_indices(T *fb, FramebufferRect rect, Byte *indices) {
+  for (int y = rect.y; y < rect.y + rect.height; y++) {
+    const Byte *bg_row = fb->layers[BG_LAYER] + y * fb->stride;
+    const Byte *fg_row = fb->layers[FG_LAYER] + y * fb->stride;
+    Byte *out = indices + (y - rect.y) * rect.width;
+
+    for (int x = rect.x; x < rect.x + rect.width; x++) {
+      Byte shift = x % FRAMEBUFFER_PIXELS_PER_BYTE * 2;
+      Byte bg = (bg_row[x / FRAMEBUFFER_PIXELS_PER_BYTE] >> shift) & 0x03;
+      Byte fg = (fg_row[x / FRAMEBUFFER_PIXELS_PER_BYTE] >> shift) & 0x03;
+      out[x - rect.x] = fg << 2 | bg;
+    }
+  }
+}
@@ -0,0 +1,251 @@
+#include "../common.h"
+#include <string.h>
+
+#ifndef framebuffer_h
+#define framebuffer_h
+
+#define SPRITE_WIDTH 8
+#define SPRITE_HEIGHT 8
+#define SPRITE_BUFFER_SIZE 8
+#define SPRITE_1BPP_BUFFER_SIZE 8
+#define SPRITE_2BPP_BUFFER_SIZE 16
+
+/**
+ * Pixels per byte of a layer. Every pixel is a 2-bit index into the palette.
+ */
+#define FRAMEBUFFER_PIXELS_PER_BYTE 4
+
+#define T Framebuffer
+
+typedef enum { BG_LAYER, FG_LAYER } DrawLayer;
+
+/**
+ * A rectangle of pixels, empty when its width or height is 0.
+ */
+typedef struct {
+  int x;
+  int y;
+  int width;
+  int height;
+} FramebufferRect;
+
+/**
+ * The screen device's background and foreground layers, without any knowledge
+ * of how they end up on a display.
+ *
+ * Each layer stores 2-bit palette indices packed four to a byte, leftmost
+ * pixel in the low bits. Index 0 on the foreground is transparent. Colours
+ * only come in when the layers are composited, so changing the palette
+ * recolours everything already drawn.
+ *
+ * Every draw also grows the dirty rectangle of its layer, so that a display
+ * only has to composite and upload what changed since it last looked.
+ */
+typedef struct T T;
+
+struct T {
+  Short width;
+  Short height;
+  // Bytes per row of a layer
+  size_t stride;
+  Byte *layers[2];
+  // Bounds of everything drawn on each layer since framebuffer_clean
+  FramebufferRect dirty[2];
+};
+
+/**
+ * @brief Allocate a framebuffer with both layers cleared and dirty.
+ *
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @return A pointer to the new framebuffer.
+ */
+T *framebuffer_new(Short width, Short height);
+
+/**
+ * @brief Free a framebuffer and its layers.
+ *
+ * @param fb Pointer to the framebuffer.
+ */
+void framebuffer_delete(T *fb);
+
+/**
+ * @brief Change the size of a framebuffer, clearing both layers and marking
+ * them dirty.
+ *
+ * @param fb Pointer to the framebuffer.
+ * @param width New width in pixels.
+ * @param height New height in pixels.
+ */
+void framebuffer_resize(T *fb, Short width, Short height);
+
+/**
+ * @brief Make one framebuffer a copy of another, including its size and dirty
+ * rectangles.
+ *
+ * @param dst Framebuffer to overwrite.
+ * @param src Framebuffer to copy.
+ */
+void framebuffer_copy(T *dst, T *src);
+
+/**
+ * @brief Read the palette index of a pixel.
+ *
+ * @param fb Pointer to the framebuffer.
+ * @param layer Layer to read.
+ * @param x Column, must be inside the framebuffer.
+ * @param y Row, must be inside the framebuffer.
+ * @return An index from 0 to 3.
+ */
+static inline Byte framebuffer_get(T *fb, DrawLayer layer, int x, int y) {
+  Byte packed =
+      fb->layers[layer][y * fb->stride + x / FRAMEBUFFER_PIXELS_PER_BYTE];
+  return (packed >> (x % FRAMEBUFFER_PIXELS_PER_BYTE * 2)) & 0x03;
+}
+
+/**
+ * @brief Set the palette index of a pixel, ignoring pixels off the edges.
+ *
+ * @param fb Pointer to the framebuffer.
+ * @param layer Layer to draw on.
+ * @param x Column.
+ * @param y Row.
+ * @param color Index from 0 to 3.
+ */
+void framebuffer_pixel(T *fb, DrawLayer layer, int x, int y, Byte color);
+
+/**
+ * @brief Set every pixel of a rectangle, clipped to the framebuffer.
+ *
+ * @param fb Pointer to the framebuffer.
+ * @param layer Layer to draw on.
+ * @param x Left edge.
+ * @param y Top edge.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @param color Index from 0 to 3.
+ */
+void framebuffer_fill(T *fb, DrawLayer layer, int x, int y, int width,
+                      int height, Byte color);
+
+/**
+ * @brief `framebuffer_fill` limited to the rows from top up to bottom, without
+ * marking anything dirty.
+ *
+ * Calls for rows that don't overlap may run concurrently, as long as the
+ * rectangles drawn are marked dirty with `framebuffer_touch` beforehand.
+ */
+void framebuffer_fill_rows(T *fb, DrawLayer layer, int x, int y, int width,
+                           int height, Byte color, int top, int bottom);
+
+/**
+ * @brief Draw an 8x8 sprite, clipped to the framebuffer.
+ *
+ * The sprite is 8 rows of the low bit plane followed, in 2bpp mode, by 8 rows
+ * of the high bit plane, with the leftmost pixel in the top bit. The colour
+ * nibble picks the palette index for each sprite colour as in the Varvara
+ * screen spec, and in the modes where it is a multiple of 5 sprite colour 0
+ * leaves the layer untouched.
+ *
+ * @param fb Pointer to the framebuffer.
+ * @param layer Layer to draw on.
+ * @param x Left edge.
+ * @param y Top edge.
+ * @param sprite 8 or 16 bytes of sprite data.
+ * @param two_bit Whether the sprite has a high bit plane.
+ * @param color Colour nibble from the sprite port.
+ * @param flip_x Mirror the sprite horizontally.
+ * @param flip_y Mirror the sprite vertically.
+ */
+void framebuffer_sprite(T *fb, DrawLayer layer, int x, int y,
+                        const Byte *sprite, bool two_bit, Byte color,
+                        bool flip_x, bool flip_y);
+
+/**
+ * @brief `framebuffer_sprite` limited to the rows from top up to bottom,
+ * without marking anything dirty, see `framebuffer_fill_rows`.
+ */
+void framebuffer_sprite_rows(T *fb, DrawLayer layer, int x, int y,
+                             const Byte *sprite, bool two_bit, Byte color,
+                             bool flip_x, bool flip_y, int top, int bottom);
+
+/**
+ * @brief Grow the dirty rectangle of a layer by a rectangle, clipped to the
+ * framebuffer.
+ *
+ * @param fb Pointer to the framebuffer.
+ * @param layer Layer drawn on.
+ * @param x Left edge.
+ * @param y Top edge.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ */
+void framebuffer_touch(T *fb, DrawLayer layer, int x, int y, int width,
+                       int height);
+
+/**
+ * @brief Mark the whole of both layers dirty, for changes that affect every
+ * pixel such as a new palette.
+ *
+ * @param fb Pointer to the framebuffer.
+ */
+void framebuffer_touch_all(T *fb);
+
+/**
+ * @brief Bounds of everything drawn on either layer since the last call to
+ * `framebuffer_clean`.
+ *
+ * @param fb Pointer to the framebuffer.
+ * @return The union of the dirty rectangles of both layers.
+ */
+FramebufferRect framebuffer_dirty(T *fb);
+
+/**
+ * @brief Forget the dirty rectangles, once they have been displayed.
+ *
+ * @param fb Pointer to the framebuffer.
+ */
+void framebuffer_clean(T *fb);
+
+/**
+ * @brief Pack a colour into the pixel format `framebuffer_composite` writes.
+ *
+ * Colours are 32-bit words holding red, green, blue and alpha bytes in that
+ * order in memory, the layout of an RGBA8 texture.
+ */
+static inline uint32_t framebuffer_rgba(Byte r, Byte g, Byte b, Byte a) {
+  Byte bytes[4] = {r, g, b, a};
+  uint32_t rgba;
+  memcpy(&rgba, bytes, sizeof(rgba));
+  return rgba;
+}
+
+/**
+ * @brief Flatten a rectangle of both layers into an RGBA image.
+ *
+ * Every pixel takes the foreground colour, or the background colour where the
+ * foreground is transparent.
+ *
+ * @param fb Pointer to the framebuffer.
+ * @param palette The four screen colours, see `framebuffer_rgba`.
+ * @param rect Rectangle to composite, inside the framebuffer.
+ * @param pixels Output of `rect.width * rect.height` colours, row by row.
+ */
+void framebuffer_composite(T *fb, const uint32_t palette[4],
+                           FramebufferRect rect, uint32_t *pixels);
+
+/**
+ * @brief Copy a rectangle of both layers out as one byte per pixel, for a
+ * display that applies the palette itself.
+ *
+ * Each byte holds the foreground index in bits 2-3 and the background index
+ * in bits 0-1, the pair `framebuffer_composite` picks a colour by.
+ *
+ * @param fb Pointer to the framebuffer.
+ * @param rect Rectangle to copy, inside the framebuffer.
+ * @param indices Output of `rect.width * rect.height` bytes, row by row.
+ */
+void framebuffer_indices(T *fb, FramebufferRect rect, Byte *indices);
+
+#undef T
+#endif // framebuffer_h
@@ -0,0 +1,67 @@
+#include <stdlib.h>
+
+#include "frames.h"
+
+#define T FrameExchange
+
+#define FRAMES_FRESH 0x04
+#define FRAMES_INDEX 0x03
+
+T *frames_new(Short width, Short height) {
+  T *frames = (T *)malloc(sizeof(T));
+  *frames = (T){.back = 0, .front = 2, .pending = {{0}, {0}}};
+
+  for (size_t i = 0; i < 3; i++) {
+    frames->frames[i] = (Frame){.framebuffer = framebuffer_new(width, height)};
+  }
+  atomic_init(&frames->middle, 1);
+
+  return frames;
+}
+
+void frames_delete(T *frames) {
+  for (size_t i = 0; i < 3; i++) {
+    framebuffer_delete(frames->frames[i].framebuffer);
+  }
+  free(frames);
+}
+
+Frame *frames_back(T *frames) { return &frames->frames[frames->back]; }
+
+void frames_publish(T *frames) {
+  Framebuffer *published = frames->frames[frames->back].framebuffer;
+
+  FramebufferRect own[2];
+  FramebufferRect with_pending[2];
+  for (DrawLayer layer = BG_LAYER; layer <= FG_LAYER; layer++) {
+    FramebufferRect pending = frames->pending[layer];
+    own[layer] = published->dirty[layer];
+    framebuffer_touch(published, layer, pending.x, pending.y, pending.width,
+                      pending.height);
+    with_pending[layer] = published->dirty[layer];
+  }
+
+  size_t middle = atomic_exchange_explicit(
+      &frames->middle, frames->back | FRAMES_FRESH, memory_order_acq_rel);
+  frames->back = middle & FRAMES_INDEX;
+
+  // The frame we got back was never taken, so the reader hasn't seen what
+  // it drew either. Otherwise it has seen everything before this frame.
+  for (DrawLayer layer = BG_LAYER; layer <= FG_LAYER; layer++) {
+    frames->pending[layer] =
+        middle & FRAMES_FRESH ? with_pending[layer] : own[layer];
+  }
+}
+
+Frame *frames_take(T *frames) {
+  // Only the reader clears FRAMES_FRESH, so it can't go away before the
+  // exchange
+  if (!(atomic_load_explicit(&frames->middle, memory_order_relaxed) &
+        FRAMES_FRESH))
+    return NULL;
+
+  size_t middle = atomic_exchange_explicit(&frames->middle, frames->front,
+                                           memory_order_acq_rel);
+  frames->front = middle & FRAMES_INDEX;
+  return &frames->frames[frames->front];
+}
@@ -0,0 +1,87 @@
+#include "../common.h"
+#include "framebuffer.h"
+#include <stdatomic.h>
+
+#ifndef frames_h
+#define frames_h
+
+#define T FrameExchange
+
+/**
+ * Hands finished frames from the thread running the VM to the thread
+ * displaying them, without either one waiting on the other.
+ *
+ * A triple buffer: the writer fills the back frame and publishes it, the
+ * reader takes whatever was published last, and a third frame sits between
+ * them. Publishing swaps the back and middle frames, and taking swaps the
+ * middle and front frames, each with one atomic exchange. Until the writer
+ * sees that the reader took a frame, every frame it publishes is also dirty
+ * wherever the frames before it were, so the reader still redraws
+ * everything drawn since it last looked when it skips some.
+ */
+typedef struct T T;
+
+/**
+ * A finished frame: both layers and the palette to show them in.
+ */
+typedef struct {
+  Framebuffer *framebuffer;
+  // Screen colours in framebuffer_rgba format
+  uint32_t palette[4];
+} Frame;
+
+struct T {
+  Frame frames[3];
+  // Frame being filled by the writer, and frame shown by the reader
+  size_t back;
+  size_t front;
+  // Dirty rectangles of the published frames the reader may not have taken
+  FramebufferRect pending[2];
+  // The frame in between, with FRAMES_FRESH set when it was published after
+  // the reader last took one
+  atomic_size_t middle;
+};
+
+/**
+ * @brief Allocate an exchange with three blank frames.
+ *
+ * @param width Width of the frames in pixels.
+ * @param height Height of the frames in pixels.
+ * @return A pointer to the new exchange.
+ */
+T *frames_new(Short width, Short height);
+
+/**
+ * @brief Free an exchange and its frames.
+ *
+ * @param frames Pointer to the exchange.
+ */
+void frames_delete(T *frames);
+
+/**
+ * @brief The writer's frame, to fill before `frames_publish`.
+ *
+ * @param frames Pointer to the exchange.
+ * @return The back frame, owned by the writer until it is published.
+ */
+Frame *frames_back(T *frames);
+
+/**
+ * @brief Publish the back frame and start filling another one.
+ *
+ * @param frames Pointer to the exchange.
+ */
+void frames_publish(T *frames);
+
+/**
+ * @brief Take the frame published last, if there is one the reader hasn't
+ * already taken.
+ *
+ * @param frames Pointer to the exchange.
+ * @return The new front frame, owned by the reader until the next call, or
+ * NULL when nothing was published since the last call.
+ */
+Frame *frames_take(T *frames);
+
+#undef T
+#endif // frames_h
@@ -0,0 +1,38 @@
+#include <stdlib.h>
+
+#include "input.h"
+
+#define T InputQueue
+
+T *input_new(void) {
+  T *queue = (T *)malloc(sizeof(T));
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+  return queue;
+}
+
+void input_delete(T *queue) { free(queue); }
+
+bool input_push(T *queue, InputEvent event) {
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+  if (tail - head == INPUT_QUEUE_SIZE)
+    return false;
+
+  queue->events[tail % INPUT_QUEUE_SIZE] = event;
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+bool input_pop(T *queue, InputEvent *event) {
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+  if (head == tail)
+    return false;
+
+  *event = queue->events[head % INPUT_QUEUE_SIZE];
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+  return true;
+}
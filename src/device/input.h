@@ -0,0 +1,83 @@
+#include "../common.h"
+#include <stdatomic.h>
+
+#ifndef input_h
+#define input_h
+
+#define INPUT_QUEUE_SIZE 256
+
+#define T InputQueue
+
+typedef enum {
+  INPUT_BUTTON_DOWN,
+  INPUT_BUTTON_UP,
+  INPUT_KEY,
+  INPUT_MOUSE_MOVE,
+  INPUT_MOUSE_DOWN,
+  INPUT_MOUSE_UP,
+  INPUT_MOUSE_SCROLL,
+  // The window was closed
+  INPUT_QUIT,
+} InputKind;
+
+/**
+ * One input event, for the controller or mouse device.
+ */
+typedef struct {
+  Byte kind;
+  // Button mask, or key for INPUT_KEY
+  Byte value;
+  // Position for INPUT_MOUSE_MOVE, or distance for INPUT_MOUSE_SCROLL
+  Short x;
+  Short y;
+} InputEvent;
+
+/**
+ * Input events on their way from the window to the thread running the VM.
+ *
+ * A ring buffer for one producer and one consumer: each side only writes its
+ * own end of the ring, so neither ever takes a lock or waits for the other.
+ */
+typedef struct T T;
+
+struct T {
+  InputEvent events[INPUT_QUEUE_SIZE];
+  // Next event to pop, and next slot to push into
+  atomic_size_t head;
+  atomic_size_t tail;
+};
+
+/**
+ * @brief Allocate an empty queue.
+ *
+ * @return A pointer to the new queue.
+ */
+T *input_new(void);
+
+/**
+ * @brief Free a queue.
+ *
+ * @param queue Pointer to the queue.
+ */
+void input_delete(T *queue);
+
+/**
+ * @brief Add an event to the back of the queue, from the producer.
+ *
+ * @param queue Pointer to the queue.
+ * @param event Event to add.
+ * @return false, dropping the event, when the queue is full.
+ */
+bool input_push(T *queue, InputEvent event);
+
+/**
+ * @brief Remove the event at the front of the queue, from the consumer.
+ *
+ * @param queue Pointer to the queue.
+ * @param event Filled in with the event.
+ * @return false when the queue is empty.
+ */
+bool input_pop(T *queue, InputEvent *event);
+
+#undef T
+#endif // input_h
@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "offscreen.h"
+
+#define T OffscreenScreen
+
+// Longest block deflate can store without compressing it
+#define DEFLATE_STORED_MAX 65535
+
+static const Byte png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a,
+                                      '\n'};
+
+static uint32_t crc_table[256];
+
+static void init_crc_table(void) {
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t crc = n;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 1 ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+    }
+    crc_table[n] = crc;
+  }
+}
+
+static uint32_t crc_update(uint32_t crc, const Byte *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+static void put_be32(Byte *out, uint32_t value) {
+  out[0] = value >> 24;
+  out[1] = value >> 16;
+  out[2] = value >> 8;
+  out[3] = value;
+}
+
+static bool write_chunk(FILE *out, const char type[4], const Byte *data,
+                        size_t length) {
+  Byte header[8];
+  put_be32(header, length);
+  memcpy(header + 4, type, 4);
+
+  uint32_t crc = crc_update(0xffffffff, header + 4, 4);
+  crc = crc_update(crc, data, length) ^ 0xffffffff;
+  Byte trailer[4];
+  put_be32(trailer, crc);
+
+  return fwrite(header, 1, sizeof(header), out) == sizeof(header) &&
+         (length == 0 || fwrite(data, 1, length, out) == length) &&
+         fwrite(trailer, 1, sizeof(trailer), out) == sizeof(trailer);
+}
+
+// Wraps data in a zlib stream of stored deflate blocks. Frames are dumped
+// while the ROM runs, so they are written as fast as possible rather than as
+// small as possible.
+static Byte *zlib_stored(const Byte *data, size_t length, size_t *zlib_length) {
+  size_t blocks = length / DEFLATE_STORED_MAX + 1;
+  Byte *zlib = malloc(2 + blocks * 5 + length + 4);
+  Byte *out = zlib;
+
+  // 32K window, no dictionary, fastest
+  *out++ = 0x78;
+  *out++ = 0x01;
+
+  size_t offset = 0;
+  for (size_t block = 0; block < blocks; block++) {
+    size_t size = length - offset;
+    if (size > DEFLATE_STORED_MAX)
+      size = DEFLATE_STORED_MAX;
+
+    *out++ = block == blocks - 1;
+    *out++ = size;
+    *out++ = size >> 8;
+    *out++ = ~size;
+    *out++ = ~size >> 8;
+    memcpy(out, data + offset, size);
+    out += size;
+    offset += size;
+  }
+
+  uint32_t a = 1, b = 0;
+  for (size_t i = 0; i < length; i++) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  put_be32(out, b << 16 | a);
+  out += 4;
+
+  *zlib_length = out - zlib;
+  return zlib;
+}
+
+bool offscreen_write_png(Framebuffer *fb, const uint32_t palette[4],
+                         FILE *out) {
+  Byte header[13];
+  put_be32(header, fb->width);
+  put_be32(header + 4, fb->height);
+  // 8-bit palette indices, default compression and filters, no interlacing
+  header[8] = 8;
+  header[9] = 3;
+  header[10] = header[11] = header[12] = 0;
+
+  Byte colors[4 * 3];
+  for (int color = 0; color < 4; color++) {
+    Byte rgba[4];
+    memcpy(rgba, &palette[color], sizeof(rgba));
+    memcpy(colors + color * 3, rgba, 3);
+  }
+
+  // Every row starts with filter type 0, none
+  size_t row = (size_t)fb->width + 1;
+  size_t length = row * fb->height;
+  Byte *rows = malloc(length + 1);
+  for (int y = 0; y < fb->height; y++) {
+    Byte *pixels = rows + y * row + 1;
+    rows[y * row] = 0;
+    framebuffer_indices(fb, (FramebufferRect){0, y, fb->width, 1}, pixels);
+
+    for (int x = 0; x < fb->width; x++) {
+      Byte fg = pixels[x] >> 2;
+      pixels[x] = fg ? fg : pixels[x] & 0x03;
+    }
+  }
+
+  size_t zlib_length;
+  Byte *zlib = zlib_stored(rows, length, &zlib_length);
+
+  bool ok = fwrite(png_signature, 1, sizeof(png_signature), out) ==
+                sizeof(png_signature) &&
+            write_chunk(out, "IHDR", header, sizeof(header)) &&
+            write_chunk(out, "PLTE", colors, sizeof(colors)) &&
+            write_chunk(out, "IDAT", zlib, zlib_length) &&
+            write_chunk(out, "IEND", NULL, 0);
+
+  free(zlib);
+  free(rows);
+  return ok;
+}
+
+bool offscreen_write_raw(Framebuffer *fb, FILE *out) {
+  size_t length = (size_t)fb->width * fb->height;
+  Byte *indices = malloc(length + 1);
+
+  framebuffer_indices(fb, (FramebufferRect){0, 0, fb->width, fb->height},
+                      indices);
+  bool ok = fwrite(indices, 1, length, out) == length;
+
+  free(indices);
+  return ok;
+}
+
+static void present(ScreenBackend *backend, Framebuffer *fb,
+                    const uint32_t palette[4], uint64_t frame) {
+  T *offscreen = (T *)backend;
+
+  bool requested = atomic_exchange(&offscreen->requested, false);
+  if (requested || (offscreen->every && frame % offscreen->every == 0))
+    offscreen_dump(offscreen, fb, palette, frame);
+}
+
+T *offscreen_new(const char *prefix, OffscreenFormat format, uint64_t every) {
+  static bool crc_ready = false;
+  if (!crc_ready) {
+    init_crc_table();
+    crc_ready = true;
+  }
+
+  T *offscreen = (T *)malloc(sizeof(T));
+  *offscreen = (T){
+      .backend = {.present = present},
+      .prefix = prefix,
+      .format = format,
+      .every = every,
+      .dumped = 0,
+  };
+  atomic_init(&offscreen->requested, false);
+
+  return offscreen;
+}
+
+void offscreen_delete(T *offscreen) { free(offscreen); }
+
+void offscreen_request_dump(T *offscreen) {
+  atomic_store(&offscreen->requested, true);
+}
+
+bool offscreen_dump(T *offscreen, Framebuffer *fb, const uint32_t palette[4],
+                    uint64_t frame) {
+  if (!offscreen->prefix)
+    return true;
+
+  char path[4096];
+  if (offscreen->format == OFFSCREEN_RAW)
+    snprintf(path, sizeof(path), "%s-%06llu-%dx%d.raw", offscreen->prefix,
+             (unsigned long long)frame, fb->width, fb->height);
+  else
+    snprintf(path, sizeof(path), "%s-%06llu.png", offscreen->prefix,
+             (unsigned long long)frame);
+
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    perror(path);
+    return false;
+  }
+
+  bool ok = offscreen->format == OFFSCREEN_RAW
+                ? offscreen_write_raw(fb, out)
+                : offscreen_write_png(fb, palette, out);
+  ok = fclose(out) == 0 && ok;
+  if (!ok) {
+    perror(path);
+    return false;
+  }
+
+  offscreen->dumped++;
+  return true;
+}
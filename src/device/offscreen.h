@@ -0,0 +1,101 @@
+#include "../common.h"
+#include "framebuffer.h"
+#include "screen.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+#ifndef offscreen_h
+#define offscreen_h
+
+#define T OffscreenScreen
+
+typedef enum {
+  // An indexed colour PNG of what the window would show
+  OFFSCREEN_PNG,
+  // One framebuffer_indices byte per pixel, row by row, with no header
+  OFFSCREEN_RAW,
+} OffscreenFormat;
+
+/**
+ * Screen backend that keeps frames in memory and writes some of them to
+ * files, for running ROMs with no display at all.
+ *
+ * Frames are written on the VM thread as they are presented, so the same ROM
+ * always dumps the same frames. Files are named after the number of screen
+ * vectors run, `<prefix>-000060.png`, with the size added for raw dumps,
+ * `<prefix>-000060-512x320.raw`.
+ */
+typedef struct T T;
+
+struct T {
+  ScreenBackend backend;
+  // Start of every file name, NULL to write none
+  const char *prefix;
+  OffscreenFormat format;
+  // Write every this many frames, 0 to only write when asked to
+  uint64_t every;
+  // Set by `offscreen_request_dump`
+  atomic_bool requested;
+  // Files written so far
+  uint64_t dumped;
+};
+
+/**
+ * @brief Allocate an offscreen backend.
+ *
+ * @param prefix Start of every file name, NULL to write none.
+ * @param format File format.
+ * @param every Write every this many frames, 0 to only write when asked to.
+ * @return A pointer to the new backend.
+ */
+T *offscreen_new(const char *prefix, OffscreenFormat format, uint64_t every);
+
+/**
+ * @brief Free an offscreen backend.
+ *
+ * @param offscreen Pointer to the backend.
+ */
+void offscreen_delete(T *offscreen);
+
+/**
+ * @brief Write the next frame presented, whatever its number. Safe to call
+ * from a signal handler.
+ *
+ * @param offscreen Pointer to the backend.
+ */
+void offscreen_request_dump(T *offscreen);
+
+/**
+ * @brief Write a frame to its file now.
+ *
+ * @param offscreen Pointer to the backend.
+ * @param fb Both layers.
+ * @param palette Screen colours in framebuffer_rgba format.
+ * @param frame Number of screen vectors run so far, for the file name.
+ * @return false, after printing why, when the file couldn't be written.
+ */
+bool offscreen_dump(T *offscreen, Framebuffer *fb, const uint32_t palette[4],
+                    uint64_t frame);
+
+/**
+ * @brief Write both layers as an indexed colour PNG.
+ *
+ * @param fb Both layers.
+ * @param palette Screen colours in framebuffer_rgba format.
+ * @param out Stream to write to.
+ * @return false when writing failed.
+ */
+bool offscreen_write_png(Framebuffer *fb, const uint32_t palette[4],
+                         FILE *out);
+
+/**
+ * @brief Write both layers as raw `framebuffer_indices` bytes.
+ *
+ * @param fb Both layers.
+ * @param out Stream to write to.
+ * @return false when writing failed.
+ */
+bool offscreen_write_raw(Framebuffer *fb, FILE *out);
+
+#undef T
+#endif // offscreen_h
@@ -0,0 +1,132 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "raster.h"
+
+#define T Rasterizer
+
+typedef struct {
+  T *raster;
+  size_t band;
+} Worker;
+
+struct T {
+  size_t threads;
+  pthread_t *pthreads;
+  Worker *workers;
+
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  // Bumped for every flush, workers wait for it to change
+  uint64_t generation;
+  // Workers still drawing the current flush
+  size_t pending;
+  bool stop;
+
+  DrawList *list;
+  Framebuffer *fb;
+};
+
+static void draw_band(T *raster, size_t band) {
+  int height = raster->fb->height;
+  int top = height * band / raster->threads;
+  int bottom = height * (band + 1) / raster->threads;
+
+  drawlist_draw_rows(raster->list, raster->fb, top, bottom);
+}
+
+static void *worker_main(void *arg) {
+  Worker *worker = arg;
+  T *raster = worker->raster;
+  uint64_t seen = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&raster->lock);
+    while (raster->generation == seen && !raster->stop)
+      pthread_cond_wait(&raster->start, &raster->lock);
+    if (raster->stop) {
+      pthread_mutex_unlock(&raster->lock);
+      return NULL;
+    }
+    seen = raster->generation;
+    pthread_mutex_unlock(&raster->lock);
+
+    draw_band(raster, worker->band);
+
+    pthread_mutex_lock(&raster->lock);
+    if (--raster->pending == 0)
+      pthread_cond_signal(&raster->done);
+    pthread_mutex_unlock(&raster->lock);
+  }
+}
+
+T *rasterizer_new(size_t threads) {
+  T *raster = (T *)malloc(sizeof(T));
+  *raster = (T){
+      .threads = threads ? threads : 1,
+      .generation = 0,
+      .pending = 0,
+      .stop = false,
+  };
+
+  pthread_mutex_init(&raster->lock, NULL);
+  pthread_cond_init(&raster->start, NULL);
+  pthread_cond_init(&raster->done, NULL);
+
+  // Band 0 is drawn by the thread calling rasterizer_flush
+  raster->pthreads = malloc(raster->threads * sizeof(pthread_t));
+  raster->workers = malloc(raster->threads * sizeof(Worker));
+  for (size_t i = 1; i < raster->threads; i++) {
+    raster->workers[i] = (Worker){.raster = raster, .band = i};
+    pthread_create(&raster->pthreads[i], NULL, worker_main,
+                   &raster->workers[i]);
+  }
+
+  return raster;
+}
+
+void rasterizer_delete(T *raster) {
+  pthread_mutex_lock(&raster->lock);
+  raster->stop = true;
+  pthread_cond_broadcast(&raster->start);
+  pthread_mutex_unlock(&raster->lock);
+
+  for (size_t i = 1; i < raster->threads; i++) {
+    pthread_join(raster->pthreads[i], NULL);
+  }
+
+  pthread_cond_destroy(&raster->done);
+  pthread_cond_destroy(&raster->start);
+  pthread_mutex_destroy(&raster->lock);
+  free(raster->workers);
+  free(raster->pthreads);
+  free(raster);
+}
+
+void rasterizer_flush(T *raster, DrawList *list, Framebuffer *fb) {
+  if (raster->threads == 1 || list->length == 0) {
+    drawlist_flush(list, fb);
+    return;
+  }
+
+  // Dirty rectangles are shared by every band, so they are grown up front
+  drawlist_touch(list, fb);
+
+  pthread_mutex_lock(&raster->lock);
+  raster->list = list;
+  raster->fb = fb;
+  raster->pending = raster->threads - 1;
+  raster->generation++;
+  pthread_cond_broadcast(&raster->start);
+  pthread_mutex_unlock(&raster->lock);
+
+  draw_band(raster, 0);
+
+  pthread_mutex_lock(&raster->lock);
+  while (raster->pending)
+    pthread_cond_wait(&raster->done, &raster->lock);
+  pthread_mutex_unlock(&raster->lock);
+
+  drawlist_clear(list);
+}
@@ -0,0 +1,48 @@
+#include "../common.h"
+#include "drawlist.h"
+#include "framebuffer.h"
+
+#ifndef raster_h
+#define raster_h
+
+#define T Rasterizer
+
+/**
+ * Band-parallel draw list replay.
+ *
+ * The framebuffer is split into one horizontal band of rows per thread, and
+ * every thread replays the whole draw list clipped to its own band. Bands
+ * never share a byte, and each one sees the commands in recorded order, so
+ * the result is the same as `drawlist_flush`. The calling thread draws the
+ * first band while a pool of workers draws the others.
+ */
+typedef struct T T;
+
+/**
+ * @brief Start a rasterizer.
+ *
+ * @param threads Number of bands, including the calling thread's. 1 draws
+ * everything on the calling thread.
+ * @return A pointer to the new rasterizer.
+ */
+T *rasterizer_new(size_t threads);
+
+/**
+ * @brief Stop the workers and free a rasterizer.
+ *
+ * @param raster Pointer to the rasterizer.
+ */
+void rasterizer_delete(T *raster);
+
+/**
+ * @brief Draw every recorded command into a framebuffer and empty the list,
+ * like `drawlist_flush`.
+ *
+ * @param raster Pointer to the rasterizer.
+ * @param list Pointer to the draw list.
+ * @param fb Framebuffer to draw into.
+ */
+void rasterizer_flush(T *raster, DrawList *list, Framebuffer *fb);
+
+#undef T
+#endif // raster_h
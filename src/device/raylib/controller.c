@@ -116,31 +116,35 @@ UxnControllerButton convert_raylib_button(KeyboardKey key) {
   }
 }
 
-void handle_controller_button(Uxn *uxn, KeyboardKey raylib_key) {
+void handle_controller_button(InputQueue *queue, KeyboardKey raylib_key) {
   if (IsKeyPressed(raylib_key)) {
-    controller_button_down(uxn, convert_raylib_button(raylib_key));
+    input_push(queue, (InputEvent){.kind = INPUT_BUTTON_DOWN,
+                                   .value = convert_raylib_button(raylib_key)});
   } else if (IsKeyReleased(raylib_key)) {
-    controller_button_up(uxn, convert_raylib_button(raylib_key));
+    input_push(queue, (InputEvent){.kind = INPUT_BUTTON_UP,
+                                   .value = convert_raylib_button(raylib_key)});
   }
 }
-void controller_poll(Uxn *uxn) {
+void controller_poll(InputQueue *queue) {
 
-  handle_controller_button(uxn, KEY_LEFT_CONTROL);
-  handle_controller_button(uxn, KEY_RIGHT_CONTROL);
-  handle_controller_button(uxn, KEY_LEFT_ALT);
-  handle_controller_button(uxn, KEY_RIGHT_ALT);
-  handle_controller_button(uxn, KEY_LEFT_SHIFT);
-  handle_controller_button(uxn, KEY_RIGHT_SHIFT);
-  handle_controller_button(uxn, KEY_HOME);
-  handle_controller_button(uxn, KEY_UP);
-  handle_controller_button(uxn, KEY_DOWN);
-  handle_controller_button(uxn, KEY_LEFT);
-  handle_controller_button(uxn, KEY_RIGHT);
+  handle_controller_button(queue, KEY_LEFT_CONTROL);
+  handle_controller_button(queue, KEY_RIGHT_CONTROL);
+  handle_controller_button(queue, KEY_LEFT_ALT);
+  handle_controller_button(queue, KEY_RIGHT_ALT);
+  handle_controller_button(queue, KEY_LEFT_SHIFT);
+  handle_controller_button(queue, KEY_RIGHT_SHIFT);
+  handle_controller_button(queue, KEY_HOME);
+  handle_controller_button(queue, KEY_UP);
+  handle_controller_button(queue, KEY_DOWN);
+  handle_controller_button(queue, KEY_LEFT);
+  handle_controller_button(queue, KEY_RIGHT);
 
   KeyboardKey key = 0;
   while ((key = GetKeyPressed())) {
     bool shift_pressed =
         IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
-    controller_key_down(uxn, convert_raylib_to_ascii(key, shift_pressed));
+    input_push(queue,
+               (InputEvent){.kind = INPUT_KEY,
+                            .value = convert_raylib_to_ascii(key, shift_pressed)});
   }
 }
\ No newline at end of file
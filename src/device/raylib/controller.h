@@ -1,8 +1,8 @@
-#include "../../uxn.h"
+#include "../input.h"
 
 #ifndef raylib_controller_h
 #define raylib_controller_h
 
-void controller_poll(Uxn *uxn);
+void controller_poll(InputQueue *queue);
 
 #endif // raylib_controller_h
\ No newline at end of file
@@ -1,8 +1,8 @@
-#include "../../uxn.h"
+#include "../input.h"
 
 #ifndef raylib_mouse_h
 #define raylib_mouse_h
 
-void mouse_poll(Uxn *uxn, int scale_factor);
+void mouse_poll(InputQueue *queue, int scale_factor);
 
 #endif // raylib_mouse_h
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include <rlgl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "controller.h"
+#include "mouse.h"
+#include "screen.h"
+
+#define T RaylibScreen
+
+// Looks up the colour of each framebuffer_indices pair. The texture is
+// sampled with the default point filter, so indices are never blended.
+static const char *palette_shader =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform vec4 palette[4];\n"
+    "out vec4 finalColor;\n"
+    "void main() {\n"
+    "  int pair = int(texture(texture0, fragTexCoord).r * 255.0 + 0.5);\n"
+    "  int fg = pair >> 2;\n"
+    "  finalColor = palette[fg != 0 ? fg : pair & 3];\n"
+    "}\n";
+
+static size_t pixel_size(T *screen) {
+  return screen->shader_composite ? sizeof(Byte) : sizeof(uint32_t);
+}
+
+static void alloc_pixels(T *screen, int width, int height) {
+  screen->pixels = calloc((size_t)width * height + 1, pixel_size(screen));
+
+  Image image = {
+      .data = screen->pixels,
+      .width = width,
+      .height = height,
+      .mipmaps = 1,
+      .format = screen->shader_composite ? PIXELFORMAT_UNCOMPRESSED_GRAYSCALE
+                                         : PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+  };
+  screen->texture = LoadTextureFromImage(image);
+}
+
+static void free_pixels(T *screen) {
+  UnloadTexture(screen->texture);
+  free(screen->pixels);
+}
+
+// Sends the palette to the shader as four RGBA vectors
+static void upload_palette(T *screen) {
+  float colors[4][4];
+  for (int color = 0; color < 4; color++) {
+    Byte rgba[4];
+    memcpy(rgba, &screen->shown_palette[color], sizeof(rgba));
+    for (int channel = 0; channel < 4; channel++) {
+      colors[color][channel] = rgba[channel] / 255.0f;
+    }
+  }
+
+  SetShaderValueV(screen->shader, screen->palette_location, colors,
+                  SHADER_UNIFORM_VEC4, 4);
+}
+
+// Compiles the palette shader, leaving the screen to composite on the CPU
+// when the driver doesn't take GLSL 330
+static void load_shader(T *screen) {
+  screen->shader = LoadShaderFromMemory(NULL, palette_shader);
+  screen->shader_composite = screen->shader.id != rlGetShaderIdDefault();
+  if (!screen->shader_composite)
+    return;
+
+  screen->palette_location = GetShaderLocation(screen->shader, "palette");
+  upload_palette(screen);
+}
+
+// Hands a copy of a finished frame to the render thread
+static void present(ScreenBackend *backend, Framebuffer *fb,
+                    const uint32_t palette[4], uint64_t frame) {
+  (void)frame;
+  T *screen = (T *)backend;
+  Frame *back = frames_back(screen->frames);
+
+  framebuffer_copy(back->framebuffer, fb);
+  memcpy(back->palette, palette, sizeof(back->palette));
+
+  frames_publish(screen->frames);
+}
+
+T *raylib_screen_new(int width, int height, int scale) {
+  InitWindow(width * scale, height * scale, "Uxn");
+  SetExitKey(0);
+  HideCursor();
+  SetTargetFPS(60);
+
+  T *screen = (T *)malloc(sizeof(T));
+  *screen = (T){
+      .backend = {.present = present},
+      .frames = frames_new(width, height),
+      .scale = scale,
+  };
+
+  load_shader(screen);
+  alloc_pixels(screen, width, height);
+
+  return screen;
+}
+
+void raylib_screen_delete(T *screen) {
+  free_pixels(screen);
+  if (screen->shader_composite)
+    UnloadShader(screen->shader);
+  frames_delete(screen->frames);
+  free(screen);
+
+  CloseWindow();
+}
+
+void raylib_screen_composite_on_cpu(T *screen) {
+  if (!screen->shader_composite)
+    return;
+
+  int width = screen->texture.width;
+  int height = screen->texture.height;
+
+  free_pixels(screen);
+  UnloadShader(screen->shader);
+  screen->shader_composite = false;
+  alloc_pixels(screen, width, height);
+}
+
+// Uploads the part of a frame drawn since the last one shown
+static size_t upload_dirty(T *screen, Framebuffer *fb) {
+  FramebufferRect dirty = framebuffer_dirty(fb);
+  if (dirty.width <= 0 || dirty.height <= 0)
+    return 0;
+
+  if (screen->shader_composite)
+    framebuffer_indices(fb, dirty, screen->pixels);
+  else
+    framebuffer_composite(fb, screen->shown_palette, dirty, screen->pixels);
+  UpdateTextureRec(screen->texture,
+                   (Rectangle){(float)dirty.x, (float)dirty.y,
+                               (float)dirty.width, (float)dirty.height},
+                   screen->pixels);
+  framebuffer_clean(fb);
+
+  return (size_t)dirty.width * dirty.height * pixel_size(screen);
+}
+
+// Brings the texture up to date with a new frame
+static size_t show_frame(T *screen, Frame *frame) {
+  Framebuffer *fb = frame->framebuffer;
+
+  if (fb->width != screen->texture.width ||
+      fb->height != screen->texture.height) {
+    free_pixels(screen);
+    alloc_pixels(screen, fb->width, fb->height);
+    SetWindowSize(fb->width * screen->scale, fb->height * screen->scale);
+    framebuffer_touch_all(fb);
+  }
+
+  if (memcmp(frame->palette, screen->shown_palette, sizeof(frame->palette))) {
+    memcpy(screen->shown_palette, frame->palette, sizeof(frame->palette));
+
+    // The shader recolours the uploaded indices, only CPU compositing has to
+    // redo the whole texture
+    if (screen->shader_composite)
+      upload_palette(screen);
+    else
+      framebuffer_touch_all(fb);
+  }
+
+  return upload_dirty(screen, fb);
+}
+
+void raylib_screen_redraw(T *screen) {
+  Frame *frame = frames_take(screen->frames);
+  size_t bytes = frame ? show_frame(screen, frame) : 0;
+
+  if (!bytes)
+    screen->stats.skipped++;
+
+  screen->stats.frames++;
+  screen->stats.bytes += bytes;
+  screen->stats.last_bytes = bytes;
+
+  // Still draw the texture on frames that changed nothing: EndDrawing paces
+  // the frame and polls input
+  BeginDrawing();
+
+  if (screen->shader_composite)
+    BeginShaderMode(screen->shader);
+
+  // Scaled up on the GPU, with the point filter keeping pixels sharp
+  float width = screen->texture.width;
+  float height = screen->texture.height;
+  DrawTexturePro(screen->texture, (Rectangle){0, 0, width, height},
+                 (Rectangle){0, 0, width * screen->scale,
+                             height * screen->scale},
+                 (Vector2){0, 0}, 0, WHITE);
+
+  if (screen->shader_composite)
+    EndShaderMode();
+
+  EndDrawing();
+}
+
+void raylib_screen_poll(T *screen, InputQueue *input) {
+  controller_poll(input);
+  mouse_poll(input, screen->scale);
+
+  if (WindowShouldClose())
+    input_push(input, (InputEvent){.kind = INPUT_QUIT});
+}
+
+void raylib_screen_report(T *screen, FILE *out) {
+  ScreenStats *stats = &screen->stats;
+  uint64_t uploads = stats->frames - stats->skipped;
+
+  fprintf(out, "frames: %llu (%llu skipped)\n",
+          (unsigned long long)stats->frames,
+          (unsigned long long)stats->skipped);
+  fprintf(out, "uploaded: %llu bytes, %llu per upload, %zu last frame\n",
+          (unsigned long long)stats->bytes,
+          (unsigned long long)(uploads ? stats->bytes / uploads : 0),
+          stats->last_bytes);
+}
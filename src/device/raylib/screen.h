@@ -0,0 +1,105 @@
+#include "../frames.h"
+#include "../input.h"
+#include "../screen.h"
+#include <raylib.h>
+#include <stdio.h>
+
+#ifndef raylib_screen_h
+#define raylib_screen_h
+
+#define T RaylibScreen
+
+/**
+ * Texture upload counters, see `raylib_screen_report`.
+ */
+typedef struct {
+  uint64_t frames;
+  // Frames where nothing was drawn and the texture was reused as is
+  uint64_t skipped;
+  uint64_t bytes;
+  size_t last_bytes;
+} ScreenStats;
+
+/**
+ * Screen backend that shows frames in a raylib window.
+ *
+ * The VM thread presents frames by copying them into frames, and the render
+ * thread, which owns the window, the shader and the texture, shows the newest
+ * one every time it redraws.
+ */
+typedef struct T T;
+
+struct T {
+  ScreenBackend backend;
+  // Finished frames, from the VM thread to the render thread
+  FrameExchange *frames;
+
+  // Owned by the render thread
+  // Palette of the frame on screen
+  uint32_t shown_palette[4];
+  // Applies shown_palette to texture on the GPU, when it could be compiled.
+  // Without it the layers are composited on the CPU.
+  Shader shader;
+  bool shader_composite;
+  int palette_location;
+  // The dirty part of both layers, uploaded to texture once per frame: one
+  // framebuffer_indices byte per pixel with the shader, or one
+  // framebuffer_composite colour per pixel without
+  void *pixels;
+  Texture2D texture;
+  int scale;
+  ScreenStats stats;
+};
+
+/**
+ * @brief Open a window.
+ *
+ * @param width Width of the screen in pixels.
+ * @param height Height of the screen in pixels.
+ * @param scale Window pixels per screen pixel.
+ * @return A pointer to the new backend.
+ */
+T *raylib_screen_new(int width, int height, int scale);
+
+/**
+ * @brief Close the window and free the backend.
+ *
+ * @param screen Pointer to the backend.
+ */
+void raylib_screen_delete(T *screen);
+
+/**
+ * @brief Composite the layers on the CPU and upload colours, instead of
+ * palette indices for the shader. Call before the first redraw.
+ *
+ * @param screen Pointer to the backend.
+ */
+void raylib_screen_composite_on_cpu(T *screen);
+
+/**
+ * @brief Show the newest finished frame, or the last one again when there
+ * isn't a new one. Called by the render thread.
+ *
+ * @param screen Pointer to the backend.
+ */
+void raylib_screen_redraw(T *screen);
+
+/**
+ * @brief Queue the keyboard and mouse input since the last redraw, and
+ * INPUT_QUIT once the window has been closed. Called by the render thread.
+ *
+ * @param screen Pointer to the backend.
+ * @param input Queue to the VM thread.
+ */
+void raylib_screen_poll(T *screen, InputQueue *input);
+
+/**
+ * @brief Print the frame and texture upload counters.
+ *
+ * @param screen Pointer to the backend.
+ * @param out Stream to print to.
+ */
+void raylib_screen_report(T *screen, FILE *out);
+
+#undef T
+#endif // raylib_screen_h
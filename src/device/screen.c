@@ -1,115 +1,37 @@
-#include <raylib.h>
-#include <rlgl.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "screen.h"
 #include "system.h"
 
-#define ERASE WHITE
-#define T RaylibScreen
-
-// clang-format off
-
-// From the Varvara spec:
-// c = !ch
-//    ? (color % 5 ? color >> 2 : 0)
-//    : color % 4 + ch == 1 ? 0 : (ch - 2 + (color & 3)) % 3 + 1;
-static const Byte color_table[16][4] = {
-    {0, 0, 1, 2}, // In 1bpp mode index 0 = clear and index 1 = transparent
-    {0, 1, 2, 3}, 
-    {0, 2, 3, 1},
-    {0, 3, 1, 2},
-    {1, 0, 1, 2},
-    {0, 1, 2, 3}, // 0 in this mode is transparent
-    {1, 2, 3, 1},
-    {1, 3, 1, 2},
-    {2, 0, 1, 2},
-    {2, 1, 2, 3},
-    {0, 2, 3, 1}, // 0 in this mode is transparent
-    {2, 3, 1, 2},
-    {3, 0, 1, 2},
-    {3, 1, 2, 3},
-    {3, 2, 3, 1},
-    {0, 3, 1, 2}, // 0 in this mode is transparent
-};
-
-// clang-format on
-
-static void sprite_palette(Color palette[4], Color screen_colors[static 4],
-                           DrawLayer layer, Byte color_byte) {
-
-  // Load the colors from the screen palette
-  for (size_t i = 0; i < 4; i++) {
-    Byte color_index = color_table[color_byte][i];
-    palette[i] = layer == FG_LAYER && color_index == 0
-                     ? BLANK
-                     : screen_colors[color_index];
-  }
-
-  if (color_byte % 5 == 0) {
-    palette[0] = BLANK;
-  }
-}
-
-bool color_eq(Color a, Color b) {
-  return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
-}
-
-void screen_ImageErase(Image *img, Image eraser, int dstX, int dstY,
-                       Color eraser_color) {
-  // Security check to avoid program crash
-  if (img->data == NULL || img->width == 0 || img->height == 0 ||
-      eraser.data == NULL || eraser.width == 0 || eraser.height == 0)
-    return;
-
-  for (int y = 0; y < eraser.height; y++) {
-    for (int x = 0; x < eraser.width; x++) {
-      if (dstX + x >= img->width || dstY + y >= img->height || dstX + x < 0 ||
-          dstY + y < 0)
-        continue;
-
-      Color src_color = GetImageColor(eraser, x, y);
-      if (color_eq(src_color, eraser_color)) {
-        ImageDrawPixel(img, dstX + x, dstY + y, BLANK);
-      }
-    }
-  }
-}
-
-void screen_init(T *screen, int width, int height, int scale) {
-  InitWindow(width * scale, height * scale, "Uxn");
+#define T Screen
 
+void screen_init(T *screen, int width, int height, ScreenBackend *backend) {
   *screen = (T){
-      .sprite_buffer = GenImageColor(SPRITE_WIDTH, SPRITE_HEIGHT, BLANK),
-      .bg_buffer = GenImageColor(width, height, BLANK),
-      .fg_buffer = GenImageColor(width, height, BLANK),
+      .framebuffer = framebuffer_new(width, height),
+      .drawlist = drawlist_new(),
       .width = width,
       .height = height,
-      .scale = scale,
-      .palette = {RED, GREEN, BLUE, MAGENTA},
+      // Shown until the ROM sets its own colours
+      .palette = {framebuffer_rgba(230, 41, 55, 255),
+                  framebuffer_rgba(0, 228, 48, 255),
+                  framebuffer_rgba(0, 121, 241, 255),
+                  framebuffer_rgba(255, 0, 255, 255)},
+      .publish_every = 1,
+      .backend = backend,
   };
-
-  screen->bg_tex = LoadTextureFromImage(screen->bg_buffer);
-  screen->fg_tex = LoadTextureFromImage(screen->fg_buffer);
-
-  SetTargetFPS(60);
 }
 
 void screen_destroy(T *screen) {
-
-  UnloadImage(screen->sprite_buffer);
-  UnloadImage(screen->bg_buffer);
-  UnloadImage(screen->fg_buffer);
-  UnloadTexture(screen->fg_tex);
-  UnloadTexture(screen->bg_tex);
-
-  CloseWindow();
+  if (screen->rasterizer)
+    rasterizer_delete(screen->rasterizer);
+  drawlist_delete(screen->drawlist);
+  framebuffer_delete(screen->framebuffer);
 }
 
-T *screen_new(int width, int height, int scale) {
+T *screen_new(int width, int height, ScreenBackend *backend) {
   T *screen = (T *)malloc(sizeof(T));
-  screen_init(screen, width, height, scale);
+  screen_init(screen, width, height, backend);
   return screen;
 }
 
@@ -118,33 +40,8 @@ void screen_delete(T *screen) {
   free(screen);
 }
 
-static void draw_buffer(Image *img, Texture2D *tex, int scale) {
-
-  UpdateTexture(*tex, img->data);
-
-  DrawTexturePro(
-      *tex, (Rectangle){0, 0, (float)tex->width, (float)tex->height},
-      (Rectangle){0, 0, (float)tex->width * scale, (float)tex->height * scale},
-      (Vector2){0, 0}, 0, WHITE);
-}
-
-void screen_redraw(Uxn *uxn, T *screen) {
-
-  BeginDrawing();
-
-  ClearBackground(screen->palette[0]);
-
-  draw_buffer(&screen->bg_buffer, &screen->bg_tex, screen->scale);
-  draw_buffer(&screen->fg_buffer, &screen->fg_tex, screen->scale);
-
-  EndDrawing();
-
-  if (WindowShouldClose())
-    uxn_dev_write(uxn, SYSTEM_STATE_PORT, 1);
-}
-
 void screen_boot(Uxn *uxn) {
-  RaylibScreen *screen = uxn_get_screen(uxn);
+  Screen *screen = uxn_get_screen(uxn);
 
   uxn_dev_write_short(uxn, SCREEN_WIDTH_PORT, screen->width);
   uxn_dev_write_short(uxn, SCREEN_HEIGHT_PORT, screen->height);
@@ -168,16 +65,6 @@ void screen_pixel_port(Uxn *uxn, T *screen) {
 
   Byte fill_mode = control & 0x80;
 
-  Color draw_color = screen->palette[color];
-
-  bool erase_mode = color == 0 && layer == FG_LAYER;
-  if (erase_mode) {
-    draw_color = BLANK;
-  }
-
-  Image *layer_buffer =
-      layer == FG_LAYER ? &screen->fg_buffer : &screen->bg_buffer;
-
   if (fill_mode) {
 
     int rect_x = flip_x ? 0 : x;
@@ -185,11 +72,11 @@ void screen_pixel_port(Uxn *uxn, T *screen) {
     int rect_width = flip_x ? x : screen->width - x;
     int rect_height = flip_y ? y : screen->height - y;
 
-    ImageDrawRectangle(layer_buffer, rect_x, rect_y, rect_width, rect_height,
-                       draw_color);
+    drawlist_fill(screen->drawlist, screen->framebuffer, layer, rect_x, rect_y,
+                  rect_width, rect_height, color);
 
   } else {
-    ImageDrawPixel(layer_buffer, x, y, draw_color);
+    drawlist_pixel(screen->drawlist, screen->framebuffer, layer, x, y, color);
   }
 
   if (auto_x) {
@@ -207,68 +94,14 @@ void read_sprite_chunk(Uxn *uxn, Byte buffer[SPRITE_BUFFER_SIZE], Short addr) {
   uxn_mem_buffer_read(uxn, SPRITE_BUFFER_SIZE, buffer, addr);
 }
 
-void decode_1bpp_sprite(Byte sprite_data[SPRITE_BUFFER_SIZE],
-                        Byte decoded_data[SPRITE_HEIGHT][SPRITE_WIDTH]) {
-  for (int i = 0; i < SPRITE_HEIGHT; i++) {
-    Byte row = sprite_data[i];
-    for (int j = 0; j < SPRITE_WIDTH; j++) {
-      Byte bit = (row >> j) & 0x01;
-      decoded_data[i][7 - j] = bit;
-    }
-  }
-}
-
-void decode_2bpp_sprite(Byte low_bit_data[SPRITE_BUFFER_SIZE],
-                        Byte high_bit_data[SPRITE_BUFFER_SIZE],
-                        Byte decoded_data[SPRITE_HEIGHT][SPRITE_WIDTH]) {
-  for (int i = 0; i < SPRITE_HEIGHT; i++) {
-    Byte low_row = low_bit_data[i];
-    Byte high_row = high_bit_data[i];
-    for (int j = 0; j < SPRITE_WIDTH; j++) {
-      Byte low_bit = (low_row >> j) & 0x01;
-      Byte high_bit = (high_row >> j) & 0x01;
-      decoded_data[i][7 - j] = (high_bit << 1) | low_bit;
-    }
-  }
-}
-void read_1bpp_sprite(Uxn *uxn, Image *buffer, Color palette[]) {
+static void read_sprite(Uxn *uxn, Byte sprite[SPRITE_2BPP_BUFFER_SIZE],
+                        bool two_bit_mode) {
   Short addr = uxn_dev_read_short(uxn, SCREEN_ADDR_PORT);
 
-  Byte sprite_data[SPRITE_BUFFER_SIZE] = {0};
-  read_sprite_chunk(uxn, sprite_data, addr);
-
-  Byte decoded_data[SPRITE_HEIGHT][SPRITE_WIDTH] = {0};
-  decode_1bpp_sprite(sprite_data, decoded_data);
-
-  ImageClearBackground(buffer, BLANK);
-
-  for (int j = 0; j < SPRITE_HEIGHT; j++) {
-    for (int i = 0; i < SPRITE_WIDTH; i++) {
-      Color color = palette[decoded_data[j][i]];
-      ImageDrawPixel(buffer, i, j, color);
-    }
-  }
-}
-
-void read_2bpp_sprite(Uxn *uxn, Image *buffer, Color palette[]) {
-  Short addr = uxn_dev_read_short(uxn, SCREEN_ADDR_PORT);
-
-  Byte low_bit_data[SPRITE_BUFFER_SIZE] = {0};
-  Byte high_bit_data[SPRITE_BUFFER_SIZE] = {0};
-  read_sprite_chunk(uxn, low_bit_data, addr);
-  read_sprite_chunk(uxn, high_bit_data, addr + SPRITE_BUFFER_SIZE);
-
-  Byte decoded_data[SPRITE_HEIGHT][SPRITE_WIDTH] = {0};
-  decode_2bpp_sprite(low_bit_data, high_bit_data, decoded_data);
-
-  ImageClearBackground(buffer, BLANK);
-
-  for (int j = 0; j < SPRITE_HEIGHT; j++) {
-    for (int i = 0; i < SPRITE_WIDTH; i++) {
-      Color color = palette[decoded_data[j][i]];
-      ImageDrawPixel(buffer, i, j, color);
-    }
-  }
+  read_sprite_chunk(uxn, sprite, addr);
+  if (two_bit_mode)
+    read_sprite_chunk(uxn, sprite + SPRITE_BUFFER_SIZE,
+                      addr + SPRITE_BUFFER_SIZE);
 }
 
 static void shift_sprite_addr(Uxn *uxn, bool two_bit_mode) {
@@ -292,30 +125,14 @@ void screen_draw_sprite(Uxn *uxn, T *screen, Byte control) {
 
   Byte two_bit_mode = control & 0x80;
 
-  Color palette[4] = {0};
-  sprite_palette(palette, screen->palette, layer, color);
-
-  bool erase_mode = color == 0 && !two_bit_mode;
-
-  if (erase_mode) {
-    palette[1] = ERASE;
-  }
-
   int dirX = flip_x ? -1 : 1;
   int dirY = flip_y ? -1 : 1;
 
   Byte auto_addr = auto_byte & 0x04;
   Byte auto_length = (auto_byte & 0xf0) >> 4;
 
-  Image layer_buffer =
-      layer == FG_LAYER ? screen->fg_buffer : screen->bg_buffer;
-
-  // Read sprite data
-  if (two_bit_mode) {
-    read_2bpp_sprite(uxn, &screen->sprite_buffer, palette);
-  } else {
-    read_1bpp_sprite(uxn, &screen->sprite_buffer, palette);
-  }
+  Byte sprite[SPRITE_2BPP_BUFFER_SIZE] = {0};
+  read_sprite(uxn, sprite, two_bit_mode);
 
   /**
    * The definition of dx and dy looks confusing
@@ -327,44 +144,18 @@ void screen_draw_sprite(Uxn *uxn, T *screen, Byte control) {
    * rightward for auto-x and as rows moving downward for auto-y
    */
 
-  float dx = auto_y ? dirX * SPRITE_WIDTH : 0;
-  float dy = auto_x ? dirY * SPRITE_HEIGHT : 0;
+  int dx = auto_y ? dirX * SPRITE_WIDTH : 0;
+  int dy = auto_x ? dirY * SPRITE_HEIGHT : 0;
 
   size_t num_sprites = auto_x || auto_y ? auto_length + 1 : 1;
 
   for (size_t i = 0; i < num_sprites; i++) {
-    if (y + i * dy > screen->height || x + i * dx > screen->width) {
-      // continue;
-    }
-
-    if (flip_x)
-      ImageFlipHorizontal(&screen->sprite_buffer);
-    if (flip_y)
-      ImageFlipVertical(&screen->sprite_buffer);
-
-    if (erase_mode) {
-      screen_ImageErase(&layer_buffer, screen->sprite_buffer, x + i * dx,
-                        y + i * dy, ERASE);
-    } else {
-      ImageDraw(
-          &layer_buffer, screen->sprite_buffer,
-          (Rectangle){0, 0, SPRITE_WIDTH, SPRITE_HEIGHT},
-          (Rectangle){(float)x + i * dx, (float)y + i * dy, SPRITE_WIDTH, SPRITE_HEIGHT},
-          WHITE);
-    }
-
-    if (flip_x)
-      ImageFlipHorizontal(&screen->sprite_buffer);
-    if (flip_y)
-      ImageFlipVertical(&screen->sprite_buffer);
+    drawlist_sprite(screen->drawlist, screen->framebuffer, layer, x + i * dx,
+                    y + i * dy, sprite, two_bit_mode, color, flip_x, flip_y);
 
     if (auto_addr) {
       shift_sprite_addr(uxn, two_bit_mode);
-      if (two_bit_mode) {
-        read_2bpp_sprite(uxn, &screen->sprite_buffer, palette);
-      } else {
-        read_1bpp_sprite(uxn, &screen->sprite_buffer, palette);
-      }
+      read_sprite(uxn, sprite, two_bit_mode);
     }
   }
 
@@ -384,7 +175,7 @@ void screen_sprite_port(Uxn *uxn, T *screen) {
 }
 
 void screen_change_palette(Uxn *uxn) {
-  RaylibScreen *screen = uxn_get_screen(uxn);
+  Screen *screen = uxn_get_screen(uxn);
 
   Short red_bits = uxn_dev_read_short(uxn, SYSTEM_RED_PORT);
   Short green_bits = uxn_dev_read_short(uxn, SYSTEM_GREEN_PORT);
@@ -401,44 +192,57 @@ void screen_change_palette(Uxn *uxn) {
     green = green | (green << 4);
     blue = blue | (blue << 4);
 
-    screen->palette[color] = (Color){
-        .r = red,
-        .g = green,
-        .b = blue,
-        .a = 255,
-    };
+    screen->palette[color] = framebuffer_rgba(red, green, blue, 255);
   }
 }
 
+void screen_flush(T *screen) {
+  if (screen->dump_drawlist)
+    drawlist_dump(screen->drawlist, stderr);
+
+  if (screen->rasterizer)
+    rasterizer_flush(screen->rasterizer, screen->drawlist, screen->framebuffer);
+  else
+    drawlist_flush(screen->drawlist, screen->framebuffer);
+}
+
+// Hands the framebuffer to the backend
+static void publish_frame(T *screen) {
+  if (screen->backend)
+    screen->backend->present(screen->backend, screen->framebuffer,
+                             screen->palette, screen->vectors);
+  framebuffer_clean(screen->framebuffer);
+}
+
 void screen_update(Uxn *uxn) {
-  RaylibScreen *screen = uxn_get_screen(uxn);
+  Screen *screen = uxn_get_screen(uxn);
   Short screen_vector = uxn_dev_read_short(uxn, SCREEN_VECTOR_PORT);
 
   uxn_eval(uxn, screen_vector);
-  screen_redraw(uxn, screen);
+  screen_flush(screen);
+
+  // The frames in between are never shown, their dirty rectangles add up
+  // until one is
+  if (++screen->vectors % screen->publish_every == 0)
+    publish_frame(screen);
 }
 
 void screen_resize(Uxn *uxn) {
-  RaylibScreen *screen = uxn_get_screen(uxn);
+  Screen *screen = uxn_get_screen(uxn);
+
+  // Recorded at the old size, and culled against it
+  screen_flush(screen);
 
   screen->width = uxn_dev_read_short(uxn, SCREEN_WIDTH_PORT);
   screen->height = uxn_dev_read_short(uxn, SCREEN_HEIGHT_PORT);
 
-  UnloadImage(screen->bg_buffer);
-  UnloadImage(screen->fg_buffer);
-  UnloadTexture(screen->bg_tex);
-  UnloadTexture(screen->fg_tex);
-
-  screen->bg_buffer = GenImageColor(screen->width, screen->height, BLANK);
-  screen->fg_buffer = GenImageColor(screen->width, screen->height, BLANK);
-  screen->bg_tex = LoadTextureFromImage(screen->bg_buffer);
-  screen->fg_tex = LoadTextureFromImage(screen->fg_buffer);
-
-  SetWindowSize(screen->width * screen->scale, screen->height * screen->scale);
+  // The backend resizes its window or images when the first frame at the new
+  // size reaches it
+  framebuffer_resize(screen->framebuffer, screen->width, screen->height);
 }
 
 Byte screen_dei(Uxn *uxn, Byte addr) {
-  RaylibScreen *screen = uxn_get_screen(uxn);
+  Screen *screen = uxn_get_screen(uxn);
   switch (addr) {
   case SCREEN_WIDTH_PORT:
     return screen->width >> 8;
@@ -454,7 +258,7 @@ Byte screen_dei(Uxn *uxn, Byte addr) {
 }
 
 void screen_deo(Uxn *uxn, Byte addr) {
-  RaylibScreen *screen = uxn_get_screen(uxn);
+  Screen *screen = uxn_get_screen(uxn);
 
   switch (addr) {
   case SCREEN_WIDTH_PORT:
@@ -472,4 +276,79 @@ void screen_deo(Uxn *uxn, Byte addr) {
   default:
     break;
   }
-}
\ No newline at end of file
+}
+
+// Any write to the system colour ports changes the palette
+static void palette_deo(Uxn *uxn, Byte addr) {
+  (void)addr;
+  screen_change_palette(uxn);
+}
+
+void screen_register(Uxn *uxn) {
+  for (Byte addr = SCREEN_WIDTH_PORT; addr < SCREEN_HEIGHT_PORT + 2; addr++) {
+    uxn_set_dei(uxn, addr, screen_dei);
+    uxn_set_deo(uxn, addr, screen_deo);
+  }
+  uxn_set_deo(uxn, SCREEN_PIXEL_PORT, screen_deo);
+  uxn_set_deo(uxn, SCREEN_SPRITE_PORT, screen_deo);
+
+  for (Byte addr = SYSTEM_RED_PORT; addr < SYSTEM_BLUE_PORT + 2; addr++) {
+    uxn_set_deo(uxn, addr, palette_deo);
+  }
+}
+
+// Snapshots
+
+static bool screen_save(Uxn *uxn, FILE *out) {
+  Screen *screen = uxn_get_screen(uxn);
+  Framebuffer *fb = screen->framebuffer;
+
+  // Drawing recorded so far goes in with it
+  screen_flush(screen);
+
+  for (int color = 0; color < 4; color++) {
+    if (!snapshot_write_long(out, screen->palette[color]))
+      return false;
+  }
+
+  size_t layer_size = fb->stride * fb->height;
+  return snapshot_write_short(out, fb->width) &&
+         snapshot_write_short(out, fb->height) &&
+         snapshot_write(out, fb->layers[BG_LAYER], layer_size) &&
+         snapshot_write(out, fb->layers[FG_LAYER], layer_size);
+}
+
+static bool screen_load(Uxn *uxn, FILE *in, uint32_t length) {
+  Screen *screen = uxn_get_screen(uxn);
+  Framebuffer *fb = screen->framebuffer;
+
+  // Colours, then the size
+  const uint32_t header = 4 * 4 + 4;
+  if (length < header)
+    return false;
+  for (int color = 0; color < 4; color++) {
+    if (!snapshot_read_long(in, &screen->palette[color]))
+      return false;
+  }
+
+  Short width, height;
+  if (!snapshot_read_short(in, &width) || !snapshot_read_short(in, &height))
+    return false;
+
+  drawlist_clear(screen->drawlist);
+  screen->width = width;
+  screen->height = height;
+  framebuffer_resize(fb, width, height);
+
+  size_t layer_size = fb->stride * fb->height;
+  if (length != header + 2 * layer_size ||
+      !snapshot_read(in, fb->layers[BG_LAYER], layer_size) ||
+      !snapshot_read(in, fb->layers[FG_LAYER], layer_size))
+    return false;
+
+  framebuffer_touch_all(fb);
+  return true;
+}
+
+const SnapshotDevice screen_snapshot = {
+    .tag = "SCRN", .save = screen_save, .load = screen_load};
@@ -1,6 +1,10 @@
 #include "../common.h"
+#include "../snapshot.h"
 #include "../uxn.h"
-#include <raylib.h>
+#include "drawlist.h"
+#include "framebuffer.h"
+#include "raster.h"
+#include <stdio.h>
 
 #ifndef screen_h
 #define screen_h
@@ -18,14 +22,7 @@
 #define SCREEN_PIXEL_PORT 0x2e
 #define SCREEN_SPRITE_PORT 0x2f
 
-#define SPRITE_WIDTH 8
-#define SPRITE_HEIGHT 8
-#define SPRITE_BUFFER_SIZE 8
-#define SPRITE_1BPP_BUFFER_SIZE 8
-#define SPRITE_2BPP_BUFFER_SIZE 16
-
-#define T RaylibScreen
-#define ScreenT RaylibScreen
+#define T Screen
 
 typedef struct T T;
 
@@ -36,29 +33,96 @@ typedef enum {
 
 typedef enum { ONE_BIT, TWO_BIT } SpriteMode;
 
-typedef enum { BG_LAYER, FG_LAYER } DrawLayer;
+/**
+ * Where finished frames go: a window, see `src/device/raylib/screen.h`, or
+ * files, see `src/device/offscreen.h`.
+ *
+ * A backend embeds this as its first member, and is handed to `screen_new`.
+ */
+typedef struct ScreenBackend ScreenBackend;
+
+struct ScreenBackend {
+  /**
+   * @brief Take a finished frame. Called on the VM thread.
+   *
+   * @param backend Pointer to the backend.
+   * @param fb Both layers. Their dirty rectangles cover everything drawn
+   * since the last call, and are cleared once it returns.
+   * @param palette Screen colours in framebuffer_rgba format.
+   * @param frame Number of screen vectors run so far.
+   */
+  void (*present)(ScreenBackend *backend, Framebuffer *fb,
+                  const uint32_t palette[4], uint64_t frame);
+};
 
+/**
+ * The Varvara screen device. Everything here runs on the VM thread: drawing
+ * is recorded into drawlist, replayed into framebuffer at the end of every
+ * screen vector, and then handed to backend.
+ */
 struct T {
-  Image sprite_buffer;
-  Image bg_buffer;
-  Image fg_buffer;
-  Texture2D bg_tex;
-  Texture2D fg_tex;
+  Framebuffer *framebuffer;
+  // Drawing done by the current frame, replayed into framebuffer at the end
+  DrawList *drawlist;
+  // Print drawlist to stderr before every replay
+  bool dump_drawlist;
+  // Replays drawlist across several threads when set
+  Rasterizer *rasterizer;
   Short width;
   Short height;
-  int scale;
-  Color palette[4];
+  // Screen colours in framebuffer_rgba format
+  uint32_t palette[4];
+  // Screen vectors run so far, and how many of them make one frame for the
+  // backend
+  uint64_t vectors;
+  int publish_every;
+  ScreenBackend *backend;
 };
 
-T *screen_new(int widht, int height, int scale);
+/**
+ * @brief Allocate a screen.
+ *
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @param backend Where finished frames go, owned by the caller. May be NULL.
+ * @return A pointer to the new screen.
+ */
+T *screen_new(int width, int height, ScreenBackend *backend);
 void screen_delete(T *screen);
 
 Byte screen_dei(Uxn *uxn, Byte addr);
 void screen_deo(Uxn *uxn, Byte addr);
 
 void screen_boot(Uxn *uxn);
-void screen_update(Uxn *uxn);
+
+/**
+ * @brief Register the screen ports that draw or resize, and the system
+ * colour ports, which set the screen palette.
+ *
+ * @param uxn Pointer to the Uxn VM.
+ */
+void screen_register(Uxn *uxn);
 void screen_change_palette(Uxn *uxn);
 
+/**
+ * @brief Draw everything recorded since the last flush into the framebuffer,
+ * without handing it to the backend.
+ *
+ * @param screen Pointer to the screen.
+ */
+void screen_flush(T *screen);
+
+/**
+ * @brief Run the screen vector and hand the finished frame to the backend.
+ *
+ * @param uxn Pointer to the Uxn VM.
+ */
+void screen_update(Uxn *uxn);
+
+/**
+ * Saves the palette, the size and both layers of the screen.
+ */
+extern const SnapshotDevice screen_snapshot;
+
 #undef T
-#endif // screen_h
\ No newline at end of file
+#endif // screen_h
@@ -2,47 +2,43 @@
 #include "system.h"
 
 #include "../common.h"
+#include "../profile.h"
 #include "../uxn.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // System expansion operations
+//
+// Addresses wrap around the end of their bank, and operations on banks past
+// RAM_PAGES are ignored.
 static void system_expansion_fill(Uxn *uxn, Short op_addr) {
   Short length = uxn_mem_read_short(uxn, op_addr + 1);
   Short bank = uxn_mem_read_short(uxn, op_addr + 3);
   Short addr = uxn_mem_read_short(uxn, op_addr + 5);
   Byte value = uxn_mem_read(uxn, op_addr + 7);
 
-  for (int i = 0; i < length; i++) {
-    uxn_page_write(uxn, bank, addr + i, value);
-  }
-}
-
-static void system_expansion_copy_left(Uxn *uxn, Short op_addr) {
-  Short length = uxn_mem_read_short(uxn, op_addr + 1);
-  Short src_bank = uxn_mem_read_short(uxn, op_addr + 3);
-  Short src_addr = uxn_mem_read_short(uxn, op_addr + 5);
-  Short dst_bank = uxn_mem_read_short(uxn, op_addr + 7);
-  Short dst_addr = uxn_mem_read_short(uxn, op_addr + 9);
-
-  for (int i = 0; i < length; i++) {
-    Byte src = uxn_page_read(uxn, src_bank, src_addr + i);
-    uxn_page_write(uxn, dst_bank, dst_addr + i, src);
-  }
+  if (bank >= RAM_PAGES)
+    return;
+  uxn_page_fill(uxn, bank, addr, length, value);
 }
 
-static void system_expansion_copy_right(Uxn *uxn, Short op_addr) {
+static void system_expansion_copy(Uxn *uxn, Short op_addr, bool backwards) {
   Short length = uxn_mem_read_short(uxn, op_addr + 1);
   Short src_bank = uxn_mem_read_short(uxn, op_addr + 3);
   Short src_addr = uxn_mem_read_short(uxn, op_addr + 5);
   Short dst_bank = uxn_mem_read_short(uxn, op_addr + 7);
   Short dst_addr = uxn_mem_read_short(uxn, op_addr + 9);
 
-  for (int i = length - 1; i >= 0; i--) {
-    Byte src = uxn_page_read(uxn, src_bank, src_addr + i);
-    uxn_page_write(uxn, dst_bank, dst_addr + i, src);
-  }
+  if (src_bank >= RAM_PAGES || dst_bank >= RAM_PAGES)
+    return;
+  uxn_page_copy(uxn, dst_bank, dst_addr, src_bank, src_addr, length,
+                backwards);
 }
 
 static void system_expansion(Uxn *uxn) {
@@ -54,36 +50,98 @@ static void system_expansion(Uxn *uxn) {
     system_expansion_fill(uxn, op_addr);
     break;
   case CPYL:
-    system_expansion_copy_left(uxn, op_addr);
+    system_expansion_copy(uxn, op_addr, false);
     break;
   case CPYR:
-    system_expansion_copy_right(uxn, op_addr);
+    system_expansion_copy(uxn, op_addr, true);
     break;
   }
 }
 
-static int system_load(Uxn *uxn, char *filename) {
-  FILE *f = fopen(filename, "rb");
+// Reads up to length bytes, fewer only once the file runs out. -1 on errors.
+static ssize_t read_fully(int fd, Byte *buffer, size_t length) {
+  size_t done = 0;
+  while (done < length) {
+    ssize_t got = read(fd, &buffer[done], length - done);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got < 0)
+      return -1;
+    if (got == 0)
+      break;
+    done += got;
+  }
+  return done;
+}
 
-  if (!f)
+// Loads a ROM that can only be read in order, such as a pipe, reading every
+// bank it reaches straight away.
+static bool system_stream(Uxn *uxn, int fd) {
+  Byte *buffer = malloc(RAM_PAGE_SIZE);
+  if (!buffer)
+    return false;
+
+  bool ok = true;
+  size_t addr = RESET_VECTOR;
+  for (size_t page = 0; page < RAM_PAGES; page++, addr = 0) {
+    size_t length = RAM_PAGE_SIZE - addr;
+    ssize_t got = read_fully(fd, buffer, length);
+    if (got < 0) {
+      ok = false;
+      break;
+    }
+    if (got == 0 && page > 0)
+      break;
+    memset(&buffer[got], 0, length - got);
+    ok = uxn_page_load(uxn, buffer, length, page, addr);
+    if (!ok || (size_t)got < length)
+      break;
+  }
+
+  free(buffer);
+  return ok;
+}
+
+// Loads the ROM after the zero page. The part that doesn't fit in page 0
+// goes into the banks after it, which are only read once the ROM touches
+// them, so loading and rebooting cost the same however big the ROM is.
+// Pipes and other files without offsets are read in full instead.
+static int system_load(Uxn *uxn, char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
     return 0;
 
-  Byte page_buffer[RAM_PAGE_SIZE] = {0};
-  int page = 0;
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return 0;
+  }
 
-  int l = fread(&page_buffer[RESET_VECTOR], RAM_PAGE_SIZE - RESET_VECTOR, 1, f);
-  uxn_mem_load(uxn, page_buffer, sizeof(page_buffer), 0);
+  if (!S_ISREG(st.st_mode)) {
+    bool ok = system_stream(uxn, fd);
+    close(fd);
+    return ok;
+  }
 
-  while (l != 0 && ++page < RAM_PAGES) {
-    printf("Loading page %d\n", page);
-    memset(page_buffer, 0, sizeof(page_buffer));
-    l = fread(page_buffer, RAM_PAGE_SIZE, 1, f);
-    uxn_page_load(uxn, page_buffer, sizeof(page_buffer), page, 0);
+  size_t size = st.st_size;
+  size_t length = RAM_PAGE_SIZE - RESET_VECTOR;
+  if (length > size)
+    length = size;
+  bool ok = uxn_page_load_file(uxn, 0, RESET_VECTOR, fd, 0, length);
+
+  size_t offset = length;
+  for (size_t page = 1; ok && offset < size && page < RAM_PAGES; page++) {
+    length = size - offset;
+    if (length > RAM_PAGE_SIZE)
+      length = RAM_PAGE_SIZE;
+    ok = uxn_page_load_file(uxn, page, 0, fd, offset, length);
+    offset += length;
   }
 
-  fclose(f);
+  // Banks still to be read keep their own descriptors
+  close(fd);
 
-  return 1;
+  return ok;
 }
 
 static void system_zero(Uxn *uxn, bool soft) {
@@ -92,7 +150,10 @@ static void system_zero(Uxn *uxn, bool soft) {
   uxn_stack_zero(uxn);
 }
 
-void system_inspect(Uxn *uxn) { uxn_dump(uxn); }
+void system_inspect(Uxn *uxn) {
+  uxn_dump(uxn);
+  profile_report(uxn);
+}
 
 int system_error(char *msg, const char *err) {
   fprintf(stderr, "%s: %s\n", msg, err);
@@ -141,4 +202,14 @@ void system_deo(Uxn *uxn, Byte addr) {
     system_inspect(uxn);
     break;
   }
-}
\ No newline at end of file
+}
+
+void system_register(Uxn *uxn) {
+  uxn_set_dei(uxn, SYSTEM_WST_PORT, system_dei);
+  uxn_set_dei(uxn, SYSTEM_RST_PORT, system_dei);
+
+  uxn_set_deo(uxn, SYSTEM_EXPANSION_PORT, system_deo);
+  uxn_set_deo(uxn, SYSTEM_WST_PORT, system_deo);
+  uxn_set_deo(uxn, SYSTEM_RST_PORT, system_deo);
+  uxn_set_deo(uxn, SYSTEM_DEBUG_PORT, system_deo);
+}
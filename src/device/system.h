@@ -24,4 +24,11 @@ int system_boot(Uxn *uxn, char *rom_path);
 Byte system_dei(Uxn *uxn, Byte addr);
 void system_deo(Uxn *uxn, Byte addr);
 
+/**
+ * @brief Register the system ports that do more than store a byte.
+ *
+ * @param uxn Pointer to the Uxn VM.
+ */
+void system_register(Uxn *uxn);
+
 #endif // system_h
\ No newline at end of file
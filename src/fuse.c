@@ -0,0 +1,139 @@
+#include "fuse.h"
+#include "code.h"
+#include <sys/mman.h>
+
+#define UXN_FUSED_LENGTH(NAME, name, length) [FUSED_##NAME] = length,
+
+const Byte uxn_fused_lengths[FUSED_COUNT] = {
+    [FUSED_NONE] = 1, UXN_FUSED_OPS(UXN_FUSED_LENGTH)};
+
+#undef UXN_FUSED_LENGTH
+
+const Byte uxn_fused_none[RAM_PAGE_SIZE] = {0};
+
+#define LIT 0x80
+#define LIT_2 0xa0
+#define INC 0x01
+#define INC_2 0x21
+#define DUP 0x06
+#define DUP_2 0x26
+#define JCI 0x20
+
+static bool is_compare(Byte op) { return op >= 0x08 && op <= 0x0b; }
+static bool is_compare_2(Byte op) { return op >= 0x28 && op <= 0x2b; }
+
+/**
+ * Returns the superinstruction for the bytes starting at pc, or FUSED_NONE.
+ */
+static Byte fuse_match(Uxn *uxn, Short pc) {
+  Byte b[UXN_FUSE_MAX_BYTES];
+  for (int i = 0; i < UXN_FUSE_MAX_BYTES; i++) {
+    b[i] = uxn_mem_read(uxn, (Short)(pc + i));
+  }
+
+  switch (b[0]) {
+  case LIT:
+    switch (b[2]) {
+    case 0x10:
+      return FUSED_LIT_LDZ;
+    case 0x30:
+      return FUSED_LIT_LDZ_2;
+    case 0x11:
+      return FUSED_LIT_STZ;
+    case 0x31:
+      return FUSED_LIT_STZ_2;
+    case 0x17:
+      return FUSED_LIT_DEO;
+    case 0x37:
+      return FUSED_LIT_DEO_2;
+    case 0x18:
+      return FUSED_LIT_ADD;
+    case 0x19:
+      return FUSED_LIT_SUB;
+    }
+    break;
+  case LIT_2:
+    switch (b[3]) {
+    case 0x14:
+      return FUSED_LIT_2_LDA;
+    case 0x34:
+      return FUSED_LIT_2_LDA_2;
+    case 0x15:
+      return FUSED_LIT_2_STA;
+    case 0x35:
+      return FUSED_LIT_2_STA_2;
+    case 0x38:
+      return FUSED_LIT_2_ADD_2;
+    case 0x39:
+      return FUSED_LIT_2_SUB_2;
+    }
+    break;
+  case DUP:
+    if (b[1] == LIT && is_compare(b[3]) && b[4] == JCI)
+      return FUSED_DUP_LIT_EQU_JCI + (b[3] - 0x08);
+    break;
+  case DUP_2:
+    if (b[1] == LIT_2 && is_compare_2(b[4]) && b[5] == JCI)
+      return FUSED_DUP_2_LIT_2_EQU_2_JCI + (b[4] - 0x28);
+    break;
+  case INC:
+    if (b[1] == DUP && b[2] == LIT && is_compare(b[4]) && b[5] == JCI)
+      return FUSED_INC_DUP_LIT_EQU_JCI + (b[4] - 0x08);
+    break;
+  case INC_2:
+    if (b[1] == DUP_2 && b[2] == LIT_2 && is_compare_2(b[5]) && b[6] == JCI)
+      return FUSED_INC_2_DUP_2_LIT_2_EQU_2_JCI + (b[5] - 0x28);
+    break;
+  }
+
+  return FUSED_NONE;
+}
+
+// Gives a VM a table of its own, the first time it matches an idiom. NULL
+// when there's no memory for one, leaving the VM without superinstructions.
+// The table is mapped rather than allocated so that only the parts of it
+// that hold idioms are ever resident, where calloc may clear all of it.
+static Byte *own_table(Uxn *uxn) {
+  if (uxn->fused == uxn_fused_none) {
+    Byte *table = mmap(NULL, RAM_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED)
+      return NULL;
+    uxn->fused = table;
+  }
+  return (Byte *)uxn->fused;
+}
+
+void uxn_fuse_free(Uxn *uxn) {
+  if (uxn->fused != uxn_fused_none)
+    munmap((Byte *)uxn->fused, RAM_PAGE_SIZE);
+  uxn->fused = uxn_fused_none;
+}
+
+void uxn_fuse_scan(Uxn *uxn, Short addr, size_t length) {
+  size_t count = length + UXN_FUSE_MAX_BYTES - 1;
+  Short pc = addr - (UXN_FUSE_MAX_BYTES - 1);
+
+  if (count >= RAM_PAGE_SIZE) {
+    count = RAM_PAGE_SIZE;
+    pc = 0;
+  }
+
+  for (size_t i = 0; i < count; i++, pc++) {
+    Byte old = uxn->fused[pc];
+    Byte fused = fuse_match(uxn, pc);
+    if (old == fused)
+      continue;
+
+    Byte *table = own_table(uxn);
+    if (!table)
+      return;
+    table[pc] = fused;
+    // Any of the bytes an idiom could span may turn it into another one
+    if (!old) {
+      uxn_code_watch(uxn, pc, UXN_FUSE_MAX_BYTES);
+    } else if (!fused) {
+      uxn_code_unwatch(uxn, pc, UXN_FUSE_MAX_BYTES);
+    }
+  }
+}
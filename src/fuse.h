@@ -0,0 +1,140 @@
+#include "common.h"
+#include "ops.h"
+#include "uxn.h"
+
+#ifndef fuse_h
+#define fuse_h
+
+/**
+ * Superinstructions.
+ *
+ * Every address in page 0 has an entry in a side table (`Uxn.fused`) that is
+ * non-zero when the bytes starting there form one of the idioms below. When
+ * uxn_eval dispatches one of the instructions an idiom can start with, it
+ * checks the table and runs the whole sequence through a single handler.
+ *
+ * Each idiom ends with its only instruction that can write RAM or call a
+ * device, so a sequence never runs past code it has just changed. The table
+ * watches the code pages its idioms were matched in (see code.h), and writes
+ * to those pages rescan the addresses they could have changed, which keeps
+ * the table coherent with self-modifying code.
+ *
+ * A VM only allocates its table once a scan matches an idiom. Until then it
+ * points at uxn_fused_none, so a VM that never loads code costs 64 KiB less.
+ */
+
+/**
+ * X-macro over the superinstructions.
+ *
+ * X(NAME, name, length) where length is the number of instructions fused.
+ * The four compare variants of each branch idiom must stay in opcode order
+ * (EQU, NEQ, GTH, LTH), the scanner relies on it.
+ */
+#define UXN_FUSED_OPS(X)                                                       \
+  X(LIT_LDZ, lit_ldz, 2)                                                       \
+  X(LIT_LDZ_2, lit_ldz_2, 2)                                                   \
+  X(LIT_STZ, lit_stz, 2)                                                       \
+  X(LIT_STZ_2, lit_stz_2, 2)                                                   \
+  X(LIT_2_LDA, lit_2_lda, 2)                                                   \
+  X(LIT_2_LDA_2, lit_2_lda_2, 2)                                               \
+  X(LIT_2_STA, lit_2_sta, 2)                                                   \
+  X(LIT_2_STA_2, lit_2_sta_2, 2)                                               \
+  X(LIT_DEO, lit_deo, 2)                                                       \
+  X(LIT_DEO_2, lit_deo_2, 2)                                                   \
+  X(LIT_ADD, lit_add, 2)                                                       \
+  X(LIT_SUB, lit_sub, 2)                                                       \
+  X(LIT_2_ADD_2, lit_2_add_2, 2)                                               \
+  X(LIT_2_SUB_2, lit_2_sub_2, 2)                                               \
+  X(DUP_LIT_EQU_JCI, dup_lit_equ_jci, 4)                                       \
+  X(DUP_LIT_NEQ_JCI, dup_lit_neq_jci, 4)                                       \
+  X(DUP_LIT_GTH_JCI, dup_lit_gth_jci, 4)                                       \
+  X(DUP_LIT_LTH_JCI, dup_lit_lth_jci, 4)                                       \
+  X(DUP_2_LIT_2_EQU_2_JCI, dup_2_lit_2_equ_2_jci, 4)                           \
+  X(DUP_2_LIT_2_NEQ_2_JCI, dup_2_lit_2_neq_2_jci, 4)                           \
+  X(DUP_2_LIT_2_GTH_2_JCI, dup_2_lit_2_gth_2_jci, 4)                           \
+  X(DUP_2_LIT_2_LTH_2_JCI, dup_2_lit_2_lth_2_jci, 4)                           \
+  X(INC_DUP_LIT_EQU_JCI, inc_dup_lit_equ_jci, 5)                               \
+  X(INC_DUP_LIT_NEQ_JCI, inc_dup_lit_neq_jci, 5)                               \
+  X(INC_DUP_LIT_GTH_JCI, inc_dup_lit_gth_jci, 5)                               \
+  X(INC_DUP_LIT_LTH_JCI, inc_dup_lit_lth_jci, 5)                               \
+  X(INC_2_DUP_2_LIT_2_EQU_2_JCI, inc_2_dup_2_lit_2_equ_2_jci, 5)               \
+  X(INC_2_DUP_2_LIT_2_NEQ_2_JCI, inc_2_dup_2_lit_2_neq_2_jci, 5)               \
+  X(INC_2_DUP_2_LIT_2_GTH_2_JCI, inc_2_dup_2_lit_2_gth_2_jci, 5)               \
+  X(INC_2_DUP_2_LIT_2_LTH_2_JCI, inc_2_dup_2_lit_2_lth_2_jci, 5)
+
+#define UXN_FUSED_ENUM(NAME, name, length) FUSED_##NAME,
+
+typedef enum FusedOp {
+  FUSED_NONE,
+  UXN_FUSED_OPS(UXN_FUSED_ENUM) FUSED_COUNT
+} FusedOp;
+
+#undef UXN_FUSED_ENUM
+
+/**
+ * Longest idiom in bytes (INC2 DUP2 LIT2 xx xx NEQ2 JCI xx xx).
+ */
+#define UXN_FUSE_MAX_BYTES 9
+
+/**
+ * True for the instruction bytes that can start an idiom: LIT, LIT2, INC,
+ * INC2, DUP and DUP2.
+ */
+#define UXN_FUSE_START(byte)                                                   \
+  ((byte) == 0x80 || (byte) == 0xa0 || (byte) == 0x01 || (byte) == 0x21 ||     \
+   (byte) == 0x06 || (byte) == 0x26)
+
+/**
+ * Superinstruction handlers indexed by FusedOp, called like any other UxnOp
+ * with the PC just past the first opcode byte.
+ */
+extern const UxnOp uxn_fused_ops[FUSED_COUNT];
+
+/**
+ * Number of instructions each superinstruction stands for.
+ */
+extern const Byte uxn_fused_lengths[FUSED_COUNT];
+
+/**
+ * Table of a VM with no superinstructions, all FUSED_NONE.
+ */
+extern const Byte uxn_fused_none[RAM_PAGE_SIZE];
+
+/**
+ * @brief Rematch the idioms that could overlap a range of page 0.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param addr First address that was written.
+ * @param length Number of bytes written, anything from 0x10000 up rescans the
+ * whole page.
+ */
+void uxn_fuse_scan(Uxn *uxn, Short addr, size_t length);
+
+/**
+ * @brief Free a VM's table, leaving it with no superinstructions until the
+ * next scan.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ */
+void uxn_fuse_free(Uxn *uxn);
+
+/**
+ * @brief Run the superinstruction at an address, or the plain handler if
+ * there is none.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param pc PC just past the opcode byte.
+ * @param op Handler for the opcode byte itself.
+ * @return The PC of the next instruction.
+ */
+static inline Short uxn_eval_fused(Uxn *uxn, Short pc, UxnOp op) {
+  Byte fused = uxn->fused[(Short)(pc - 1)];
+  if (!fused)
+    return op(uxn, pc);
+#ifdef UXN_STATS
+  uxn->instructions += uxn_fused_lengths[fused] - 1;
+#endif
+  return uxn_fused_ops[fused](uxn, pc);
+}
+
+#endif // fuse_h
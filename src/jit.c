@@ -0,0 +1,1464 @@
+#include "jit.h"
+#include "code.h"
+#include "ops.h"
+
+#ifdef UXN_JIT
+
+#if !defined(__x86_64__)
+#error "UXN_JIT needs an x86-64 target"
+#endif
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Block entries before a block start is compiled
+#ifndef UXN_JIT_THRESHOLD
+#define UXN_JIT_THRESHOLD 32
+#endif
+
+#define CODE_SIZE (4 << 20)
+// Room a single block may take up in the code buffer
+#define BLOCK_RESERVE 0x4000
+#define MAX_BLOCKS 0x4000
+#define MAX_BLOCK_OPS 128
+// Widest range of stack slots a block may touch, relative to the stack
+// pointers it was entered with
+#define MAX_SLOT_SPAN 192
+// Times a block start is recompiled after being overwritten before it is left
+// to the interpreter for good
+#define MAX_RECOMPILES 4
+#define NEVER_COMPILE 0xffff
+// Set in a block's return value when the instruction at the returned PC has to
+// be interpreted
+#define INTERPRET 0x10000
+
+typedef uint32_t (*JitCode)(Uxn *uxn);
+
+typedef struct JitBlock {
+  Short start;
+  Short length;
+  bool live;
+} JitBlock;
+
+struct Jit {
+  Byte *buffer;
+  size_t used;
+
+  JitCode code[0x10000];
+  uint16_t hits[0x10000];
+  Byte recompiles[0x10000];
+
+  JitBlock blocks[MAX_BLOCKS];
+  size_t block_count;
+  // Number of live blocks overlapping each code page, so that writes to pages
+  // only the superinstruction table watches skip the block list
+  uint16_t pages[CODE_PAGES];
+
+  // Set whenever a block is dropped, so that compiled stores can tell whether
+  // they overwrote code
+  bool invalidated;
+};
+
+// Lifecycle management
+
+Jit *jit_new(void) {
+  Jit *jit = calloc(1, sizeof(Jit));
+  if (!jit)
+    return NULL;
+
+  jit->buffer = mmap(NULL, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (jit->buffer == MAP_FAILED) {
+    free(jit);
+    return NULL;
+  }
+
+  return jit;
+}
+
+void jit_delete(Jit *jit) {
+  if (jit) {
+    munmap(jit->buffer, CODE_SIZE);
+    free(jit);
+  }
+}
+
+static void jit_flush(Jit *jit, Uxn *uxn) {
+  for (size_t i = 0; i < jit->block_count; i++) {
+    if (jit->blocks[i].live)
+      uxn_code_unwatch(uxn, jit->blocks[i].start, jit->blocks[i].length);
+  }
+  memset(jit->code, 0, sizeof(jit->code));
+  memset(jit->hits, 0, sizeof(jit->hits));
+  memset(jit->pages, 0, sizeof(jit->pages));
+  jit->block_count = 0;
+  jit->used = 0;
+  jit->invalidated = true;
+}
+
+// Invalidation
+
+// Adds delta to the count of every page a block overlaps
+static void count_pages(Jit *jit, Short start, Short length, int delta) {
+  size_t first = start / CODE_PAGE_SIZE;
+  size_t last = (start + length - 1) / CODE_PAGE_SIZE;
+  for (size_t page = first; page <= last; page++) {
+    jit->pages[page % CODE_PAGES] += delta;
+  }
+}
+
+static void drop_block(Jit *jit, Uxn *uxn, JitBlock *block) {
+  block->live = false;
+  jit->code[block->start] = NULL;
+  jit->hits[block->start] =
+      ++jit->recompiles[block->start] > MAX_RECOMPILES ? NEVER_COMPILE : 0;
+  count_pages(jit, block->start, block->length, -1);
+  uxn_code_unwatch(uxn, block->start, block->length);
+  jit->invalidated = true;
+}
+
+void jit_invalidate(Uxn *uxn, Short addr, size_t length) {
+  Jit *jit = uxn->jit;
+  if (!jit || !length || !jit->block_count)
+    return;
+
+  if (length < 0x10000) {
+    bool code = false;
+    size_t first = addr / CODE_PAGE_SIZE;
+    size_t last = (addr + length - 1) / CODE_PAGE_SIZE;
+    for (size_t page = first; page <= last; page++) {
+      code |= jit->pages[page % CODE_PAGES] != 0;
+    }
+    if (!code)
+      return;
+  }
+
+  for (size_t i = 0; i < jit->block_count; i++) {
+    JitBlock *block = &jit->blocks[i];
+    if (block->live &&
+        (length >= 0x10000 || (Short)(addr - block->start) < block->length ||
+         (Short)(block->start - addr) < length)) {
+      drop_block(jit, uxn, block);
+    }
+  }
+}
+
+// Stores called from compiled code. They return whether the write dropped any
+// block, in which case the block that called them exits right away.
+
+static uint32_t store_zero_page(Uxn *uxn, uint32_t addr, uint32_t value) {
+  Jit *jit = uxn->jit;
+  jit->invalidated = false;
+  uxn_zero_page_write(uxn, addr, value);
+  return jit->invalidated;
+}
+
+static uint32_t store_zero_page_short(Uxn *uxn, uint32_t addr,
+                                      uint32_t value) {
+  Jit *jit = uxn->jit;
+  jit->invalidated = false;
+  uxn_zero_page_write_short(uxn, addr, value);
+  return jit->invalidated;
+}
+
+static uint32_t store(Uxn *uxn, uint32_t addr, uint32_t value) {
+  Jit *jit = uxn->jit;
+  jit->invalidated = false;
+  uxn_mem_write(uxn, addr, value);
+  return jit->invalidated;
+}
+
+static uint32_t store_short(Uxn *uxn, uint32_t addr, uint32_t value) {
+  Jit *jit = uxn->jit;
+  jit->invalidated = false;
+  uxn_mem_write_short(uxn, addr, value);
+  return jit->invalidated;
+}
+
+// x86-64 encoding
+
+enum {
+  RAX = 0,
+  RCX = 1,
+  RDX = 2,
+  RBX = 3,
+  RSP = 4,
+  RBP = 5,
+  RSI = 6,
+  RDI = 7,
+  R8 = 8,
+  R9 = 9,
+  R10 = 10,
+  R11 = 11,
+  R12 = 12,
+  R13 = 13,
+  R14 = 14,
+  R15 = 15,
+  NO_REG = -1,
+};
+
+/**
+ * Register assignment inside a block:
+ *
+ * rbx/rbp  working/return stack pointer, zero extended
+ * r12/r15  working/return stack data
+ * r13      the Uxn
+ * r14      RAM
+ *
+ * The caller saved registers hold stack values and temporaries.
+ */
+#define WORK_PTR RBX
+#define RET_PTR RBP
+#define WORK_DATA R12
+#define RET_DATA R15
+#define UXN_REG R13
+#define RAM_REG R14
+
+static const int value_regs[] = {RAX, RCX, RDX, RSI, RDI, R8, R9, R10, R11};
+#define VALUE_REGS (sizeof(value_regs) / sizeof(value_regs[0]))
+
+// Operand size and REX flags for emit_modrm
+enum {
+  REX_W = 1,
+  BYTE_REGS = 2, ///< Byte registers, always emit REX so 4-7 mean spl..dil
+  OPSIZE = 4,    ///< 16 bit operand
+};
+
+// ALU opcode extensions (`81 /digit`), the register forms are `digit << 3 | 1`
+enum { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+
+// Condition codes for SETcc and Jcc
+enum { CC_B = 0x2, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7 };
+
+typedef struct Operand {
+  bool memory;
+  int reg;   ///< Register when not memory
+  int base;  ///< Memory base
+  int index; ///< Memory index or NO_REG
+  int32_t disp;
+} Operand;
+
+static Operand reg_operand(int reg) {
+  return (Operand){.memory = false, .reg = reg};
+}
+
+static Operand mem_operand(int base, int index, int32_t disp) {
+  return (Operand){.memory = true, .base = base, .index = index, .disp = disp};
+}
+
+// Compiler state
+
+typedef enum SlotKind {
+  SLOT_MEMORY, ///< Only in memory
+  SLOT_CONST,  ///< Known at compile time
+  SLOT_BYTE,   ///< Register holds the byte
+  SLOT_HIGH,   ///< Register holds a short, this is its high byte
+  SLOT_LOW,    ///< Register holds a short, this is its low byte
+} SlotKind;
+
+typedef struct Slot {
+  Byte kind;
+  Byte reg;
+  Byte value;
+} Slot;
+
+typedef enum ValueKind { VALUE_CONST, VALUE_REG } ValueKind;
+
+/**
+ * An instruction operand or result. Registers always hold the exact, zero
+ * extended byte or short.
+ */
+typedef struct Value {
+  ValueKind kind;
+  int reg;
+  Short value;
+} Value;
+
+static Value const_value(Short value) {
+  return (Value){.kind = VALUE_CONST, .value = value};
+}
+
+static Value reg_value(int reg) { return (Value){.kind = VALUE_REG, .reg = reg}; }
+
+typedef struct Target {
+  bool dynamic; ///< Known only at run time, in reg
+  int reg;
+  Short pc;
+} Target;
+
+typedef enum Result { COMPILED, BLOCK_END, STOP } Result;
+
+/**
+ * Stack slots are numbered relative to the stack pointers the block (or the
+ * current loop iteration) was entered with. Every push is written through to
+ * the stack, so a slot cached in a register can be forgotten at any time.
+ */
+typedef struct Compiler {
+  Jit *jit;
+  Uxn *uxn;
+  Byte *code;
+  size_t pos;
+
+  Short start;
+  Short pc;
+  Short end; ///< One past the last byte read
+  size_t header;
+  int ops;
+
+  int delta[2];
+  int min_slot[2];
+  int max_slot[2];
+  bool slot_overflow;
+  Slot slots[2][256];
+
+  int refs[16];
+  int locks[16];
+  uint32_t last_use[16];
+  uint32_t clock;
+
+  bool unsupported; ///< STOP because the instruction can't be compiled
+} Compiler;
+
+static void emit8(Compiler *c, Byte byte) {
+  c->code[c->pos++] = byte;
+}
+
+static void emit32(Compiler *c, uint32_t value) {
+  memcpy(&c->code[c->pos], &value, 4);
+  c->pos += 4;
+}
+
+static void emit64(Compiler *c, uint64_t value) {
+  memcpy(&c->code[c->pos], &value, 8);
+  c->pos += 8;
+}
+
+static void patch32(Compiler *c, size_t at, uint32_t value) {
+  memcpy(&c->code[at], &value, 4);
+}
+
+/**
+ * Emits an instruction with a ModRM operand. Opcodes above 0xff are two bytes
+ * (0x0f escaped). Memory operands always use a SIB byte.
+ */
+static void emit_modrm(Compiler *c, unsigned flags, unsigned opcode, int reg,
+                       Operand rm) {
+  if (flags & OPSIZE)
+    emit8(c, 0x66);
+
+  Byte rex = 0;
+  if (flags & REX_W)
+    rex |= 8;
+  if (reg & 8)
+    rex |= 4;
+  if (rm.memory) {
+    if (rm.index != NO_REG && (rm.index & 8))
+      rex |= 2;
+    if (rm.base & 8)
+      rex |= 1;
+  } else if (rm.reg & 8) {
+    rex |= 1;
+  }
+  if (rex || (flags & BYTE_REGS))
+    emit8(c, 0x40 | rex);
+
+  if (opcode > 0xff)
+    emit8(c, opcode >> 8);
+  emit8(c, opcode & 0xff);
+
+  if (!rm.memory) {
+    emit8(c, 0xc0 | (reg & 7) << 3 | (rm.reg & 7));
+    return;
+  }
+
+  int mod = rm.disp == 0 && (rm.base & 7) != RBP ? 0
+            : rm.disp >= -128 && rm.disp <= 127  ? 1
+                                                 : 2;
+  int index = rm.index == NO_REG ? RSP : rm.index;
+  emit8(c, mod << 6 | (reg & 7) << 3 | RSP);
+  emit8(c, (index & 7) << 3 | (rm.base & 7));
+  if (mod == 1) {
+    emit8(c, (Byte)rm.disp);
+  } else if (mod == 2) {
+    emit32(c, rm.disp);
+  }
+}
+
+static void emit_mov_imm(Compiler *c, int reg, uint32_t imm) {
+  if (reg & 8)
+    emit8(c, 0x41);
+  emit8(c, 0xb8 | (reg & 7));
+  emit32(c, imm);
+}
+
+static void emit_mov(Compiler *c, int dst, int src) {
+  if (dst != src)
+    emit_modrm(c, 0, 0x89, src, reg_operand(dst));
+}
+
+// dst op= src
+static void emit_alu(Compiler *c, int digit, int dst, int src) {
+  emit_modrm(c, 0, digit << 3 | 1, src, reg_operand(dst));
+}
+
+static void emit_alu_imm(Compiler *c, int digit, Operand dst, int32_t imm,
+                         unsigned flags) {
+  if (imm >= -128 && imm <= 127) {
+    emit_modrm(c, flags, 0x83, digit, dst);
+    emit8(c, (Byte)imm);
+  } else {
+    emit_modrm(c, flags, 0x81, digit, dst);
+    emit32(c, imm);
+  }
+}
+
+static void emit_shift(Compiler *c, int digit, int reg, Byte count,
+                       unsigned flags) {
+  emit_modrm(c, flags, 0xc1, digit, reg_operand(reg));
+  emit8(c, count);
+}
+
+#define SHIFT_ROL 0
+#define SHIFT_SHL 4
+#define SHIFT_SHR 5
+
+static void emit_zero_extend(Compiler *c, int reg, bool short_mode) {
+  if (short_mode) {
+    emit_modrm(c, 0, 0x0fb7, reg, reg_operand(reg));
+  } else {
+    emit_modrm(c, BYTE_REGS, 0x0fb6, reg, reg_operand(reg));
+  }
+}
+
+// Returns the position of the rel32 to patch
+static size_t emit_jcc(Compiler *c, int cc) {
+  emit8(c, 0x0f);
+  emit8(c, 0x80 | cc);
+  emit32(c, 0);
+  return c->pos - 4;
+}
+
+static size_t emit_jmp(Compiler *c) {
+  emit8(c, 0xe9);
+  emit32(c, 0);
+  return c->pos - 4;
+}
+
+static void patch_jump(Compiler *c, size_t at, size_t to) {
+  patch32(c, at, (uint32_t)(to - (at + 4)));
+}
+
+static void emit_prologue(Compiler *c) {
+  static const int saved[] = {RBX, RBP, R12, R13, R14, R15};
+  for (size_t i = 0; i < 6; i++) {
+    if (saved[i] & 8)
+      emit8(c, 0x41);
+    emit8(c, 0x50 | (saved[i] & 7));
+  }
+  // Keep the stack aligned for the store helpers
+  emit_alu_imm(c, ALU_SUB, reg_operand(RSP), 8, REX_W);
+
+  emit_modrm(c, REX_W, 0x89, RDI, reg_operand(UXN_REG));
+  emit_modrm(c, REX_W, 0x8d, WORK_DATA,
+             mem_operand(UXN_REG, NO_REG, offsetof(Uxn, work.data)));
+  emit_modrm(c, REX_W, 0x8d, RET_DATA,
+             mem_operand(UXN_REG, NO_REG, offsetof(Uxn, ret.data)));
+  emit_modrm(c, REX_W, 0x8d, RAM_REG,
+             mem_operand(UXN_REG, NO_REG, offsetof(Uxn, ram)));
+  emit_modrm(c, 0, 0x0fb6, WORK_PTR,
+             mem_operand(UXN_REG, NO_REG, offsetof(Uxn, work.ptr)));
+  emit_modrm(c, 0, 0x0fb6, RET_PTR,
+             mem_operand(UXN_REG, NO_REG, offsetof(Uxn, ret.ptr)));
+}
+
+static void emit_epilogue(Compiler *c) {
+  static const int saved[] = {R15, R14, R13, R12, RBP, RBX};
+  emit_alu_imm(c, ALU_ADD, reg_operand(RSP), 8, REX_W);
+  for (size_t i = 0; i < 6; i++) {
+    if (saved[i] & 8)
+      emit8(c, 0x41);
+    emit8(c, 0x58 | (saved[i] & 7));
+  }
+  emit8(c, 0xc3);
+}
+
+static void emit_store_ptrs(Compiler *c) {
+  emit_modrm(c, BYTE_REGS, 0x88, WORK_PTR,
+             mem_operand(UXN_REG, NO_REG, offsetof(Uxn, work.ptr)));
+  emit_modrm(c, BYTE_REGS, 0x88, RET_PTR,
+             mem_operand(UXN_REG, NO_REG, offsetof(Uxn, ret.ptr)));
+}
+
+static void emit_count(Compiler *c) {
+#ifdef UXN_STATS
+  emit_alu_imm(c, ALU_ADD,
+               mem_operand(UXN_REG, NO_REG, offsetof(Uxn, instructions)),
+               c->ops, REX_W);
+  emit_alu_imm(c, ALU_ADD,
+               mem_operand(UXN_REG, NO_REG, offsetof(Uxn, dispatches)), 1,
+               REX_W);
+#else
+  (void)c;
+#endif
+}
+
+// Register cache
+
+static Operand slot_operand(int stack, int slot) {
+  return stack ? mem_operand(RET_DATA, RET_PTR, slot)
+               : mem_operand(WORK_DATA, WORK_PTR, slot);
+}
+
+static void touch_slot(Compiler *c, int stack, int slot) {
+  if (slot < c->min_slot[stack])
+    c->min_slot[stack] = slot;
+  if (slot > c->max_slot[stack])
+    c->max_slot[stack] = slot;
+  if (c->max_slot[stack] - c->min_slot[stack] >= MAX_SLOT_SPAN)
+    c->slot_overflow = true;
+}
+
+static Slot *slot_at(Compiler *c, int stack, int slot) {
+  touch_slot(c, stack, slot);
+  return &c->slots[stack][(Byte)slot];
+}
+
+static bool slot_has_reg(Slot *slot) {
+  return slot->kind >= SLOT_BYTE;
+}
+
+static void bind_slot(Compiler *c, Slot *slot, SlotKind kind, int reg,
+                      Byte value) {
+  if (slot_has_reg(slot))
+    c->refs[slot->reg]--;
+  *slot = (Slot){.kind = kind, .reg = reg, .value = value};
+  if (slot_has_reg(slot))
+    c->refs[reg]++;
+}
+
+static void lock_reg(Compiler *c, int reg) {
+  c->locks[reg]++;
+  c->last_use[reg] = ++c->clock;
+}
+
+static void unlock_reg(Compiler *c, int reg) { c->locks[reg]--; }
+
+static void unlock_value(Compiler *c, Value v) {
+  if (v.kind == VALUE_REG)
+    unlock_reg(c, v.reg);
+}
+
+static void forget_reg(Compiler *c, int reg) {
+  for (int stack = 0; stack < 2; stack++) {
+    for (int i = c->min_slot[stack]; i <= c->max_slot[stack]; i++) {
+      Slot *slot = &c->slots[stack][(Byte)i];
+      if (slot_has_reg(slot) && slot->reg == reg)
+        bind_slot(c, slot, SLOT_MEMORY, 0, 0);
+    }
+  }
+}
+
+static void forget_regs(Compiler *c) {
+  for (size_t i = 0; i < VALUE_REGS; i++) {
+    forget_reg(c, value_regs[i]);
+  }
+}
+
+// Forget the slots at and above the stack pointers, they are never read
+// before being pushed again
+static void forget_popped(Compiler *c) {
+  for (int stack = 0; stack < 2; stack++) {
+    for (int i = c->delta[stack]; i <= c->max_slot[stack]; i++) {
+      bind_slot(c, &c->slots[stack][(Byte)i], SLOT_MEMORY, 0, 0);
+    }
+  }
+}
+
+/**
+ * Returns a locked register that no slot refers to, evicting the least
+ * recently used one if needed, or NO_REG when every register is locked.
+ */
+static int alloc_reg(Compiler *c) {
+  int best = NO_REG;
+  for (size_t i = 0; i < VALUE_REGS; i++) {
+    int reg = value_regs[i];
+    if (c->locks[reg])
+      continue;
+    if (best == NO_REG || (c->refs[reg] == 0 && c->refs[best] != 0) ||
+        ((c->refs[reg] == 0) == (c->refs[best] == 0) &&
+         c->last_use[reg] < c->last_use[best])) {
+      best = reg;
+    }
+  }
+  if (best == NO_REG)
+    return NO_REG;
+
+  if (c->refs[best])
+    forget_reg(c, best);
+  lock_reg(c, best);
+  return best;
+}
+
+// The compiler gives up on the instruction when it runs out of registers,
+// which can't happen with the register counts used here
+#define ALLOC_REG(c, reg)                                                      \
+  int reg = alloc_reg(c);                                                      \
+  if (reg == NO_REG)                                                           \
+    return false;
+
+static bool load_value(Compiler *c, int dst, Value v) {
+  if (v.kind == VALUE_CONST) {
+    emit_mov_imm(c, dst, v.value);
+  } else {
+    emit_mov(c, dst, v.reg);
+  }
+  return true;
+}
+
+static bool read_byte(Compiler *c, int stack, int slot_index, Value *out) {
+  Slot *slot = slot_at(c, stack, slot_index);
+
+  switch (slot->kind) {
+  case SLOT_CONST:
+    *out = const_value(slot->value);
+    return true;
+  case SLOT_BYTE:
+    lock_reg(c, slot->reg);
+    *out = reg_value(slot->reg);
+    return true;
+  }
+
+  ALLOC_REG(c, reg);
+  switch (slot->kind) {
+  case SLOT_LOW:
+    emit_modrm(c, BYTE_REGS, 0x0fb6, reg, reg_operand(slot->reg));
+    break;
+  case SLOT_HIGH:
+    emit_mov(c, reg, slot->reg);
+    emit_shift(c, SHIFT_SHR, reg, 8, 0);
+    break;
+  default:
+    emit_modrm(c, 0, 0x0fb6, reg, slot_operand(stack, slot_index));
+    break;
+  }
+  bind_slot(c, slot, SLOT_BYTE, reg, 0);
+  *out = reg_value(reg);
+  return true;
+}
+
+static bool read_short(Compiler *c, int stack, int slot_index, Value *out) {
+  Slot *high = slot_at(c, stack, slot_index);
+  Slot *low = slot_at(c, stack, slot_index + 1);
+
+  if (high->kind == SLOT_HIGH && low->kind == SLOT_LOW &&
+      high->reg == low->reg) {
+    lock_reg(c, high->reg);
+    *out = reg_value(high->reg);
+    return true;
+  }
+  if (high->kind == SLOT_CONST && low->kind == SLOT_CONST) {
+    *out = const_value(high->value << 8 | low->value);
+    return true;
+  }
+
+  if (high->kind == SLOT_MEMORY && low->kind == SLOT_MEMORY) {
+    ALLOC_REG(c, reg);
+    emit_modrm(c, 0, 0x0fb7, reg, slot_operand(stack, slot_index));
+    emit_shift(c, SHIFT_ROL, reg, 8, OPSIZE);
+    bind_slot(c, high, SLOT_HIGH, reg, 0);
+    bind_slot(c, low, SLOT_LOW, reg, 0);
+    *out = reg_value(reg);
+    return true;
+  }
+
+  Value h, l;
+  if (!read_byte(c, stack, slot_index, &h) ||
+      !read_byte(c, stack, slot_index + 1, &l))
+    return false;
+
+  ALLOC_REG(c, reg);
+  if (h.kind == VALUE_CONST) {
+    emit_mov_imm(c, reg, h.value << 8);
+  } else {
+    emit_mov(c, reg, h.reg);
+    emit_shift(c, SHIFT_SHL, reg, 8, 0);
+  }
+  if (l.kind == VALUE_CONST) {
+    if (l.value)
+      emit_alu_imm(c, ALU_OR, reg_operand(reg), l.value, 0);
+  } else {
+    emit_alu(c, ALU_OR, reg, l.reg);
+  }
+  unlock_value(c, h);
+  unlock_value(c, l);
+
+  bind_slot(c, high, SLOT_HIGH, reg, 0);
+  bind_slot(c, low, SLOT_LOW, reg, 0);
+  *out = reg_value(reg);
+  return true;
+}
+
+static bool push_byte(Compiler *c, int stack, Value v) {
+  int slot_index = c->delta[stack]++;
+  Slot *slot = slot_at(c, stack, slot_index);
+
+  if (v.kind == VALUE_CONST) {
+    emit_modrm(c, 0, 0xc6, 0, slot_operand(stack, slot_index));
+    emit8(c, (Byte)v.value);
+    bind_slot(c, slot, SLOT_CONST, 0, v.value);
+  } else {
+    emit_modrm(c, BYTE_REGS, 0x88, v.reg, slot_operand(stack, slot_index));
+    bind_slot(c, slot, SLOT_BYTE, v.reg, 0);
+  }
+  return true;
+}
+
+static bool push_short(Compiler *c, int stack, Value v) {
+  int slot_index = c->delta[stack];
+  c->delta[stack] += 2;
+  Slot *high = slot_at(c, stack, slot_index);
+  Slot *low = slot_at(c, stack, slot_index + 1);
+
+  if (v.kind == VALUE_CONST) {
+    // Stacks are big endian
+    emit_modrm(c, OPSIZE, 0xc7, 0, slot_operand(stack, slot_index));
+    emit8(c, v.value >> 8);
+    emit8(c, v.value & 0xff);
+    bind_slot(c, high, SLOT_CONST, 0, v.value >> 8);
+    bind_slot(c, low, SLOT_CONST, 0, v.value & 0xff);
+    return true;
+  }
+
+  ALLOC_REG(c, tmp);
+  emit_mov(c, tmp, v.reg);
+  emit_shift(c, SHIFT_ROL, tmp, 8, OPSIZE);
+  emit_modrm(c, OPSIZE, 0x89, tmp, slot_operand(stack, slot_index));
+  unlock_reg(c, tmp);
+
+  bind_slot(c, high, SLOT_HIGH, v.reg, 0);
+  bind_slot(c, low, SLOT_LOW, v.reg, 0);
+  return true;
+}
+
+static bool push_value(Compiler *c, int stack, Value v, bool short_mode) {
+  return short_mode ? push_short(c, stack, v) : push_byte(c, stack, v);
+}
+
+/**
+ * Pops read their operands below a cursor, the stack pointer itself only
+ * moves once all operands are read so that keep mode can leave it alone.
+ */
+typedef struct Pops {
+  int stack;
+  int cursor;
+} Pops;
+
+static Pops start_pops(Compiler *c, int stack) {
+  return (Pops){.stack = stack, .cursor = c->delta[stack]};
+}
+
+static bool pop_byte(Compiler *c, Pops *p, Value *out) {
+  p->cursor--;
+  return read_byte(c, p->stack, p->cursor, out);
+}
+
+static bool pop_value(Compiler *c, Pops *p, bool short_mode, Value *out) {
+  if (!short_mode)
+    return pop_byte(c, p, out);
+  p->cursor -= 2;
+  return read_short(c, p->stack, p->cursor, out);
+}
+
+static void skip_value(Pops *p, bool short_mode) {
+  p->cursor -= short_mode ? 2 : 1;
+}
+
+static void end_pops(Compiler *c, Pops *p, bool keep_mode) {
+  if (!keep_mode)
+    c->delta[p->stack] = p->cursor;
+}
+
+// Arithmetic
+
+static Short fold(int digit, Short a, Short b) {
+  switch (digit) {
+  case ALU_ADD:
+    return a + b;
+  case ALU_SUB:
+    return a - b;
+  case ALU_AND:
+    return a & b;
+  case ALU_OR:
+    return a | b;
+  case ALU_XOR:
+    return a ^ b;
+  }
+  return a * b;
+}
+
+#define ALU_MUL -1
+
+static bool emit_arith(Compiler *c, int digit, Value a, Value b,
+                       bool short_mode, Value *out) {
+  if (a.kind == VALUE_CONST && b.kind == VALUE_CONST) {
+    Short result = fold(digit, a.value, b.value);
+    *out = const_value(short_mode ? result : (Byte)result);
+    return true;
+  }
+
+  ALLOC_REG(c, reg);
+  load_value(c, reg, a);
+  if (digit == ALU_MUL) {
+    if (b.kind == VALUE_CONST) {
+      emit_modrm(c, 0, 0x69, reg, reg_operand(reg));
+      emit32(c, b.value);
+    } else {
+      emit_modrm(c, 0, 0x0faf, reg, reg_operand(b.reg));
+    }
+  } else if (b.kind == VALUE_CONST) {
+    emit_alu_imm(c, digit, reg_operand(reg), b.value, 0);
+  } else {
+    emit_alu(c, digit, reg, b.reg);
+  }
+
+  // Bitwise results of zero extended operands need no masking
+  if (digit == ALU_ADD || digit == ALU_SUB || digit == ALU_MUL)
+    emit_zero_extend(c, reg, short_mode);
+
+  *out = reg_value(reg);
+  return true;
+}
+
+static int swap_condition(int cc) {
+  return cc == CC_A ? CC_B : cc == CC_B ? CC_A : cc;
+}
+
+static bool emit_compare(Compiler *c, int cc, Value a, Value b, Value *out) {
+  if (a.kind == VALUE_CONST && b.kind == VALUE_CONST) {
+    bool result = cc == CC_E    ? a.value == b.value
+                  : cc == CC_NE ? a.value != b.value
+                  : cc == CC_A  ? a.value > b.value
+                                : a.value < b.value;
+    *out = const_value(result);
+    return true;
+  }
+
+  ALLOC_REG(c, reg);
+  // Cleared before the compare, SETcc only writes the low byte
+  emit_alu(c, ALU_XOR, reg, reg);
+  if (a.kind == VALUE_CONST) {
+    emit_alu_imm(c, ALU_CMP, reg_operand(b.reg), a.value, 0);
+    cc = swap_condition(cc);
+  } else if (b.kind == VALUE_CONST) {
+    emit_alu_imm(c, ALU_CMP, reg_operand(a.reg), b.value, 0);
+  } else {
+    emit_alu(c, ALU_CMP, a.reg, b.reg);
+  }
+  emit_modrm(c, BYTE_REGS, 0x0f90 | cc, 0, reg_operand(reg));
+
+  *out = reg_value(reg);
+  return true;
+}
+
+static bool emit_shift_value(Compiler *c, Value a, Byte shift,
+                             bool short_mode, Value *out) {
+  Byte right = low_nibble(shift), left = high_nibble(shift);
+
+  if (a.kind == VALUE_CONST) {
+    Short result = (a.value >> right) << left;
+    *out = const_value(short_mode ? result : (Byte)result);
+    return true;
+  }
+
+  ALLOC_REG(c, reg);
+  emit_mov(c, reg, a.reg);
+  if (right)
+    emit_shift(c, SHIFT_SHR, reg, right, 0);
+  if (left) {
+    emit_shift(c, SHIFT_SHL, reg, left, 0);
+    emit_zero_extend(c, reg, short_mode);
+  }
+
+  *out = reg_value(reg);
+  return true;
+}
+
+// Memory
+
+static Operand ram_operand(Value addr, int offset) {
+  return addr.kind == VALUE_CONST
+             ? mem_operand(RAM_REG, NO_REG, addr.value + offset)
+             : mem_operand(RAM_REG, addr.reg, offset);
+}
+
+static bool emit_load_byte(Compiler *c, Value addr, Value *out) {
+  ALLOC_REG(c, reg);
+  emit_modrm(c, 0, 0x0fb6, reg, ram_operand(addr, 0));
+  *out = reg_value(reg);
+  return true;
+}
+
+/**
+ * Loads a big endian short. The second byte wraps around to the start of the
+ * zero page or of RAM like uxn_zero_page_read_short and uxn_mem_read_short.
+ */
+static bool emit_load_short(Compiler *c, Value addr, bool zero_page,
+                            Value *out) {
+  Short last = zero_page ? 0xff : 0xffff;
+
+  if (addr.kind == VALUE_CONST && addr.value != last) {
+    ALLOC_REG(c, reg);
+    emit_modrm(c, 0, 0x0fb7, reg, ram_operand(addr, 0));
+    emit_shift(c, SHIFT_ROL, reg, 8, OPSIZE);
+    *out = reg_value(reg);
+    return true;
+  }
+
+  ALLOC_REG(c, reg);
+  ALLOC_REG(c, low);
+  if (addr.kind == VALUE_CONST) {
+    emit_modrm(c, 0, 0x0fb6, low, mem_operand(RAM_REG, NO_REG, 0));
+  } else {
+    emit_modrm(c, REX_W, 0x8d, low, mem_operand(addr.reg, NO_REG, 1));
+    emit_zero_extend(c, low, !zero_page);
+    emit_modrm(c, 0, 0x0fb6, low, mem_operand(RAM_REG, low, 0));
+  }
+  emit_modrm(c, 0, 0x0fb6, reg, ram_operand(addr, 0));
+  emit_shift(c, SHIFT_SHL, reg, 8, 0);
+  emit_alu(c, ALU_OR, reg, low);
+  unlock_reg(c, low);
+
+  *out = reg_value(reg);
+  return true;
+}
+
+typedef uint32_t (*StoreHelper)(Uxn *uxn, uint32_t addr, uint32_t value);
+
+static void emit_exit(Compiler *c, Target target, uint32_t flags);
+
+/**
+ * Calls a store helper and exits the block to `next` if the store overwrote
+ * compiled code. The helper clobbers every value register.
+ */
+static void emit_store(Compiler *c, StoreHelper helper, Value addr,
+                       Value value, Short next) {
+  // Move the operands into esi/edx without clobbering each other
+  if (value.kind == VALUE_REG && value.reg == RSI) {
+    if (addr.kind == VALUE_REG && addr.reg == RDX) {
+      emit_modrm(c, 0, 0x87, RSI, reg_operand(RDX));
+    } else {
+      emit_mov(c, RDX, RSI);
+      load_value(c, RSI, addr);
+    }
+  } else {
+    load_value(c, RSI, addr);
+    load_value(c, RDX, value);
+  }
+
+  emit_modrm(c, REX_W, 0x89, UXN_REG, reg_operand(RDI));
+  emit8(c, 0x48);
+  emit8(c, 0xb8);
+  emit64(c, (uint64_t)(uintptr_t)helper);
+  emit_modrm(c, 0, 0xff, 2, reg_operand(RAX));
+  forget_regs(c);
+
+  emit_modrm(c, 0, 0x85, RAX, reg_operand(RAX));
+  size_t skip = emit_jcc(c, CC_E);
+  emit_exit(c, (Target){.pc = next}, 0);
+  patch_jump(c, skip, c->pos);
+}
+
+// Control flow
+
+static void emit_exit(Compiler *c, Target target, uint32_t flags) {
+  if (c->delta[0])
+    emit_alu_imm(c, ALU_ADD, reg_operand(WORK_PTR), c->delta[0], 0);
+  if (c->delta[1])
+    emit_alu_imm(c, ALU_ADD, reg_operand(RET_PTR), c->delta[1], 0);
+  emit_store_ptrs(c);
+  emit_count(c);
+
+  if (target.dynamic) {
+    emit_mov(c, RAX, target.reg);
+  } else {
+    emit_mov_imm(c, RAX, target.pc | flags);
+  }
+  emit_epilogue(c);
+}
+
+// Jumps back to the start of the block stay in native code
+static void emit_branch(Compiler *c, Target target) {
+  if (target.dynamic || target.pc != c->start) {
+    emit_exit(c, target, 0);
+    return;
+  }
+
+  if (c->delta[0]) {
+    emit_alu_imm(c, ALU_ADD, reg_operand(WORK_PTR), c->delta[0], 0);
+    emit_zero_extend(c, WORK_PTR, false);
+  }
+  if (c->delta[1]) {
+    emit_alu_imm(c, ALU_ADD, reg_operand(RET_PTR), c->delta[1], 0);
+    emit_zero_extend(c, RET_PTR, false);
+  }
+  emit_count(c);
+  patch_jump(c, emit_jmp(c), c->header);
+}
+
+static void emit_conditional(Compiler *c, Value cond, Target taken,
+                             Short fallthrough) {
+  if (cond.kind == VALUE_CONST) {
+    emit_branch(c, cond.value ? taken : (Target){.pc = fallthrough});
+    return;
+  }
+
+  emit_modrm(c, 0, 0x85, cond.reg, reg_operand(cond.reg));
+
+#ifndef UXN_STATS
+  // Tight loops branch straight back to the header
+  if (!taken.dynamic && taken.pc == c->start && !c->delta[0] &&
+      !c->delta[1]) {
+    patch_jump(c, emit_jcc(c, CC_NE), c->header);
+    emit_exit(c, (Target){.pc = fallthrough}, 0);
+    return;
+  }
+#endif
+
+  size_t not_taken = emit_jcc(c, CC_E);
+  emit_branch(c, taken);
+  patch_jump(c, not_taken, c->pos);
+  emit_exit(c, (Target){.pc = fallthrough}, 0);
+}
+
+static Short read_code_short(Compiler *c, Short addr) {
+  return uxn_mem_read_short(c->uxn, addr);
+}
+
+static Target static_target(Short pc) { return (Target){.pc = pc}; }
+
+// Jump target from the stack: absolute in short mode, otherwise relative to
+// the next instruction and only known when it's a constant
+static bool pop_target(Compiler *c, Pops *p, bool short_mode, Short next,
+                       Target *out) {
+  Value v;
+  if (!pop_value(c, p, short_mode, &v))
+    return false;
+
+  if (v.kind == VALUE_CONST) {
+    *out = static_target(short_mode ? v.value
+                                    : (Short)(next + (SignedByte)v.value));
+  } else if (short_mode) {
+    *out = (Target){.dynamic = true, .reg = v.reg};
+  } else {
+    c->unsupported = true;
+    return false;
+  }
+  return true;
+}
+
+// Relative offset for LDR/STR, only compiled when it's a constant
+static bool pop_relative(Compiler *c, Pops *p, Short next, Short *out) {
+  Value v;
+  if (!pop_byte(c, p, &v))
+    return false;
+  if (v.kind != VALUE_CONST) {
+    c->unsupported = true;
+    return false;
+  }
+  *out = next + (SignedByte)v.value;
+  return true;
+}
+
+/**
+ * Compiles the instruction at c->pc. Returns STOP without having changed
+ * anything worth keeping when it can't, the caller rolls the compiler back.
+ */
+static Result compile_op(Compiler *c) {
+  Short pc = c->pc;
+  Byte op = uxn_mem_read(c->uxn, pc);
+  Short next = pc + 1;
+
+  bool k = op & 0x80, r = op & 0x40, s = op & 0x20;
+  int stack = r ? 1 : 0;
+  Pops p = start_pops(c, stack);
+  Value a, b, v;
+  Target target;
+  Short addr;
+
+  // Immediate instructions
+  if ((op & 0x1f) == 0) {
+    switch (op) {
+    case 0x00: // BRK
+      return STOP;
+    case 0x20: { // JCI
+      Pops w = start_pops(c, 0);
+      if (!pop_byte(c, &w, &v))
+        return STOP;
+      end_pops(c, &w, false);
+      c->end = pc + 3;
+      target = static_target(pc + 3 + read_code_short(c, pc + 1));
+      emit_conditional(c, v, target, pc + 3);
+      return BLOCK_END;
+    }
+    case 0x40: // JMI
+      c->end = pc + 3;
+      emit_branch(c, static_target(pc + 3 + read_code_short(c, pc + 1)));
+      return BLOCK_END;
+    case 0x60: // JSI
+      if (!push_short(c, 1, const_value(pc + 3)))
+        return STOP;
+      c->end = pc + 3;
+      emit_branch(c, static_target(pc + 3 + read_code_short(c, pc + 1)));
+      return BLOCK_END;
+    default: // LIT
+      if (s) {
+        if (!push_short(c, stack, const_value(read_code_short(c, next))))
+          return STOP;
+        c->pc = next + 2;
+      } else {
+        if (!push_byte(c, stack, const_value(uxn_mem_read(c->uxn, next))))
+          return STOP;
+        c->pc = next + 1;
+      }
+      return COMPILED;
+    }
+  }
+
+  switch (op & 0x1f) {
+  case 0x01: // INC
+    if (!pop_value(c, &p, s, &a) ||
+        !emit_arith(c, ALU_ADD, a, const_value(1), s, &v))
+      return STOP;
+    end_pops(c, &p, k);
+    if (!push_value(c, stack, v, s))
+      return STOP;
+    break;
+  case 0x02: // POP
+    skip_value(&p, s);
+    end_pops(c, &p, k);
+    break;
+  case 0x03: // NIP
+    if (!pop_value(c, &p, s, &b))
+      return STOP;
+    skip_value(&p, s);
+    end_pops(c, &p, k);
+    if (!push_value(c, stack, b, s))
+      return STOP;
+    break;
+  case 0x04: // SWP
+    if (!pop_value(c, &p, s, &b) || !pop_value(c, &p, s, &a))
+      return STOP;
+    end_pops(c, &p, k);
+    if (!push_value(c, stack, b, s) || !push_value(c, stack, a, s))
+      return STOP;
+    break;
+  case 0x05: { // ROT
+    Value cv;
+    if (!pop_value(c, &p, s, &cv) || !pop_value(c, &p, s, &b) ||
+        !pop_value(c, &p, s, &a))
+      return STOP;
+    end_pops(c, &p, k);
+    if (!push_value(c, stack, b, s) || !push_value(c, stack, cv, s) ||
+        !push_value(c, stack, a, s))
+      return STOP;
+    break;
+  }
+  case 0x06: // DUP
+    if (!pop_value(c, &p, s, &a))
+      return STOP;
+    end_pops(c, &p, k);
+    if (!push_value(c, stack, a, s) || !push_value(c, stack, a, s))
+      return STOP;
+    break;
+  case 0x07: // OVR
+    if (!pop_value(c, &p, s, &b) || !pop_value(c, &p, s, &a))
+      return STOP;
+    end_pops(c, &p, k);
+    if (!push_value(c, stack, a, s) || !push_value(c, stack, b, s) ||
+        !push_value(c, stack, a, s))
+      return STOP;
+    break;
+  case 0x08: // EQU
+  case 0x09: // NEQ
+  case 0x0a: // GTH
+  case 0x0b: { // LTH
+    static const int conditions[] = {CC_E, CC_NE, CC_A, CC_B};
+    if (!pop_value(c, &p, s, &b) || !pop_value(c, &p, s, &a) ||
+        !emit_compare(c, conditions[op & 0x03], a, b, &v))
+      return STOP;
+    end_pops(c, &p, k);
+    if (!push_byte(c, stack, v))
+      return STOP;
+    break;
+  }
+  case 0x0c: // JMP
+    if (!pop_target(c, &p, s, next, &target))
+      return STOP;
+    end_pops(c, &p, k);
+    c->end = next;
+    emit_branch(c, target);
+    return BLOCK_END;
+  case 0x0d: // JCN
+    if (!pop_target(c, &p, s, next, &target) || !pop_byte(c, &p, &v))
+      return STOP;
+    end_pops(c, &p, k);
+    c->end = next;
+    emit_conditional(c, v, target, next);
+    return BLOCK_END;
+  case 0x0e: // JSR
+    if (!push_short(c, !stack, const_value(next)) ||
+        !pop_target(c, &p, s, next, &target))
+      return STOP;
+    end_pops(c, &p, k);
+    c->end = next;
+    emit_branch(c, target);
+    return BLOCK_END;
+  case 0x0f: // STH
+    if (!pop_value(c, &p, s, &a))
+      return STOP;
+    end_pops(c, &p, k);
+    if (!push_value(c, !stack, a, s))
+      return STOP;
+    break;
+  case 0x10: // LDZ
+    if (!pop_byte(c, &p, &a) ||
+        !(s ? emit_load_short(c, a, true, &v) : emit_load_byte(c, a, &v)))
+      return STOP;
+    end_pops(c, &p, k);
+    if (!push_value(c, stack, v, s))
+      return STOP;
+    break;
+  case 0x11: // STZ
+    if (!pop_byte(c, &p, &a) || !pop_value(c, &p, s, &v))
+      return STOP;
+    end_pops(c, &p, k);
+    emit_store(c, s ? store_zero_page_short : store_zero_page, a, v, next);
+    c->pc = next;
+    return COMPILED;
+  case 0x12: // LDR
+    if (!pop_relative(c, &p, next, &addr))
+      return STOP;
+    a = const_value(addr);
+    if (!(s ? emit_load_short(c, a, false, &v) : emit_load_byte(c, a, &v)))
+      return STOP;
+    end_pops(c, &p, k);
+    if (!push_value(c, stack, v, s))
+      return STOP;
+    break;
+  case 0x13: // STR
+    if (!pop_relative(c, &p, next, &addr) || !pop_value(c, &p, s, &v))
+      return STOP;
+    end_pops(c, &p, k);
+    emit_store(c, s ? store_short : store, const_value(addr), v, next);
+    c->pc = next;
+    return COMPILED;
+  case 0x14: // LDA
+    if (!pop_value(c, &p, true, &a) ||
+        !(s ? emit_load_short(c, a, false, &v) : emit_load_byte(c, a, &v)))
+      return STOP;
+    end_pops(c, &p, k);
+    if (!push_value(c, stack, v, s))
+      return STOP;
+    break;
+  case 0x15: // STA
+    if (!pop_value(c, &p, true, &a) || !pop_value(c, &p, s, &v))
+      return STOP;
+    end_pops(c, &p, k);
+    emit_store(c, s ? store_short : store, a, v, next);
+    c->pc = next;
+    return COMPILED;
+  case 0x18: // ADD
+  case 0x19: // SUB
+  case 0x1a: // MUL
+  case 0x1c: // AND
+  case 0x1d: // ORA
+  case 0x1e: { // EOR
+    static const int digits[] = {[0x18] = ALU_ADD, [0x19] = ALU_SUB,
+                                 [0x1a] = ALU_MUL, [0x1c] = ALU_AND,
+                                 [0x1d] = ALU_OR,  [0x1e] = ALU_XOR};
+    if (!pop_value(c, &p, s, &b) || !pop_value(c, &p, s, &a) ||
+        !emit_arith(c, digits[op & 0x1f], a, b, s, &v))
+      return STOP;
+    end_pops(c, &p, k);
+    if (!push_value(c, stack, v, s))
+      return STOP;
+    break;
+  }
+  case 0x1f: // SFT
+    if (!pop_byte(c, &p, &b))
+      return STOP;
+    if (b.kind != VALUE_CONST) {
+      c->unsupported = true;
+      return STOP;
+    }
+    if (!pop_value(c, &p, s, &a) ||
+        !emit_shift_value(c, a, b.value, s, &v))
+      return STOP;
+    end_pops(c, &p, k);
+    if (!push_value(c, stack, v, s))
+      return STOP;
+    break;
+  default: // DEI, DEO and DIV are left to the interpreter
+    c->unsupported = true;
+    return STOP;
+  }
+
+  c->pc = next;
+  return COMPILED;
+}
+
+static void record_block(Jit *jit, Uxn *uxn, Short start, Short length) {
+  jit->blocks[jit->block_count++] =
+      (JitBlock){.start = start, .length = length, .live = true};
+  count_pages(jit, start, length, 1);
+  uxn_code_watch(uxn, start, length);
+}
+
+static bool jit_compile(Jit *jit, Uxn *uxn, Short start) {
+  if (jit->used + BLOCK_RESERVE > CODE_SIZE ||
+      jit->block_count == MAX_BLOCKS) {
+    jit_flush(jit, uxn);
+  }
+
+  Compiler c = {0}, saved;
+  c.jit = jit;
+  c.uxn = uxn;
+  c.code = jit->buffer + jit->used;
+  c.start = start;
+  c.pc = start;
+
+  emit_prologue(&c);
+  c.header = c.pos;
+
+  // Bail out to the interpreter unless both stack pointers are far enough
+  // from the ends of the stacks for every slot the block touches. The bounds
+  // are patched in at the end.
+  size_t bounds[2][2], bails[2][2];
+  for (int stack = 0; stack < 2; stack++) {
+    int reg = stack ? RET_PTR : WORK_PTR;
+    emit_modrm(&c, 0, 0x81, ALU_CMP, reg_operand(reg));
+    emit32(&c, 0);
+    bounds[stack][0] = c.pos - 4;
+    bails[stack][0] = emit_jcc(&c, CC_B);
+    emit_modrm(&c, 0, 0x81, ALU_CMP, reg_operand(reg));
+    emit32(&c, 0);
+    bounds[stack][1] = c.pos - 4;
+    bails[stack][1] = emit_jcc(&c, CC_A);
+  }
+
+  Result result = COMPILED;
+  while (result == COMPILED) {
+    if (c.ops == MAX_BLOCK_OPS || c.pos > BLOCK_RESERVE - 1024) {
+      emit_exit(&c, static_target(c.pc), 0);
+      break;
+    }
+
+    // Exits emitted by the instruction count it as executed
+    saved = c;
+    c.ops++;
+    result = compile_op(&c);
+    if (c.slot_overflow)
+      result = STOP;
+
+    if (result == STOP) {
+      bool unsupported = c.unsupported;
+      c = saved;
+      if (!c.ops) {
+        jit->hits[start] = NEVER_COMPILE;
+        return false;
+      }
+      c.end = c.pc;
+      emit_exit(&c, static_target(c.pc), unsupported ? INTERPRET : 0);
+    } else if (result == COMPILED) {
+      c.end = c.pc;
+      forget_popped(&c);
+      for (size_t i = 0; i < VALUE_REGS; i++) {
+        c.locks[value_regs[i]] = 0;
+      }
+    }
+  }
+
+  size_t bail = c.pos;
+  emit_store_ptrs(&c);
+  emit_mov_imm(&c, RAX, start | INTERPRET);
+  emit_epilogue(&c);
+
+  for (int stack = 0; stack < 2; stack++) {
+    int lo = c.min_slot[stack] < 0 ? -c.min_slot[stack] : 0;
+    int hi = 255 - (c.max_slot[stack] > 0 ? c.max_slot[stack] : 0);
+    patch32(&c, bounds[stack][0], lo);
+    patch32(&c, bounds[stack][1], hi);
+    patch_jump(&c, bails[stack][0], bail);
+    patch_jump(&c, bails[stack][1], bail);
+  }
+
+  union {
+    Byte *data;
+    JitCode code;
+  } entry = {.data = c.code};
+  jit->code[start] = entry.code;
+  jit->used = (jit->used + c.pos + 15) & ~(size_t)15;
+  record_block(jit, uxn, start, (Short)(c.end - start) ? (Short)(c.end - start) : 1);
+  return true;
+}
+
+// Evaluation
+
+static bool ends_block(Byte op) {
+  Byte base = op & 0x1f;
+  if (base == 0)
+    return op == 0x20 || op == 0x40 || op == 0x60;
+  // Jumps, DEI/DEO and DIV
+  return (base >= 0x0c && base <= 0x0e) || base == 0x16 || base == 0x17 ||
+         base == 0x1b;
+}
+
+// Runs instructions up to and including the next one that ends a block
+static Short jit_interpret(Uxn *uxn, Short pc) {
+  Byte op;
+  while ((op = uxn_mem_read(uxn, pc))) {
+    pc = uxn_ops[op](uxn, pc + 1);
+#ifdef UXN_STATS
+    uxn->instructions++;
+    uxn->dispatches++;
+#endif
+    if (ends_block(op))
+      break;
+  }
+  return pc;
+}
+
+bool jit_eval(Uxn *uxn, Short pc) {
+  Jit *jit = uxn->jit;
+  if (!jit)
+    jit = uxn->jit = jit_new();
+
+  if (!jit) {
+    Byte op;
+    while ((op = uxn_mem_read(uxn, pc++))) {
+      pc = uxn_ops[op](uxn, pc);
+    }
+    return 0;
+  }
+
+  while (uxn_mem_read(uxn, pc)) {
+    JitCode code = jit->code[pc];
+    if (code) {
+      uint32_t next = code(uxn);
+      pc = next;
+      if (!(next & INTERPRET))
+        continue;
+    } else if (jit->hits[pc] != NEVER_COMPILE &&
+               ++jit->hits[pc] >= UXN_JIT_THRESHOLD &&
+               jit_compile(jit, uxn, pc)) {
+      continue;
+    }
+    pc = jit_interpret(uxn, pc);
+  }
+
+  return 0;
+}
+
+#endif // UXN_JIT
@@ -0,0 +1,64 @@
+#include "common.h"
+#include "uxn.h"
+
+#ifndef jit_h
+#define jit_h
+
+/**
+ * x86-64 JIT, only built with UXN_JIT (`make JIT=1`).
+ *
+ * uxn_eval hands every vector to `jit_eval`, which interprets basic blocks
+ * and counts how often each block start is entered. Once a start has been
+ * entered UXN_JIT_THRESHOLD times, the block is compiled to native code that
+ * keeps both stack pointers in registers and caches stack bytes it has
+ * already loaded or computed in registers.
+ *
+ * A block ends at a jump, BRK, DEI/DEO, DIV and the few instructions whose
+ * operands aren't known at compile time (relative jumps, LDR/STR and SFT with
+ * computed offsets). Those run through the interpreter. Stores go through
+ * the usual uxn_mem_* functions, and when one of them overwrites compiled
+ * code the block drops back to the interpreter right after the store.
+ */
+
+#define T Jit
+
+typedef struct T T;
+
+/**
+ * @brief Allocate a JIT and its code buffer.
+ *
+ * @return Pointer to the new JIT, or NULL if no executable memory could be
+ * mapped.
+ */
+T *jit_new(void);
+
+/**
+ * @brief Free a JIT allocated with `jit_new`.
+ *
+ * @param jit Pointer to the JIT.
+ */
+void jit_delete(T *jit);
+
+/**
+ * @brief JIT version of `uxn_eval`.
+ *
+ * Allocates the Uxn's JIT on first use and falls back to the interpreter if
+ * that fails.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param pc The vector to evaluate.
+ * @return Always false, like `uxn_eval` reaching BRK.
+ */
+bool jit_eval(Uxn *uxn, Short pc);
+
+/**
+ * @brief Drop the compiled blocks that overlap a write to page 0.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param addr First address written.
+ * @param length Number of bytes written.
+ */
+void jit_invalidate(Uxn *uxn, Short addr, size_t length);
+
+#undef T
+#endif // jit_h
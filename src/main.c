@@ -1,66 +1,158 @@
-#include <raylib.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "common.h"
 #include "device/console.h"
+#include "device/controller.h"
 #include "device/datetime.h"
 #include "device/file.h"
-#include "device/raylib/controller.h"
-#include "device/raylib/mouse.h"
+#include "device/input.h"
+#include "device/mouse.h"
+#include "device/offscreen.h"
 #include "device/screen.h"
 #include "device/system.h"
+#include "profile.h"
+#include "snapshot.h"
 #include "uxn.h"
 
-void handle_input(Uxn *uxn, int scale_factor) {
-  console_poll(uxn);
-  controller_poll(uxn);
-  mouse_poll(uxn, scale_factor);
-}
+// `make headless` leaves raylib out, and always draws offscreen
+#ifndef UXN_HEADLESS
+#include "device/raylib/screen.h"
+#endif
 
-Byte uxn_dei_dispatch(Uxn *uxn, Byte addr) {
-  const Byte page = addr & 0xf0;
-  switch (page) {
-  case DEVICE_PAGE_SYSTEM:
-    return system_dei(uxn, addr);
-  case DEVICE_PAGE_SCREEN:
-    return screen_dei(uxn, addr);
-  case DEVICE_PAGE_FILE1:
-  case DEVICE_PAGE_FILE2:
-    return file_dei(uxn, addr);
-  case DEVICE_PAGE_DATETIME:
-    return datetime_dei(uxn, addr);
-  default:
-    return uxn_dev_read(uxn, addr);
-  }
-}
+// The VM runs the screen vector 60 times a second by default, whatever the
+// display does
+#define TICK_NANOSECONDS (1000000000L / 60)
+// Ticks the VM may fall behind by before it stops trying to catch up
+#define MAX_LATE_TICKS 4
 
-void uxn_deo_dispatch(Uxn *uxn, Byte addr) {
-  const Byte page = addr & 0xf0;
-  switch (page) {
-  case DEVICE_PAGE_SYSTEM: {
-    system_deo(uxn, addr);
-    if (SYSTEM_RED_PORT <= addr && addr <= SYSTEM_BLUE_PORT + 1) {
-      screen_change_palette(uxn);
-    }
+/**
+ * State shared by the VM thread and the render thread.
+ */
+typedef struct {
+  Uxn *uxn;
+  // Window input, from the render thread to the VM thread
+  InputQueue *input;
+  // Time between screen vectors, 0 to run them back to back
+  long tick;
+  // Screen vectors to run before stopping, 0 to run until the ROM halts
+  uint64_t frames;
+  // Cleared by the VM thread once the ROM has halted
+  atomic_bool running;
+} Emulator;
+
+// Sends an input event to its device, on the VM thread
+static void apply_input(Uxn *uxn, InputEvent event) {
+  switch (event.kind) {
+  case INPUT_BUTTON_DOWN:
+    controller_button_down(uxn, event.value);
     break;
-  }
-  case DEVICE_PAGE_CONSOLE:
-    console_deo(uxn, addr);
+  case INPUT_BUTTON_UP:
+    controller_button_up(uxn, event.value);
+    break;
+  case INPUT_KEY:
+    controller_key_down(uxn, event.value);
+    break;
+  case INPUT_MOUSE_MOVE:
+    mouse_move(uxn, event.x, event.y);
     break;
-  case DEVICE_PAGE_SCREEN:
-    screen_deo(uxn, addr);
+  case INPUT_MOUSE_DOWN:
+    mouse_button_down(uxn, event.value);
     break;
-  case DEVICE_PAGE_FILE1:
-  case DEVICE_PAGE_FILE2:
-    file_deo(uxn, addr);
+  case INPUT_MOUSE_UP:
+    mouse_button_up(uxn, event.value);
+    break;
+  case INPUT_MOUSE_SCROLL:
+    mouse_scroll(uxn, event.x, event.y);
+    break;
+  case INPUT_QUIT:
+    uxn_dev_write(uxn, SYSTEM_STATE_PORT, 1);
     break;
   default:
     break;
   }
 }
 
+// Sleeps until the next tick. A VM too slow to keep up runs ticks back to
+// back, but gives up on ticks it is too far behind on rather than racing
+// through them.
+static void wait_for_tick(struct timespec *deadline, long tick) {
+  deadline->tv_nsec += tick;
+  if (deadline->tv_nsec >= 1000000000L) {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000L;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long long late = (now.tv_sec - deadline->tv_sec) * 1000000000LL +
+                   (now.tv_nsec - deadline->tv_nsec);
+  if (late > MAX_LATE_TICKS * tick) {
+    *deadline = now;
+    return;
+  }
+
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL);
+}
+
+static void *vm_main(void *arg) {
+  Emulator *emulator = arg;
+  Uxn *uxn = emulator->uxn;
+  Screen *screen = uxn_get_screen(uxn);
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+  for (;;) {
+    InputEvent event;
+    while (input_pop(emulator->input, &event)) {
+      apply_input(uxn, event);
+    }
+    console_poll(uxn);
+
+    if (uxn_dev_read(uxn, SYSTEM_STATE_PORT) != 0)
+      break;
+    if (emulator->frames && screen->vectors >= emulator->frames)
+      break;
+
+    screen_update(uxn);
+    if (emulator->tick)
+      wait_for_tick(&deadline, emulator->tick);
+  }
+
+  atomic_store(&emulator->running, false);
+  return NULL;
+}
+
+#ifndef UXN_HEADLESS
+// Runs the VM on its own thread, so a slow frame on this one never holds up
+// its vectors. This thread keeps the window, as raylib has to.
+static void run_windowed(Emulator *emulator, RaylibScreen *window) {
+  pthread_t vm_thread;
+  pthread_create(&vm_thread, NULL, vm_main, emulator);
+
+  while (atomic_load(&emulator->running)) {
+    raylib_screen_redraw(window);
+    raylib_screen_poll(window, emulator->input);
+  }
+
+  pthread_join(vm_thread, NULL);
+}
+#endif
+
+// Where SIGUSR1 asks for the next frame to be written
+static OffscreenScreen *dump_on_signal;
+
+static void request_dump(int signal) {
+  (void)signal;
+  offscreen_request_dump(dump_on_signal);
+}
+
 int main(int argc, char *argv[]) {
 
   if (argc < 2) {
@@ -69,35 +161,150 @@ int main(int argc, char *argv[]) {
   }
 
   int scale = 1;
+  const char *profile_path = NULL;
+  bool report_uploads = false;
+  bool dump_drawlist = false;
+  int threads = 1;
+  bool cpu_composite = false;
+  // Normal speed in a window, as fast as possible offscreen
+  int speed = -1;
+  int publish_every = 1;
+  const char *output_prefix = NULL;
+  uint64_t output_every = 0;
+  OffscreenFormat output_format = OFFSCREEN_PNG;
+  uint64_t frames = 0;
+  const char *boot_snapshot = NULL;
+  const char *save_snapshot = NULL;
 
   int opt;
-  while ((opt = getopt(argc, argv, "s:")) != -1) {
+  while ((opt = getopt(argc, argv, "s:p:ulj:ct:n:o:e:rf:b:S:")) != -1) {
     switch (opt) {
     case 's':
       scale = atoi(optarg);
       break;
+    case 'p':
+      profile_path = optarg;
+      break;
+    case 'u':
+      report_uploads = true;
+      break;
+    case 'l':
+      dump_drawlist = true;
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 'c':
+      cpu_composite = true;
+      break;
+    case 't':
+      speed = atoi(optarg);
+      break;
+    case 'n':
+      publish_every = atoi(optarg);
+      break;
+    case 'o':
+      output_prefix = optarg;
+      break;
+    case 'e':
+      output_every = strtoull(optarg, NULL, 10);
+      break;
+    case 'r':
+      output_format = OFFSCREEN_RAW;
+      break;
+    case 'f':
+      frames = strtoull(optarg, NULL, 10);
+      break;
+    case 'b':
+      boot_snapshot = optarg;
+      break;
+    case 'S':
+      save_snapshot = optarg;
+      break;
     default:
-      fprintf(stderr, "Usage: %s [-s scale] <rom>\n", argv[0]);
+      fprintf(stderr,
+              "Usage: %s [-s scale] [-p profile.folded] [-u] [-l] [-j threads] "
+              "[-c] [-t speed] [-n frames] [-o prefix [-e frames] [-r]] "
+              "[-f frames] [-b snapshot] [-S snapshot] <rom>\n",
+              argv[0]);
       exit(EXIT_FAILURE);
     }
   }
 
   const char *rom_filename = argv[optind];
 
-  ScreenT *screen =
-      screen_new(DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT, scale);
+  ScreenBackend *backend;
+  OffscreenScreen *offscreen = NULL;
+#ifndef UXN_HEADLESS
+  RaylibScreen *window = NULL;
+  if (!output_prefix) {
+    window = raylib_screen_new(DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT,
+                               scale);
+    if (cpu_composite)
+      raylib_screen_composite_on_cpu(window);
+    backend = &window->backend;
+  } else
+#endif
+  {
+    offscreen = offscreen_new(output_prefix, output_format, output_every);
+    backend = &offscreen->backend;
+  }
+
+  if (speed < 0)
+    speed = offscreen ? 0 : 1;
 
-  SetExitKey(0);
-  HideCursor();
+#ifdef UXN_HEADLESS
+  // Window options are accepted, and have nothing to apply to
+  (void)scale;
+  (void)cpu_composite;
+  (void)report_uploads;
+#endif
+
+  Screen *screen =
+      screen_new(DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT, backend);
+  screen->dump_drawlist = dump_drawlist;
+  if (threads > 1)
+    screen->rasterizer = rasterizer_new(threads);
+  // Offscreen frames are numbered by vector, so every one is presented
+  if (publish_every > 1 && !offscreen)
+    screen->publish_every = publish_every;
 
   Uxn *uxn = uxn_new(screen);
+  Emulator emulator = {
+      .uxn = uxn,
+      .input = input_new(),
+      .tick = speed > 0 ? TICK_NANOSECONDS / speed : 0,
+      .frames = frames,
+  };
+  atomic_init(&emulator.running, true);
+
+  if (profile_path) {
+    Profile *profile = profile_new(profile_path);
+    profile_load_symbols(profile, rom_filename);
+    uxn_set_profile(uxn, profile);
+  }
+
+  system_register(uxn);
+  console_register(uxn);
+  screen_register(uxn);
+  file_register(uxn);
+  datetime_register(uxn);
 
   screen_boot(uxn);
-  system_boot(uxn, (char *)rom_filename);
 
-  bool continue_execution = true;
+  // A snapshot taken after the reset vector stands in for the ROM and for
+  // running the reset vector again
+  const SnapshotDevice devices[] = {screen_snapshot, file_snapshot};
+  if (boot_snapshot) {
+    if (!uxn_snapshot_load(uxn, boot_snapshot, devices, 2))
+      exit(EXIT_FAILURE);
+  } else {
+    system_boot(uxn, (char *)rom_filename);
+    uxn_eval(uxn, RESET_VECTOR);
+  }
 
-  uxn_eval(uxn, RESET_VECTOR);
+  if (save_snapshot && !uxn_snapshot_save(uxn, save_snapshot, devices, 2))
+    exit(EXIT_FAILURE);
 
   for (int i = optind + 1; i < argc; i++) {
     char *p = argv[i];
@@ -109,16 +316,53 @@ int main(int argc, char *argv[]) {
                                       : CONSOLE_TYPE_ARG_SPACER);
   }
 
-  while (continue_execution) {
-    screen_update(uxn);
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (offscreen) {
+    // With no window there is nothing to wait on, the VM runs right here
+    dump_on_signal = offscreen;
+    signal(SIGUSR1, request_dump);
+    vm_main(&emulator);
+    signal(SIGUSR1, SIG_DFL);
+
+    // The last frame is always written, with whatever was drawn after it
+    screen_flush(screen);
+    offscreen_dump(offscreen, screen->framebuffer, screen->palette,
+                   screen->vectors);
+  }
+#ifndef UXN_HEADLESS
+  else {
+    run_windowed(&emulator, window);
+  }
+#endif
 
-    handle_input(uxn, scale);
+  input_delete(emulator.input);
 
-    continue_execution = uxn_dev_read(uxn, SYSTEM_STATE_PORT) == 0;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (speed != 1 || offscreen) {
+    double seconds =
+        (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "vectors: %llu in %.2f s, %.0f per second\n",
+            (unsigned long long)screen->vectors, seconds,
+            seconds > 0 ? screen->vectors / seconds : 0);
   }
 
+  profile_report(uxn);
+  profile_delete(uxn_get_profile(uxn));
+
   screen_delete(screen);
   uxn_delete(uxn);
 
+  if (offscreen)
+    offscreen_delete(offscreen);
+#ifndef UXN_HEADLESS
+  if (window) {
+    if (report_uploads)
+      raylib_screen_report(window, stderr);
+    raylib_screen_delete(window);
+  }
+#endif
+
   return 0;
 }
@@ -1,14 +1,13 @@
+#include "ops.h"
+#include "fuse.h"
 #include "uxn.h"
 #include "common.h"
 
-extern Byte uxn_dei_dispatch(Uxn *uxn, Byte addr);
-extern void uxn_deo_dispatch(Uxn *uxn, Byte addr);
-
-Byte save_stack_ptr(Uxn *uxn, bool return_mode) {
+UXN_INLINE Byte save_stack_ptr(Uxn *uxn, bool return_mode) {
   return return_mode ? uxn_ret_ptr(uxn) : uxn_work_ptr(uxn);
 }
 
-void restore_stack_ptr(Uxn *uxn, bool return_mode, Byte ptr) {
+UXN_INLINE void restore_stack_ptr(Uxn *uxn, bool return_mode, Byte ptr) {
   if (return_mode) {
     uxn_set_ret_ptr(uxn, ptr);
   } else {
@@ -66,7 +65,8 @@ Short op_jci(Uxn *uxn, Short pc) {
  * Pushes the next bytes in memory, and moves the PC+2. The LIT opcode always
  * has the keep mode active.
  */
-Short op_lit(Uxn *uxn, Short pc, bool return_mode, bool short_mode) {
+UXN_INLINE Short eval_lit(Uxn *uxn, Short pc, bool return_mode,
+                           bool short_mode) {
   Byte literal_value = uxn_mem_read(uxn, pc);
   uxn_push(uxn, literal_value, return_mode);
 
@@ -84,8 +84,8 @@ Short op_lit(Uxn *uxn, Short pc, bool return_mode, bool short_mode) {
  *
  * Increments the top value of the stack by one.
  */
-Short op_inc(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_inc(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -112,8 +112,8 @@ Short op_inc(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Removes the value at the top of the stack
  */
-Short op_pop(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_pop(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   if (keep_mode)
     return pc;
 
@@ -130,8 +130,8 @@ Short op_pop(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * Removes the second value from the stack. This is useful to truncate a short
  * into a byte.
  */
-Short op_nip(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_nip(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -160,8 +160,8 @@ Short op_nip(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Exchanges the top two values on the stack.
  */
-Short op_swp(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_swp(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -192,8 +192,8 @@ Short op_swp(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Rotates three values at the top of the stack, to the left, wrapping around.
  */
-Short op_rot(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_rot(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -228,8 +228,8 @@ Short op_rot(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Duplicates the value at the top of the stack.
  */
-Short op_dup(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_dup(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -258,8 +258,8 @@ Short op_dup(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Duplicates the second value at the top of the stack.
  */
-Short op_ovr(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_ovr(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -293,8 +293,8 @@ Short op_ovr(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * Pushes 01 to the stack if the two values at the top of the stack are equal,
  * 00 otherwise.
  */
-Short op_equ(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_equ(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   bool result = false;
@@ -324,8 +324,8 @@ Short op_equ(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * Pushes 01 to the stack if the two values at the top of the stack are not
  * equal, 00 otherwise.
  */
-Short op_neq(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_neq(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   bool result = false;
@@ -354,8 +354,8 @@ Short op_neq(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Pushes 01 to the stack if a > b, 00 otherwise.
  */
-Short op_gth(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_gth(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   bool result = false;
@@ -385,8 +385,8 @@ Short op_gth(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Pushes 01 to the stack if a < b, 00 otherwise.
  */
-Short op_lth(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_lth(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   bool result = false;
@@ -416,8 +416,8 @@ Short op_lth(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * Move the PC by a relative distance equal to the signed byte on the top of the
  * stack, or to an absolute address in short mode.
  */
-Short op_jmp(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_jmp(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -446,8 +446,8 @@ Short op_jmp(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * equal to the byte on the top of the stack, or to an absolute address in short
  * mode.
  */
-Short op_jcn(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_jcn(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -480,8 +480,8 @@ Short op_jcn(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Using return mode swaps the operation on the working and return stacks.
  */
-Short op_jsr(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_jsr(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   uxn_push_short(uxn, pc, !return_mode);
@@ -511,8 +511,8 @@ Short op_jsr(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * With return mode active, the stacks are exchanged, and the value is moved
  * from the return stack to the working stack.
  */
-Short op_sth(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_sth(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -540,8 +540,8 @@ Short op_sth(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * Pushes the value at an address within the first 256 bytes of memeory, to the
  * top of the stack.
  */
-Short op_ldz(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_ldz(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   Byte addr = uxn_pop(uxn, return_mode);
@@ -566,8 +566,8 @@ Short op_ldz(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Writes a value to an address within the first 256 bytes of memory.
  */
-Short op_stz(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_stz(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   Byte addr = uxn_pop(uxn, return_mode);
@@ -597,8 +597,8 @@ Short op_stz(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * Pushes a value at a relative address in relation to the PC, within a range
  * between -128 and +127 bytes, to the top of the stack.
  */
-Short op_ldr(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_ldr(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   SignedByte rel_addr = uxn_pop(uxn, return_mode);
@@ -625,8 +625,8 @@ Short op_ldr(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * Writes a value to a relative address in relation to the PC, within a range
  * between -128 and +127 bytes.
  */
-Short op_str(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_str(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   SignedByte rel_addr = uxn_pop(uxn, return_mode);
@@ -658,8 +658,8 @@ Short op_str(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Pushes a value at an absolute address in memory to the top of the stack.
  */
-Short op_lda(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_lda(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   Short addr = uxn_pop_short(uxn, return_mode);
@@ -683,8 +683,8 @@ Short op_lda(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Writes a value to an absolute address in memory.
  */
-Short op_sta(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_sta(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   Short addr = uxn_pop_short(uxn, return_mode);
@@ -714,8 +714,8 @@ Short op_sta(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * Pushes a value from the device page to the top of the stack.
  * The target device might capture the reading to trigger an I/O event.
  */
-Short op_dei(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_dei(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   Byte addr = uxn_pop(uxn, return_mode);
@@ -724,13 +724,13 @@ Short op_dei(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
     restore_stack_ptr(uxn, return_mode, ptr);
 
   if (short_mode) {
-    Byte high_a = uxn_dei_dispatch(uxn, addr);
-    Byte low_a = uxn_dei_dispatch(uxn, addr + 1);
+    Byte high_a = uxn_dei(uxn, addr);
+    Byte low_a = uxn_dei(uxn, addr + 1);
 
     uxn_push(uxn, high_a, return_mode);
     uxn_push(uxn, low_a, return_mode);
   } else {
-    Byte a = uxn_dei_dispatch(uxn, addr);
+    Byte a = uxn_dei(uxn, addr);
 
     uxn_push(uxn, a, return_mode);
   }
@@ -744,8 +744,8 @@ Short op_dei(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * Writes a value to the device page. The target device might capture the
  * writing to trigger an I/O event.
  */
-Short op_deo(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_deo(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   Byte addr = uxn_pop(uxn, return_mode);
@@ -758,8 +758,8 @@ Short op_deo(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
 
     uxn_dev_write_short(uxn, addr, a);
 
-    uxn_deo_dispatch(uxn, addr);
-    uxn_deo_dispatch(uxn, addr + 1);
+    uxn_deo(uxn, addr);
+    uxn_deo(uxn, addr + 1);
 
   } else {
     Byte a = uxn_pop(uxn, return_mode);
@@ -769,7 +769,7 @@ Short op_deo(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
 
     uxn_dev_write(uxn, addr, a);
 
-    uxn_deo_dispatch(uxn, addr);
+    uxn_deo(uxn, addr);
   }
 
   return pc;
@@ -780,8 +780,8 @@ Short op_deo(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Pushes the sum of the two values at the top of the stack.
  */
-Short op_add(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_add(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -813,8 +813,8 @@ Short op_add(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * Pushes the difference of the first value minus the second, to the top of the
  * stack.
  */
-Short op_sub(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_sub(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -845,8 +845,8 @@ Short op_sub(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Pushes the product of the first and second values at the top of the stack.
  */
-Short op_mul(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_mul(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -879,8 +879,8 @@ Short op_mul(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * stack. Division by zero pushes zero to the stack. The rounding direction is
  * toward zero.
  */
-Short op_div(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_div(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -918,8 +918,8 @@ Short op_div(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Pushes the bitwise AND of the two values at the top of the stack.
  */
-Short op_and(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_and(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -948,8 +948,8 @@ Short op_and(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Pushes the bitwise OR of the two values at the top of the stack.
  */
-Short op_ora(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_ora(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -978,8 +978,8 @@ Short op_ora(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  *
  * Pushes the bitwise XOR of the two values at the top of the stack.
  */
-Short op_eor(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_eor(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   if (short_mode) {
@@ -1011,8 +1011,8 @@ Short op_eor(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
  * the control value indicates how many bits to shift left, the low nibble how
  * many bits to shift right. The rightward shift is done first.
  */
-Short op_sft(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
-             bool short_mode) {
+UXN_INLINE Short eval_sft(Uxn *uxn, Short pc, bool keep_mode,
+                          bool return_mode, bool short_mode) {
   Byte ptr = save_stack_ptr(uxn, return_mode);
 
   Byte shift = uxn_pop(uxn, return_mode);
@@ -1041,4 +1041,130 @@ Short op_sft(Uxn *uxn, Short pc, bool keep_mode, bool return_mode,
   }
 
   return pc;
-}
\ No newline at end of file
+}
+
+// Specialised handlers
+
+/**
+ * One handler per opcode and mode combination, e.g. op_add_k_r_2 for ADD2kr.
+ *
+ * The generic eval_* bodies above are always inlined with constant modes, so
+ * the mode tests and the stack pointer save/restore fold away at compile time.
+ */
+
+Short op_lit(Uxn *uxn, Short pc) { return eval_lit(uxn, pc, false, false); }
+Short op_lit_2(Uxn *uxn, Short pc) { return eval_lit(uxn, pc, false, true); }
+Short op_lit_r(Uxn *uxn, Short pc) { return eval_lit(uxn, pc, true, false); }
+Short op_lit_r_2(Uxn *uxn, Short pc) { return eval_lit(uxn, pc, true, true); }
+
+#define SPECIALISE(code, name, mode, suffix, k, r, s)                          \
+  Short op_##name##suffix(Uxn *uxn, Short pc) {                                \
+    return eval_##name(uxn, pc, k, r, s);                                      \
+  }
+#define SPECIALISE_MODE(mode, suffix, k, r, s)                                 \
+  UXN_MODED_OPS(SPECIALISE, mode, suffix, k, r, s)
+
+UXN_OP_MODES(SPECIALISE_MODE)
+
+#define TABLE_ENTRY(code, name, mode, suffix, k, r, s)                         \
+  [(code) | (mode)] = op_##name##suffix,
+#define TABLE_MODE(mode, suffix, k, r, s)                                      \
+  UXN_MODED_OPS(TABLE_ENTRY, mode, suffix, k, r, s)
+
+const UxnOp uxn_ops[256] = {
+    // BRK has no handler, uxn_eval stops before dispatching it.
+    [0x00] = NULL,        [0x20] = op_jci,     [0x40] = op_jmi,
+    [0x60] = op_jsi,      [0x80] = op_lit,     [0xa0] = op_lit_2,
+    [0xc0] = op_lit_r,    [0xe0] = op_lit_r_2,
+    UXN_OP_MODES(TABLE_MODE)};
+
+// Superinstructions
+
+/**
+ * Handlers for the idioms in UXN_FUSED_OPS. Each one runs the same eval_*
+ * bodies as the instructions it replaces, one after the other, so the only
+ * thing saved is the dispatch in between.
+ */
+
+#define FUSED_LITERAL(name, lit_short, op, short_mode)                         \
+  static Short op_fused_##name(Uxn *uxn, Short pc) {                           \
+    pc = eval_lit(uxn, pc, false, lit_short);                                  \
+    return eval_##op(uxn, pc + 1, false, false, short_mode);                   \
+  }
+
+FUSED_LITERAL(lit_ldz, false, ldz, false)
+FUSED_LITERAL(lit_ldz_2, false, ldz, true)
+FUSED_LITERAL(lit_stz, false, stz, false)
+FUSED_LITERAL(lit_stz_2, false, stz, true)
+FUSED_LITERAL(lit_2_lda, true, lda, false)
+FUSED_LITERAL(lit_2_lda_2, true, lda, true)
+FUSED_LITERAL(lit_2_sta, true, sta, false)
+FUSED_LITERAL(lit_2_sta_2, true, sta, true)
+FUSED_LITERAL(lit_deo, false, deo, false)
+FUSED_LITERAL(lit_deo_2, false, deo, true)
+FUSED_LITERAL(lit_add, false, add, false)
+FUSED_LITERAL(lit_sub, false, sub, false)
+FUSED_LITERAL(lit_2_add_2, true, add, true)
+FUSED_LITERAL(lit_2_sub_2, true, sub, true)
+
+#define FUSED_BRANCH(cmp)                                                      \
+  static Short op_fused_dup_lit_##cmp##_jci(Uxn *uxn, Short pc) {              \
+    pc = eval_dup(uxn, pc, false, false, false);                               \
+    pc = eval_lit(uxn, pc + 1, false, false);                                  \
+    pc = eval_##cmp(uxn, pc + 1, false, false, false);                         \
+    return op_jci(uxn, pc + 1);                                                \
+  }                                                                            \
+  static Short op_fused_dup_2_lit_2_##cmp##_2_jci(Uxn *uxn, Short pc) {        \
+    pc = eval_dup(uxn, pc, false, false, true);                                \
+    pc = eval_lit(uxn, pc + 1, false, true);                                   \
+    pc = eval_##cmp(uxn, pc + 1, false, false, true);                          \
+    return op_jci(uxn, pc + 1);                                                \
+  }                                                                            \
+  static Short op_fused_inc_dup_lit_##cmp##_jci(Uxn *uxn, Short pc) {          \
+    pc = eval_inc(uxn, pc, false, false, false);                               \
+    return op_fused_dup_lit_##cmp##_jci(uxn, pc + 1);                          \
+  }                                                                            \
+  static Short op_fused_inc_2_dup_2_lit_2_##cmp##_2_jci(Uxn *uxn, Short pc) {  \
+    pc = eval_inc(uxn, pc, false, false, true);                                \
+    return op_fused_dup_2_lit_2_##cmp##_2_jci(uxn, pc + 1);                    \
+  }
+
+FUSED_BRANCH(equ)
+FUSED_BRANCH(neq)
+FUSED_BRANCH(gth)
+FUSED_BRANCH(lth)
+
+#define FUSED_TABLE_ENTRY(NAME, name, length) [FUSED_##NAME] = op_fused_##name,
+
+const UxnOp uxn_fused_ops[FUSED_COUNT] = {
+    [FUSED_NONE] = NULL, UXN_FUSED_OPS(FUSED_TABLE_ENTRY)};
+
+/**
+ * The instructions an idiom can start with check the side table before
+ * running on their own.
+ */
+
+#define FUSING(op)                                                             \
+  static Short op##_fusing(Uxn *uxn, Short pc) {                               \
+    return uxn_eval_fused(uxn, pc, op);                                        \
+  }
+
+FUSING(op_lit)
+FUSING(op_lit_2)
+FUSING(op_inc)
+FUSING(op_inc_2)
+FUSING(op_dup)
+FUSING(op_dup_2)
+
+// Later initialisers override the plain handlers from TABLE_MODE
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+
+const UxnOp uxn_eval_ops[256] = {
+    [0x00] = NULL,           [0x20] = op_jci,        [0x40] = op_jmi,
+    [0x60] = op_jsi,         [0xc0] = op_lit_r,      [0xe0] = op_lit_r_2,
+    UXN_OP_MODES(TABLE_MODE) [0x80] = op_lit_fusing, [0xa0] = op_lit_2_fusing,
+    [0x01] = op_inc_fusing,  [0x21] = op_inc_2_fusing,
+    [0x06] = op_dup_fusing,  [0x26] = op_dup_2_fusing};
+
+#pragma GCC diagnostic pop
@@ -4,40 +4,81 @@
 #ifndef ops_h
 #define ops_h
 
+/**
+ * X-macro over the opcodes that take the keep, return and short modes.
+ *
+ * X(code, name, ...) is expanded once per opcode, any extra arguments are
+ * forwarded to X unchanged.
+ */
+#define UXN_MODED_OPS(X, ...)                                                  \
+  X(0x01, inc, __VA_ARGS__) X(0x02, pop, __VA_ARGS__)                          \
+  X(0x03, nip, __VA_ARGS__) X(0x04, swp, __VA_ARGS__)                          \
+  X(0x05, rot, __VA_ARGS__) X(0x06, dup, __VA_ARGS__)                          \
+  X(0x07, ovr, __VA_ARGS__) X(0x08, equ, __VA_ARGS__)                          \
+  X(0x09, neq, __VA_ARGS__) X(0x0a, gth, __VA_ARGS__)                          \
+  X(0x0b, lth, __VA_ARGS__) X(0x0c, jmp, __VA_ARGS__)                          \
+  X(0x0d, jcn, __VA_ARGS__) X(0x0e, jsr, __VA_ARGS__)                          \
+  X(0x0f, sth, __VA_ARGS__) X(0x10, ldz, __VA_ARGS__)                          \
+  X(0x11, stz, __VA_ARGS__) X(0x12, ldr, __VA_ARGS__)                          \
+  X(0x13, str, __VA_ARGS__) X(0x14, lda, __VA_ARGS__)                          \
+  X(0x15, sta, __VA_ARGS__) X(0x16, dei, __VA_ARGS__)                          \
+  X(0x17, deo, __VA_ARGS__) X(0x18, add, __VA_ARGS__)                          \
+  X(0x19, sub, __VA_ARGS__) X(0x1a, mul, __VA_ARGS__)                          \
+  X(0x1b, div, __VA_ARGS__) X(0x1c, and, __VA_ARGS__)                          \
+  X(0x1d, ora, __VA_ARGS__) X(0x1e, eor, __VA_ARGS__)                          \
+  X(0x1f, sft, __VA_ARGS__)
+
+/**
+ * X-macro over the eight mode combinations.
+ *
+ * X(mode_bits, suffix, keep_mode, return_mode, short_mode), where mode_bits is
+ * OR'ed into the opcode to get the full instruction byte and suffix follows
+ * the `_k_r_2` naming used for the opcode labels.
+ */
+#define UXN_OP_MODES(X)                                                        \
+  X(0x00, , false, false, false)                                               \
+  X(0x20, _2, false, false, true)                                              \
+  X(0x40, _r, false, true, false)                                              \
+  X(0x60, _r_2, false, true, true)                                             \
+  X(0x80, _k, true, false, false)                                              \
+  X(0xa0, _k_2, true, false, true)                                             \
+  X(0xc0, _k_r, true, true, false)                                             \
+  X(0xe0, _k_r_2, true, true, true)
+
+/**
+ * An instruction handler. Called with the PC pointing just past the opcode
+ * byte, returns the PC of the next instruction.
+ */
+typedef Short (*UxnOp)(Uxn *uxn, Short pc);
+
+/**
+ * Handlers indexed by the raw instruction byte. The entry for BRK (0x00) is
+ * NULL.
+ */
+extern const UxnOp uxn_ops[256];
+
+/**
+ * Handlers used by uxn_eval. The same as uxn_ops, except that the instructions
+ * that can start a superinstruction (see fuse.h) run it when there is one.
+ */
+extern const UxnOp uxn_eval_ops[256];
+
 Short op_jmi(Uxn *uxn, Short pc);
 Short op_jsi(Uxn *uxn, Short pc);
 Short op_jci(Uxn *uxn, Short pc);
-Short op_lit(Uxn *uxn, Short pc, bool return_mode, bool short_mode);
-Short op_inc(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_pop(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_nip(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_swp(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_rot(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_dup(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_ovr(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_equ(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_neq(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_gth(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_lth(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_jmp(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_jcn(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_jsr(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_sth(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_ldz(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_stz(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode); 
-Short op_ldr(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_str(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_lda(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_sta(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_dei(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_deo(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_add(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_sub(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_mul(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_div(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_and(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode); 
-Short op_ora(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_eor(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
-Short op_sft(Uxn *uxn, Short pc, bool keep_mode, bool return_mode, bool short_mode);
+Short op_lit(Uxn *uxn, Short pc);
+Short op_lit_2(Uxn *uxn, Short pc);
+Short op_lit_r(Uxn *uxn, Short pc);
+Short op_lit_r_2(Uxn *uxn, Short pc);
+
+#define UXN_DECLARE_OP(code, name, mode, suffix, k, r, s)                      \
+  Short op_##name##suffix(Uxn *uxn, Short pc);
+#define UXN_DECLARE_MODE(mode, suffix, k, r, s)                                \
+  UXN_MODED_OPS(UXN_DECLARE_OP, mode, suffix, k, r, s)
+
+UXN_OP_MODES(UXN_DECLARE_MODE)
+
+#undef UXN_DECLARE_MODE
+#undef UXN_DECLARE_OP
 
 #endif // ops_h
\ No newline at end of file
@@ -0,0 +1,392 @@
+#include "profile.h"
+#include "ops.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define REPORT_ROWS 20
+#define MAX_CALL_DEPTH 0x100
+#define ROOT_NODE 0
+
+typedef struct Symbol {
+  Short addr;
+  char *name;
+} Symbol;
+
+/**
+ * A node of the call tree. Children of the root are the vectors, below them
+ * the subroutines called through JSR/JSI.
+ */
+typedef struct CallNode {
+  Short addr;
+  size_t parent;
+  size_t first_child;
+  size_t next_sibling;
+  uint64_t cycles;
+} CallNode;
+
+typedef struct Frame {
+  size_t node;
+  Byte ret_ptr; ///< Return stack pointer right after the call
+} Frame;
+
+struct Profile {
+  uint64_t op_count[256];
+  uint64_t op_cycles[256];
+  uint64_t pc_count[0x10000];
+  uint64_t pc_cycles[0x10000];
+
+  CallNode *nodes;
+  size_t node_count;
+  size_t node_capacity;
+
+  Frame frames[MAX_CALL_DEPTH];
+  size_t depth;
+
+  Symbol *symbols;
+  size_t symbol_count;
+
+  char *folded_path;
+};
+
+static uint64_t profile_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Lifecycle management
+
+Profile *profile_new(const char *folded_path) {
+  Profile *profile = calloc(1, sizeof(Profile));
+  if (!profile)
+    return NULL;
+
+  profile->node_capacity = 0x100;
+  profile->nodes = calloc(profile->node_capacity, sizeof(CallNode));
+  profile->node_count = 1; // The root
+  profile->folded_path = folded_path ? strdup(folded_path) : NULL;
+
+  return profile;
+}
+
+void profile_delete(Profile *profile) {
+  if (profile) {
+    for (size_t i = 0; i < profile->symbol_count; i++) {
+      free(profile->symbols[i].name);
+    }
+    free(profile->symbols);
+    free(profile->nodes);
+    free(profile->folded_path);
+    free(profile);
+  }
+}
+
+// Symbols
+
+static int compare_symbols(const void *a, const void *b) {
+  return ((const Symbol *)a)->addr - ((const Symbol *)b)->addr;
+}
+
+/**
+ * uxnasm symbol files are a list of big endian addresses, each followed by a
+ * null terminated label.
+ */
+void profile_load_symbols(Profile *profile, const char *rom_path) {
+  char *sym_path = malloc(strlen(rom_path) + sizeof(".sym"));
+  sprintf(sym_path, "%s.sym", rom_path);
+  FILE *f = fopen(sym_path, "rb");
+  free(sym_path);
+
+  if (!f)
+    return;
+
+  int high, low;
+  while ((high = fgetc(f)) != EOF && (low = fgetc(f)) != EOF) {
+    char name[0x100];
+    size_t len = 0;
+    int c;
+    while ((c = fgetc(f)) != EOF && c != '\0') {
+      if (len < sizeof(name) - 1)
+        name[len++] = c;
+    }
+    name[len] = '\0';
+
+    Symbol *symbols = realloc(profile->symbols,
+                              (profile->symbol_count + 1) * sizeof(Symbol));
+    if (!symbols)
+      break;
+
+    profile->symbols = symbols;
+    profile->symbols[profile->symbol_count++] =
+        (Symbol){.addr = (high << 8) | low, .name = strdup(name)};
+  }
+
+  fclose(f);
+
+  qsort(profile->symbols, profile->symbol_count, sizeof(Symbol),
+        compare_symbols);
+}
+
+// The last symbol at or before addr
+static Symbol *find_symbol(Profile *profile, Short addr) {
+  Symbol *found = NULL;
+  size_t lo = 0, hi = profile->symbol_count;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (profile->symbols[mid].addr <= addr) {
+      found = &profile->symbols[mid];
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return found;
+}
+
+static void format_addr(Profile *profile, Short addr, char *buffer,
+                        size_t size) {
+  Symbol *symbol = find_symbol(profile, addr);
+  if (!symbol) {
+    snprintf(buffer, size, "0x%04x", addr);
+  } else if (symbol->addr == addr) {
+    snprintf(buffer, size, "%s", symbol->name);
+  } else {
+    snprintf(buffer, size, "%s+0x%x", symbol->name, addr - symbol->addr);
+  }
+}
+
+static void format_op(Byte op, char buffer[8]) {
+  static const char *names[32] = {
+      "BRK", "INC", "POP", "NIP", "SWP", "ROT", "DUP", "OVR",
+      "EQU", "NEQ", "GTH", "LTH", "JMP", "JCN", "JSR", "STH",
+      "LDZ", "STZ", "LDR", "STR", "LDA", "STA", "DEI", "DEO",
+      "ADD", "SUB", "MUL", "DIV", "AND", "ORA", "EOR", "SFT",
+  };
+  static const char *immediate[8] = {"BRK", "JCI", "JMI",  "JSI",
+                                     "LIT", "LIT2", "LITr", "LIT2r"};
+
+  if ((op & 0x1f) == 0) {
+    strcpy(buffer, immediate[op >> 5]);
+    return;
+  }
+
+  sprintf(buffer, "%s%s%s%s", names[op & 0x1f], op & 0x20 ? "2" : "",
+          op & 0x80 ? "k" : "", op & 0x40 ? "r" : "");
+}
+
+// Call tree
+
+static size_t call_node_child(Profile *profile, size_t parent, Short addr) {
+  for (size_t i = profile->nodes[parent].first_child; i;
+       i = profile->nodes[i].next_sibling) {
+    if (profile->nodes[i].addr == addr)
+      return i;
+  }
+
+  if (profile->node_count == profile->node_capacity) {
+    size_t capacity = profile->node_capacity * 2;
+    CallNode *nodes = realloc(profile->nodes, capacity * sizeof(CallNode));
+    if (!nodes)
+      return parent;
+    profile->nodes = nodes;
+    profile->node_capacity = capacity;
+  }
+
+  size_t child = profile->node_count++;
+  profile->nodes[child] = (CallNode){.addr = addr,
+                                     .parent = parent,
+                                     .first_child = 0,
+                                     .next_sibling =
+                                         profile->nodes[parent].first_child,
+                                     .cycles = 0};
+  profile->nodes[parent].first_child = child;
+
+  return child;
+}
+
+static void push_frame(Profile *profile, Short addr, Byte ret_ptr) {
+  if (profile->depth == MAX_CALL_DEPTH)
+    return;
+
+  size_t parent = profile->frames[profile->depth - 1].node;
+  profile->frames[profile->depth++] = (Frame){
+      .node = call_node_child(profile, parent, addr), .ret_ptr = ret_ptr};
+}
+
+// A frame has returned once its return address was popped off the stack
+static void pop_returned_frames(Profile *profile, Byte ret_ptr) {
+  while (profile->depth > 1 &&
+         (SignedByte)(ret_ptr - profile->frames[profile->depth - 1].ret_ptr) <
+             0) {
+    profile->depth--;
+  }
+}
+
+static bool is_call(Byte op) {
+  // JSR without return mode pushes its return address to the return stack
+  return op == 0x60 || (op & 0x5f) == 0x0e;
+}
+
+// Evaluation
+
+bool profile_eval(Uxn *uxn, Short pc) {
+  Profile *profile = uxn->profile;
+
+  // Vectors can be evaluated from inside a device call, so keep the caller's
+  // frames aside
+  Frame saved_frames[MAX_CALL_DEPTH];
+  size_t saved_depth = profile->depth;
+  memcpy(saved_frames, profile->frames, saved_depth * sizeof(Frame));
+
+  profile->frames[0] = (Frame){.node = call_node_child(profile, ROOT_NODE, pc),
+                               .ret_ptr = uxn_ret_ptr(uxn)};
+  profile->depth = 1;
+
+  uint64_t last = profile_clock();
+
+  Byte op;
+  while ((op = uxn_mem_read(uxn, pc))) {
+    Short op_pc = pc;
+    pc = uxn_ops[op](uxn, pc + 1);
+
+    uint64_t now = profile_clock();
+    uint64_t cycles = now - last;
+    last = now;
+
+    profile->op_count[op]++;
+    profile->op_cycles[op] += cycles;
+    profile->pc_count[op_pc]++;
+    profile->pc_cycles[op_pc] += cycles;
+    profile->nodes[profile->frames[profile->depth - 1].node].cycles += cycles;
+
+    if (is_call(op)) {
+      push_frame(profile, pc, uxn_ret_ptr(uxn));
+    } else {
+      pop_returned_frames(profile, uxn_ret_ptr(uxn));
+    }
+  }
+
+  profile->op_count[op]++;
+  profile->pc_count[pc]++;
+
+  memcpy(profile->frames, saved_frames, saved_depth * sizeof(Frame));
+  profile->depth = saved_depth;
+
+  return 0;
+}
+
+// Reporting
+
+typedef struct Row {
+  size_t key;
+  uint64_t count;
+  uint64_t cycles;
+} Row;
+
+static int compare_rows(const void *a, const void *b) {
+  uint64_t ca = ((const Row *)a)->cycles, cb = ((const Row *)b)->cycles;
+  return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+static size_t collect_rows(Row *rows, const uint64_t *count,
+                           const uint64_t *cycles, size_t n,
+                           uint64_t *total_cycles) {
+  size_t used = 0;
+  *total_cycles = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (count[i]) {
+      rows[used++] = (Row){.key = i, .count = count[i], .cycles = cycles[i]};
+      *total_cycles += cycles[i];
+    }
+  }
+  qsort(rows, used, sizeof(Row), compare_rows);
+  return used;
+}
+
+static void write_folded(Profile *profile, FILE *f, size_t node, char *path,
+                         size_t path_len, size_t path_size) {
+  CallNode *n = &profile->nodes[node];
+  size_t len = path_len;
+
+  if (node != ROOT_NODE) {
+    char name[0x100];
+    format_addr(profile, n->addr, name, sizeof(name));
+    len += snprintf(path + path_len, path_size - path_len, "%s%s",
+                    path_len ? ";" : "", name);
+    if (len >= path_size)
+      len = path_size - 1;
+
+    if (n->cycles)
+      fprintf(f, "%s %llu\n", path, (unsigned long long)n->cycles);
+  }
+
+  for (size_t i = n->first_child; i; i = profile->nodes[i].next_sibling) {
+    write_folded(profile, f, i, path, len, path_size);
+  }
+
+  path[path_len] = '\0';
+}
+
+void profile_report(Uxn *uxn) {
+  Profile *profile = uxn->profile;
+  if (!profile)
+    return;
+
+  Row *rows = malloc(0x10000 * sizeof(Row));
+  if (!rows)
+    return;
+
+  uint64_t total;
+  size_t used = collect_rows(rows, profile->op_count, profile->op_cycles, 256,
+                             &total);
+
+  fprintf(stderr, "\n%-8s %14s %16s %7s\n", "op", "count", "cycles", "%");
+  for (size_t i = 0; i < used && i < REPORT_ROWS; i++) {
+    char name[8];
+    format_op(rows[i].key, name);
+    fprintf(stderr, "%-8s %14llu %16llu %6.2f%%\n", name,
+            (unsigned long long)rows[i].count,
+            (unsigned long long)rows[i].cycles,
+            total ? 100.0 * rows[i].cycles / total : 0);
+  }
+
+  used = collect_rows(rows, profile->pc_count, profile->pc_cycles, 0x10000,
+                      &total);
+
+  fprintf(stderr, "\n%-6s %-24s %-8s %14s %16s %7s\n", "addr", "symbol", "op",
+          "count", "cycles", "%");
+  for (size_t i = 0; i < used && i < REPORT_ROWS; i++) {
+    char symbol[0x100];
+    char op[8];
+    format_addr(profile, rows[i].key, symbol, sizeof(symbol));
+    format_op(uxn_mem_read(uxn, rows[i].key), op);
+    fprintf(stderr, "%04zx   %-24.24s %-8s %14llu %16llu %6.2f%%\n",
+            rows[i].key, symbol, op, (unsigned long long)rows[i].count,
+            (unsigned long long)rows[i].cycles,
+            total ? 100.0 * rows[i].cycles / total : 0);
+  }
+
+  free(rows);
+
+  if (profile->folded_path) {
+    FILE *f = fopen(profile->folded_path, "w");
+    if (!f) {
+      perror(profile->folded_path);
+      return;
+    }
+    char path[0x1000] = {0};
+    write_folded(profile, f, ROOT_NODE, path, 0, sizeof(path));
+    fclose(f);
+  }
+}
@@ -0,0 +1,59 @@
+#include "common.h"
+#include "uxn.h"
+
+#ifndef profile_h
+#define profile_h
+
+#define T Profile
+
+typedef struct T T;
+
+/**
+ * @brief Allocate a new profile.
+ *
+ * @param folded_path Where to write the collapsed call stacks, may be NULL.
+ * @return Pointer to the new profile.
+ */
+T *profile_new(const char *folded_path);
+
+/**
+ * @brief Free a profile allocated with `profile_new`.
+ *
+ * @param profile Pointer to the profile.
+ */
+void profile_delete(T *profile);
+
+/**
+ * @brief Load the uxnasm symbol file (`<rom>.sym`) for a ROM, if there is one.
+ *
+ * Symbols are used to name addresses in the report and in the call stacks.
+ *
+ * @param profile Pointer to the profile.
+ * @param rom_path Path of the ROM that is being profiled.
+ */
+void profile_load_symbols(T *profile, const char *rom_path);
+
+/**
+ * @brief Profiling version of `uxn_eval`.
+ *
+ * Counts executions and cycles per instruction byte and per PC, and tracks
+ * JSR/JSI calls against the return stack to build a call tree. `uxn_eval`
+ * calls this instead of its own loop when the Uxn has a profile attached.
+ *
+ * @param uxn Pointer to the Uxn instance, with a profile attached.
+ * @param pc The vector to evaluate.
+ * @return Always false, like `uxn_eval` reaching BRK.
+ */
+bool profile_eval(Uxn *uxn, Short pc);
+
+/**
+ * @brief Print the hot spot tables to stderr and write the collapsed stacks.
+ *
+ * Does nothing if the Uxn has no profile attached.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ */
+void profile_report(Uxn *uxn);
+
+#undef T
+#endif // profile_h
@@ -0,0 +1,267 @@
+#include "snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAPSHOT_VERSION 1
+
+// Pages are saved as blocks of this many bytes, skipping the ones that are
+// all zeros
+#define SNAPSHOT_BLOCK_SIZE 0x100
+#define SNAPSHOT_BLOCKS (RAM_PAGE_SIZE / SNAPSHOT_BLOCK_SIZE)
+
+static const char magic[8] = {'U', 'X', 'N', 'S', 'N', 'A', 'P',
+                              SNAPSHOT_VERSION};
+
+bool snapshot_write(FILE *out, const void *data, size_t length) {
+  return fwrite(data, 1, length, out) == length;
+}
+
+bool snapshot_write_byte(FILE *out, Byte value) {
+  return fputc(value, out) != EOF;
+}
+
+bool snapshot_write_short(FILE *out, Short value) {
+  Byte bytes[2] = {value >> 8, value};
+  return snapshot_write(out, bytes, sizeof(bytes));
+}
+
+bool snapshot_write_long(FILE *out, uint32_t value) {
+  Byte bytes[4] = {value >> 24, value >> 16, value >> 8, value};
+  return snapshot_write(out, bytes, sizeof(bytes));
+}
+
+bool snapshot_read(FILE *in, void *data, size_t length) {
+  return fread(data, 1, length, in) == length;
+}
+
+bool snapshot_read_byte(FILE *in, Byte *value) {
+  return snapshot_read(in, value, 1);
+}
+
+bool snapshot_read_short(FILE *in, Short *value) {
+  Byte bytes[2];
+  if (!snapshot_read(in, bytes, sizeof(bytes)))
+    return false;
+  *value = bytes[0] << 8 | bytes[1];
+  return true;
+}
+
+bool snapshot_read_long(FILE *in, uint32_t *value) {
+  Byte bytes[4];
+  if (!snapshot_read(in, bytes, sizeof(bytes)))
+    return false;
+  *value = (uint32_t)bytes[0] << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+  return true;
+}
+
+// Saving
+
+typedef bool (*SectionWriter)(Uxn *uxn, FILE *out, const void *context);
+
+// Writes a section, going back to fill in its length once the writer is done
+static bool write_section(Uxn *uxn, FILE *out, const char tag[4],
+                          SectionWriter writer, const void *context) {
+  if (!snapshot_write(out, tag, 4) || !snapshot_write_long(out, 0))
+    return false;
+
+  off_t start = ftello(out);
+  if (start < 0 || !writer(uxn, out, context))
+    return false;
+  off_t end = ftello(out);
+
+  return end >= 0 && fseeko(out, start - 4, SEEK_SET) == 0 &&
+         snapshot_write_long(out, end - start) &&
+         fseeko(out, end, SEEK_SET) == 0;
+}
+
+static bool write_stacks(Uxn *uxn, FILE *out, const void *context) {
+  (void)context;
+  return snapshot_write(out, uxn->work.data, STACK_SIZE) &&
+         snapshot_write_byte(out, uxn->work.ptr) &&
+         snapshot_write(out, uxn->ret.data, STACK_SIZE) &&
+         snapshot_write_byte(out, uxn->ret.ptr);
+}
+
+static bool write_devices(Uxn *uxn, FILE *out, const void *context) {
+  (void)context;
+  return snapshot_write(out, uxn->dev, DEV_PAGE_SIZE);
+}
+
+static bool write_page(Uxn *uxn, FILE *out, const void *context) {
+  Short page = *(const Short *)context;
+  const Byte *memory = uxn_page_memory(uxn, page);
+
+  Byte used[SNAPSHOT_BLOCKS / 8] = {0};
+  for (int block = 0; block < SNAPSHOT_BLOCKS; block++) {
+    const Byte *data = memory + block * SNAPSHOT_BLOCK_SIZE;
+    for (int i = 0; i < SNAPSHOT_BLOCK_SIZE; i++) {
+      if (data[i]) {
+        used[block / 8] |= 0x80 >> (block % 8);
+        break;
+      }
+    }
+  }
+
+  if (!snapshot_write_short(out, page) ||
+      !snapshot_write(out, used, sizeof(used)))
+    return false;
+
+  for (int block = 0; block < SNAPSHOT_BLOCKS; block++) {
+    if (used[block / 8] & (0x80 >> (block % 8)) &&
+        !snapshot_write(out, memory + block * SNAPSHOT_BLOCK_SIZE,
+                        SNAPSHOT_BLOCK_SIZE))
+      return false;
+  }
+  return true;
+}
+
+static bool write_device(Uxn *uxn, FILE *out, const void *context) {
+  const SnapshotDevice *device = context;
+  return device->save(uxn, out);
+}
+
+static bool page_is_zero(const Byte *memory) {
+  for (size_t i = 0; i < RAM_PAGE_SIZE; i++) {
+    if (memory[i])
+      return false;
+  }
+  return true;
+}
+
+bool uxn_snapshot_save(Uxn *uxn, const char *path,
+                       const SnapshotDevice devices[], size_t count) {
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    perror(path);
+    return false;
+  }
+
+  bool ok = snapshot_write(out, magic, sizeof(magic)) &&
+            write_section(uxn, out, "STKS", write_stacks, NULL) &&
+            write_section(uxn, out, "DEVS", write_devices, NULL);
+
+  for (Short page = 0; ok && page < RAM_PAGES; page++) {
+    const Byte *memory = uxn_page_memory(uxn, page);
+    if (memory && !page_is_zero(memory))
+      ok = write_section(uxn, out, "PAGE", write_page, &page);
+  }
+
+  for (size_t i = 0; ok && i < count; i++) {
+    ok = write_section(uxn, out, devices[i].tag, write_device, &devices[i]);
+  }
+
+  ok = fclose(out) == 0 && ok;
+  if (!ok)
+    perror(path);
+  return ok;
+}
+
+// Loading
+
+static bool read_stacks(Uxn *uxn, FILE *in, uint32_t length) {
+  return length == 2 * (STACK_SIZE + 1) &&
+         snapshot_read(in, uxn->work.data, STACK_SIZE) &&
+         snapshot_read_byte(in, &uxn->work.ptr) &&
+         snapshot_read(in, uxn->ret.data, STACK_SIZE) &&
+         snapshot_read_byte(in, &uxn->ret.ptr);
+}
+
+static bool read_devices(Uxn *uxn, FILE *in, uint32_t length) {
+  return length == DEV_PAGE_SIZE && snapshot_read(in, uxn->dev, DEV_PAGE_SIZE);
+}
+
+static bool read_page(Uxn *uxn, FILE *in, uint32_t length, Byte *memory) {
+  Short page;
+  Byte used[SNAPSHOT_BLOCKS / 8];
+  if (length < 2 + sizeof(used) || !snapshot_read_short(in, &page) ||
+      page >= RAM_PAGES || !snapshot_read(in, used, sizeof(used)))
+    return false;
+
+  memset(memory, 0, RAM_PAGE_SIZE);
+  uint32_t blocks = 0;
+  for (int block = 0; block < SNAPSHOT_BLOCKS; block++) {
+    if (!(used[block / 8] & (0x80 >> (block % 8))))
+      continue;
+    if (!snapshot_read(in, memory + block * SNAPSHOT_BLOCK_SIZE,
+                       SNAPSHOT_BLOCK_SIZE))
+      return false;
+    blocks++;
+  }
+  if (length != 2 + sizeof(used) + blocks * SNAPSHOT_BLOCK_SIZE)
+    return false;
+
+  uxn_page_load(uxn, memory, RAM_PAGE_SIZE, page, 0);
+  return true;
+}
+
+static const SnapshotDevice *find_device(const char tag[4],
+                                         const SnapshotDevice devices[],
+                                         size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (memcmp(devices[i].tag, tag, 4) == 0)
+      return &devices[i];
+  }
+  return NULL;
+}
+
+bool uxn_snapshot_load(Uxn *uxn, const char *path,
+                       const SnapshotDevice devices[], size_t count) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    return false;
+  }
+
+  char header[sizeof(magic)];
+  if (!snapshot_read(in, header, sizeof(header)) ||
+      memcmp(header, magic, sizeof(magic)) != 0) {
+    fprintf(stderr, "%s: not a snapshot\n", path);
+    fclose(in);
+    return false;
+  }
+
+  // Pages missing from the file are all zeros
+  uxn_mem_zero(uxn, false);
+  Byte *memory = malloc(RAM_PAGE_SIZE);
+
+  bool ok = true;
+  bool stacks = false, devs = false;
+  char tag[4];
+  uint32_t length;
+  size_t got;
+  // The file may only end between sections
+  while (ok && (got = fread(tag, 1, sizeof(tag), in)) > 0) {
+    if (got < sizeof(tag) || !snapshot_read_long(in, &length)) {
+      ok = false;
+      break;
+    }
+    off_t start = ftello(in);
+
+    const SnapshotDevice *device = find_device(tag, devices, count);
+    if (memcmp(tag, "STKS", 4) == 0)
+      ok = stacks = read_stacks(uxn, in, length);
+    else if (memcmp(tag, "DEVS", 4) == 0)
+      ok = devs = read_devices(uxn, in, length);
+    else if (memcmp(tag, "PAGE", 4) == 0)
+      ok = read_page(uxn, in, length, memory);
+    else if (device)
+      ok = device->load(uxn, in, length);
+
+    // Also skips sections nobody knows
+    ok = ok && start >= 0 && fseeko(in, start + length, SEEK_SET) == 0;
+  }
+
+  // Seeking past the end of the file succeeds, so a section that runs past it
+  // is only caught here
+  off_t end = ftello(in);
+  ok = ok && !ferror(in) && end >= 0 && fseeko(in, 0, SEEK_END) == 0 &&
+       ftello(in) == end;
+  // The VM can't run without its stacks and devices
+  ok = ok && stacks && devs;
+
+  free(memory);
+  fclose(in);
+  if (!ok)
+    fprintf(stderr, "%s: damaged snapshot\n", path);
+  return ok;
+}
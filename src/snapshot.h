@@ -0,0 +1,90 @@
+#include "common.h"
+#include "uxn.h"
+#include <stdio.h>
+
+#ifndef snapshot_h
+#define snapshot_h
+
+/**
+ * Snapshots hold the whole state of a VM, so a ROM can carry on from where
+ * the snapshot was taken instead of running its reset vector again.
+ *
+ * The file is the magic `UXNSNAP` and a version byte, followed by sections.
+ * Every section is a four character tag, a 32-bit length and that many bytes,
+ * and every number in the file is big-endian, like Uxn's own. The VM itself
+ * is saved as:
+ *
+ * - `STKS`: both stacks, 256 bytes and the pointer each, work stack first.
+ * - `DEVS`: the device page.
+ * - `PAGE`: one per page that isn't all zeros. The page number, a bitmap with
+ *   a bit for each 256 byte block of the page, most significant bit first,
+ *   and then only the blocks whose bit is set.
+ *
+ * Devices add sections of their own after those, see SnapshotDevice.
+ * Loading skips the sections it doesn't know, and fails when the file ends
+ * partway through a section or has no `STKS` or `DEVS`.
+ */
+
+/**
+ * State a device keeps outside the device page, saved as its own section.
+ */
+typedef struct SnapshotDevice {
+  // Tag of the device's section
+  char tag[4];
+  /**
+   * @brief Write the device's state with the snapshot_write functions.
+   *
+   * @return false when writing failed.
+   */
+  bool (*save)(Uxn *uxn, FILE *out);
+  /**
+   * @brief Read back the state written by save. Called once the VM's own
+   * sections are loaded.
+   *
+   * @param length Length of the section.
+   * @return false when the section couldn't be read or makes no sense.
+   */
+  bool (*load)(Uxn *uxn, FILE *in, uint32_t length);
+} SnapshotDevice;
+
+/**
+ * @brief Save the state of a VM and its devices to a file.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param path File to write.
+ * @param devices Devices to save, in the order they are loaded back.
+ * @param count Number of devices.
+ * @return false, after printing why, when the file couldn't be written.
+ */
+bool uxn_snapshot_save(Uxn *uxn, const char *path,
+                       const SnapshotDevice devices[], size_t count);
+
+/**
+ * @brief Replace the state of a VM and its devices with a saved one.
+ *
+ * Memory, stacks and the device page are replaced whole, devices only when
+ * the file has a section for them.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param path File to read.
+ * @param devices Devices to load.
+ * @param count Number of devices.
+ * @return false, after printing why, when the file couldn't be read. The VM
+ * may have been partly loaded by then.
+ */
+bool uxn_snapshot_load(Uxn *uxn, const char *path,
+                       const SnapshotDevice devices[], size_t count);
+
+// Reading and writing section contents
+
+bool snapshot_write(FILE *out, const void *data, size_t length);
+bool snapshot_write_byte(FILE *out, Byte value);
+bool snapshot_write_short(FILE *out, Short value);
+bool snapshot_write_long(FILE *out, uint32_t value);
+
+bool snapshot_read(FILE *in, void *data, size_t length);
+bool snapshot_read_byte(FILE *in, Byte *value);
+bool snapshot_read_short(FILE *in, Short *value);
+bool snapshot_read_long(FILE *in, uint32_t *value);
+
+#endif // snapshot_h
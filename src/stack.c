@@ -3,18 +3,13 @@
 
 #include "stack.h"
 
-struct Stack {
-  Byte data[STACK_SIZE];
-  Byte ptr;
-};
-
 /**
- * Pointer movement with circular bounds.
+ * Pointer movement with circular bounds, the Byte pointer wraps on overflow.
  */
 
-void increment_ptr(Stack *stack) { stack->ptr = (stack->ptr + 1) % STACK_SIZE; }
+void increment_ptr(Stack *stack) { stack->ptr++; }
 
-void decrement_ptr(Stack *stack) { stack->ptr = (stack->ptr - 1) % STACK_SIZE; }
+void decrement_ptr(Stack *stack) { stack->ptr--; }
 
 void Stack_zero(Stack *stack) {
   for (int i = 0; i < 0x100; i++) {
@@ -63,7 +58,7 @@ Byte Stack_pop(Stack *stack) {
 }
 
 Byte Stack_peek_offset(Stack *stack, Byte offset) {
-  Byte index = (stack->ptr - (offset + 1)) % STACK_SIZE;
+  Byte index = stack->ptr - (offset + 1);
   return stack->data[index];
 }
 
@@ -7,6 +7,18 @@
 
 typedef struct T T;
 
+/**
+ * The stack is a ring of 256 bytes indexed by a Byte, so the pointer wraps
+ * around on its own. The layout is public so that the stacks can be embedded
+ * in other structures and pushed to without a function call.
+ */
+struct T {
+  Byte data[STACK_SIZE];
+  Byte ptr;
+};
+
+_Static_assert(STACK_SIZE == 0x100, "Stack pointer wrap relies on Byte overflow");
+
 // Lifetime management
 
 /**
@@ -1,50 +1,70 @@
 #include "uxn.h"
+#include "code.h"
+#include "fuse.h"
+#include "jit.h"
 #include "ops.h"
+#include "profile.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define PAGE_ADDR(page, addr)                                                  \
-  ((page) * RAM_PAGE_SIZE + (addr))
+  ((size_t)(page) * RAM_PAGE_SIZE + (addr))
 
-bool is_keep_mode(Byte op) { return (op & 0x80) == 0x80; }
+// Returns a bank to zeros, forgetting any file it was still to be read from
+static void free_bank(Uxn *uxn, size_t page) {
+  free(uxn->banks[page]);
+  uxn->banks[page] = NULL;
 
-bool is_return_mode(Byte op) { return (op & 0x40) == 0x40; }
-
-bool is_short_mode(Byte op) { return (op & 0x20) == 0x20; }
-
-Byte opcode(Byte op) { return op & 0x1f; }
+  UxnFileBank *file = &uxn->file_banks[page];
+  if (file->fd >= 0)
+    close(file->fd);
+  file->fd = -1;
+}
 
-struct Uxn {
-  Byte ram[RAM_PAGE_SIZE * RAM_PAGES];
-  Byte dev[DEV_PAGE_SIZE];
-  Stack *work;
-  Stack *ret;
-  void *screen;
-  void *open_files;
-};
+static void free_banks(Uxn *uxn) {
+  for (int page = 1; page < RAM_PAGES; page++) {
+    free_bank(uxn, page);
+  }
+}
 
 void uxn_init(Uxn *uxn, void *screen) {
   if (uxn) {
     *uxn = (Uxn){.ram = {0},
+                 .banks = {NULL},
                  .dev = {0},
-                 .work = Stack_new(),
-                 .ret = Stack_new(),
+                 .dei = {NULL},
+                 .deo = {NULL},
+                 .work = {.ptr = 0, .data = {0}},
+                 .ret = {.ptr = 0, .data = {0}},
                  .screen = screen,
-                 .open_files = NULL};
+                 .open_files = NULL,
+                 .profile = NULL,
+                 .jit = NULL,
+                 .fused = uxn_fused_none,
+                 .code_generations = {0},
+                 .code_watchers = {0},
+                 .instructions = 0,
+                 .dispatches = 0};
+    for (int page = 0; page < RAM_PAGES; page++) {
+      uxn->file_banks[page].fd = -1;
+    }
   }
 }
 
 void uxn_destroy(Uxn *uxn) {
   if (uxn) {
-    for (int i = 0; i < RAM_PAGE_SIZE * RAM_PAGES; i++) {
-      uxn->ram[i] = 0;
-    }
-    for (int i = 0; i < DEV_PAGE_SIZE; i++) {
-      uxn->dev[i] = 0;
-    }
-    Stack_delete(uxn->work);
-    Stack_delete(uxn->ret);
+    memset(uxn->ram, 0, sizeof(uxn->ram));
+    free_banks(uxn);
+    memset(uxn->dev, 0, sizeof(uxn->dev));
+    Stack_destroy(&uxn->work);
+    Stack_destroy(&uxn->ret);
+    uxn_fuse_free(uxn);
+#ifdef UXN_JIT
+    jit_delete(uxn->jit);
+    uxn->jit = NULL;
+#endif
   }
 }
 
@@ -53,6 +73,9 @@ void *uxn_get_screen(Uxn *uxn) { return uxn->screen; }
 void *uxn_get_open_files(Uxn *uxn) { return uxn->open_files; }
 void uxn_set_open_files(Uxn *uxn, void *files) { uxn->open_files = files; }
 
+void *uxn_get_profile(Uxn *uxn) { return uxn->profile; }
+void uxn_set_profile(Uxn *uxn, void *profile) { uxn->profile = profile; }
+
 Uxn *uxn_new(void *screen) {
   Uxn *uxn = malloc(sizeof(Uxn));
   uxn_init(uxn, screen);
@@ -66,83 +89,220 @@ void uxn_delete(Uxn *uxn) {
   }
 }
 
-// Stack operations
+// Memory operations
+
+// Reads length bytes of the file at offset into memory at addr, and zeros
+// the rest of the page
+static bool read_page(Byte *memory, size_t addr, int fd, off_t offset,
+                      size_t length) {
+  size_t done = 0;
+  while (done < length) {
+    ssize_t got =
+        pread(fd, &memory[addr + done], length - done, offset + done);
+    if (got <= 0)
+      break;
+    done += got;
+  }
 
-void uxn_stack_zero(Uxn *uxn) {
-  Stack_set_ptr(uxn->work, 0);
-  Stack_set_ptr(uxn->ret, 0);
+  memset(&memory[addr + done], 0, RAM_PAGE_SIZE - addr - done);
+  return done == length;
 }
 
-Byte uxn_work_ptr(Uxn *uxn) { return Stack_get_ptr(uxn->work); }
+// Reads a bank loaded by uxn_page_load_file on its first access. Where the
+// file has shrunk since, the bank is zeros. Returns NULL, leaving the bank to
+// be read on a later access, when there's no memory for it.
+static Byte *read_file_bank(Uxn *uxn, size_t page) {
+  Byte *memory = malloc(RAM_PAGE_SIZE);
+  if (!memory)
+    return NULL;
+
+  UxnFileBank *file = &uxn->file_banks[page];
+  read_page(memory, 0, file->fd, file->offset, file->length);
+  uxn->banks[page] = memory;
+
+  close(file->fd);
+  file->fd = -1;
+  return memory;
+}
 
-Byte uxn_ret_ptr(Uxn *uxn) { return Stack_get_ptr(uxn->ret); }
+// Finds the page holding a byte of memory, allocating it when asked to.
+// Returns NULL for pages past the end of memory, for pages that were never
+// written or loaded when not asked to allocate them, and when there's no
+// memory for the page.
+static Byte *page_memory(Uxn *uxn, size_t index, bool allocate) {
+  size_t page = index / RAM_PAGE_SIZE;
+
+  if (page == 0)
+    return uxn->ram;
+  if (page >= RAM_PAGES)
+    return NULL;
+  if (!uxn->banks[page] && uxn->file_banks[page].fd >= 0)
+    return read_file_bank(uxn, page);
+  if (!uxn->banks[page] && allocate)
+    uxn->banks[page] = calloc(RAM_PAGE_SIZE, 1);
+  return uxn->banks[page];
+}
 
-void uxn_set_work_ptr(Uxn *uxn, Byte ptr) { Stack_set_ptr(uxn->work, ptr); }
+const Byte *uxn_page_memory(Uxn *uxn, size_t page) {
+  return page_memory(uxn, PAGE_ADDR(page, 0), false);
+}
 
-void uxn_set_ret_ptr(Uxn *uxn, Byte ptr) { Stack_set_ptr(uxn->ret, ptr); }
+Byte uxn_page_read(Uxn *uxn, Short page, size_t addr) {
+  size_t index = PAGE_ADDR(page, addr);
+  Byte *memory = page_memory(uxn, index, false);
+  return memory ? memory[index % RAM_PAGE_SIZE] : 0;
+}
 
-void uxn_push_work(Uxn *uxn, Byte value) { Stack_push(uxn->work, value); }
+bool uxn_page_load(Uxn *uxn, Byte program[], unsigned long size, size_t page,
+                   size_t addr) {
+  size_t index = PAGE_ADDR(page, addr);
+
+  while (size > 0) {
+    Byte *memory = page_memory(uxn, index, true);
+    if (!memory)
+      return false;
+
+    size_t offset = index % RAM_PAGE_SIZE;
+    unsigned long length = RAM_PAGE_SIZE - offset;
+    if (length > size)
+      length = size;
+    memcpy(&memory[offset], program, length);
+    if (memory == uxn->ram) {
+      uxn_code_loaded(uxn, offset, length);
+    }
 
-Byte uxn_pop_work(Uxn *uxn) { return Stack_pop(uxn->work); }
+    program += length;
+    size -= length;
+    index += length;
+  }
+  return true;
+}
 
-Byte uxn_peek_work_offset(Uxn *uxn, Byte offset) {
-  return Stack_peek_offset(uxn->work, offset);
+void uxn_page_write(Uxn *uxn, Short page, size_t addr, Byte value) {
+  size_t index = PAGE_ADDR(page, addr);
+  Byte *memory = page_memory(uxn, index, true);
+  if (!memory)
+    return;
+
+  memory[index % RAM_PAGE_SIZE] = value;
+  if (memory == uxn->ram) {
+    uxn_code_written(uxn, index, 1);
+  }
 }
 
-Byte uxn_peek_work(Uxn *uxn) { return Stack_peek(uxn->work); }
+bool uxn_page_load_file(Uxn *uxn, size_t page, size_t addr, int fd,
+                        off_t offset, size_t length) {
+  if (page >= RAM_PAGES)
+    return false;
 
-void uxn_push_ret(Uxn *uxn, Byte value) { Stack_push(uxn->ret, value); }
+  if (page == 0) {
+    bool ok = read_page(uxn->ram, addr, fd, offset, length);
+    uxn_code_loaded(uxn, addr, RAM_PAGE_SIZE - addr);
+    return ok;
+  }
 
-Byte uxn_pop_ret(Uxn *uxn) { return Stack_pop(uxn->ret); }
+  // Whole banks are read on their first access, from a descriptor of our own
+  // as the caller closes theirs
+  free_bank(uxn, page);
+  int copy = addr == 0 ? dup(fd) : -1;
+  if (copy >= 0) {
+    uxn->file_banks[page] = (UxnFileBank){copy, offset, length};
+    return true;
+  }
 
-Byte uxn_peek_ret(Uxn *uxn) { return Stack_peek(uxn->ret); }
+  Byte *memory = calloc(RAM_PAGE_SIZE, 1);
+  if (!memory)
+    return false;
+  uxn->banks[page] = memory;
+  return read_page(memory, addr, fd, offset, length);
+}
 
-void uxn_push(Uxn *uxn, Byte value, bool to_return_stack) {
-  if (to_return_stack) {
-    uxn_push_ret(uxn, value);
-  } else {
-    uxn_push_work(uxn, value);
+void uxn_page_fill(Uxn *uxn, Short page, Short addr, Short length,
+                   Byte value) {
+  Byte *memory = page_memory(uxn, PAGE_ADDR(page, 0), true);
+  if (!memory)
+    return;
+
+  // At most two spans, the second starting over at the bottom of the page
+  while (length > 0) {
+    Short span = length;
+    if (span > RAM_PAGE_SIZE - addr)
+      span = RAM_PAGE_SIZE - addr;
+
+    memset(&memory[addr], value, span);
+    if (page == 0) {
+      uxn_code_written(uxn, addr, span);
+    }
+
+    length -= span;
+    addr += span;
   }
 }
 
-Byte uxn_pop(Uxn *uxn, bool from_return_stack) {
-  if (from_return_stack) {
-    return uxn_pop_ret(uxn);
+// Copies one span that stays within both pages, byte by byte in the given
+// direction where the spans overlap the wrong way for memmove to give the
+// same result
+static void copy_span(Byte *dst, const Byte *src, size_t length,
+                      bool backwards, bool same_page) {
+  bool smears = same_page && (backwards ? src > dst && src < dst + length
+                                        : dst > src && dst < src + length);
+  if (!smears) {
+    memmove(dst, src, length);
+  } else if (backwards) {
+    for (size_t i = length; i-- > 0;)
+      dst[i] = src[i];
   } else {
-    return uxn_pop_work(uxn);
+    for (size_t i = 0; i < length; i++)
+      dst[i] = src[i];
   }
 }
 
-Short uxn_pop_short(Uxn *uxn, bool from_return_stack) {
-  Byte low = uxn_pop(uxn, from_return_stack);
-  Byte high = uxn_pop(uxn, from_return_stack);
-  return (high << 8) | low;
-}
-
-void uxn_push_short(Uxn *uxn, Short value, bool to_return_stack) {
-  uxn_push(uxn, value >> 8, to_return_stack);
-  uxn_push(uxn, value & 0xff, to_return_stack);
-}
-
-// Memory operations
-
-Byte uxn_page_read(Uxn *uxn, Short page, size_t addr) {
-  return uxn->ram[PAGE_ADDR(page, addr)];
-}
+void uxn_page_copy(Uxn *uxn, Short dst_page, Short dst_addr, Short src_page,
+                   Short src_addr, Short length, bool backwards) {
+  Byte *dst = page_memory(uxn, PAGE_ADDR(dst_page, 0), true);
+  if (!dst)
+    return;
+  // Missing source pages read as zeros
+  Byte *src = page_memory(uxn, PAGE_ADDR(src_page, 0), false);
+
+  // Either address can wrap, so the copy splits into at most three spans,
+  // taken in the order the bytes would be copied one at a time
+  Short done = 0;
+  while (done < length) {
+    Short left = length - done;
+    Short from = backwards ? src_addr + length - done - 1 : src_addr + done;
+    Short to = backwards ? dst_addr + length - done - 1 : dst_addr + done;
+
+    // Bytes available before either address reaches the end of its page in
+    // the direction of the copy
+    size_t src_room = backwards ? from + 1 : RAM_PAGE_SIZE - from;
+    size_t dst_room = backwards ? to + 1 : RAM_PAGE_SIZE - to;
+    Short span = left;
+    if (span > src_room)
+      span = src_room;
+    if (span > dst_room)
+      span = dst_room;
+
+    Short src_start = backwards ? from - span + 1 : from;
+    Short dst_start = backwards ? to - span + 1 : to;
+    if (src)
+      copy_span(&dst[dst_start], &src[src_start], span, backwards,
+                src == dst);
+    else
+      memset(&dst[dst_start], 0, span);
+    if (dst == uxn->ram) {
+      uxn_code_written(uxn, dst_start, span);
+    }
 
-void uxn_page_load(Uxn *uxn, Byte program[], unsigned long size, size_t page,
-                   size_t addr) {
-  size_t idx = PAGE_ADDR(page, addr);
-  memcpy(&uxn->ram[idx], program, size);
+    done += span;
+  }
 }
 
-void uxn_page_write(Uxn *uxn, Short page, size_t addr, Byte value) {
-  uxn->ram[PAGE_ADDR(page, addr)] = value;
-}
 void uxn_mem_zero(Uxn *uxn, bool soft) {
-  for (int i = (soft ? RESET_VECTOR : 0); i < RAM_PAGE_SIZE * RAM_PAGES; i++) {
-    uxn->ram[i] = 0;
-  }
+  size_t start = soft ? RESET_VECTOR : 0;
+  memset(&uxn->ram[start], 0, RAM_PAGE_SIZE - start);
+  free_banks(uxn);
+  uxn_code_loaded(uxn, 0, RAM_PAGE_SIZE);
 }
 
 void uxn_mem_load(Uxn *uxn, Byte program[], unsigned long size, size_t addr) {
@@ -152,7 +312,13 @@ void uxn_mem_load(Uxn *uxn, Byte program[], unsigned long size, size_t addr) {
 Byte uxn_mem_read(Uxn *uxn, size_t addr) { return uxn->ram[PAGE_ADDR(0, addr) & (RAM_PAGE_SIZE - 1)]; }
 
 void uxn_mem_buffer_read(Uxn *uxn, Short size, Byte buffer[size], size_t addr) {
-  memcpy(buffer, &uxn->ram[addr], size);
+  // Wraps around the end of page 0, like every other access to it
+  addr &= RAM_PAGE_SIZE - 1;
+  size_t first = RAM_PAGE_SIZE - addr;
+  if (first > size)
+    first = size;
+  memcpy(buffer, &uxn->ram[addr], first);
+  memcpy(buffer + first, uxn->ram, size - first);
 }
 
 Short uxn_mem_read_short(Uxn *uxn, size_t addr) {
@@ -161,11 +327,13 @@ Short uxn_mem_read_short(Uxn *uxn, size_t addr) {
 
 void uxn_mem_write(Uxn *uxn, size_t addr, Byte value) {
   uxn->ram[PAGE_ADDR(0, addr) & (RAM_PAGE_SIZE - 1)] = value;
+  uxn_code_written(uxn, addr, 1);
 }
 
 void uxn_mem_write_short(Uxn *uxn, size_t addr, Short value) {
   uxn->ram[PAGE_ADDR(0, addr) & (RAM_PAGE_SIZE - 1)] = value >> 8;
   uxn->ram[PAGE_ADDR(0, addr + 1) & (RAM_PAGE_SIZE - 1)] = value & 0xff;
+  uxn_code_written(uxn, addr, 2);
 }
 
 Byte uxn_zero_page_read(Uxn *uxn, Byte addr) {
@@ -180,20 +348,24 @@ Short uxn_zero_page_read_short(Uxn *uxn, Byte addr) {
 
 void uxn_zero_page_write(Uxn *uxn, Byte addr, Byte value) {
   uxn->ram[addr & (RESET_VECTOR - 1)] = value;
+  uxn_code_written(uxn, addr, 1);
 }
 
 void uxn_zero_page_write_short(Uxn *uxn, Byte addr, Short value) {
   uxn->ram[addr & (RESET_VECTOR - 1)] = value >> 8;
   uxn->ram[(addr + 1) & (RESET_VECTOR - 1)] = value & 0xff;
+  // The low byte wraps around within the zero page
+  uxn_code_written(uxn, addr, 1);
+  uxn_code_written(uxn, (Byte)(addr + 1), 1);
 }
 
 // Device operations
 
-void uxn_dev_zero(Uxn *uxn) {
-  for (int i = 0; i < DEV_PAGE_SIZE; i++) {
-    uxn->dev[i] = 0;
-  }
-}
+void uxn_dev_zero(Uxn *uxn) { memset(uxn->dev, 0, sizeof(uxn->dev)); }
+
+void uxn_set_dei(Uxn *uxn, Byte addr, UxnDei dei) { uxn->dei[addr] = dei; }
+
+void uxn_set_deo(Uxn *uxn, Byte addr, UxnDeo deo) { uxn->deo[addr] = deo; }
 
 Byte uxn_dev_read(Uxn *uxn, Byte addr) { return uxn->dev[addr]; }
 
@@ -208,157 +380,169 @@ void uxn_dev_write_short(Uxn *uxn, Byte addr, Short value) {
   uxn->dev[(addr + 1) & 0xff] = (Byte)(value & 0xff);
 }
 
+// Superinstructions add the instructions they stand for beyond the first
+// themselves, see uxn_eval_fused
+#ifdef UXN_STATS
+#define COUNT_DISPATCH() (dispatches++)
+#define FLUSH_DISPATCHES()                                                     \
+  (uxn->instructions += dispatches, uxn->dispatches += dispatches)
+#else
+#define COUNT_DISPATCH()
+#define FLUSH_DISPATCHES()
+#endif
+
+#ifdef UXN_THREADED_DISPATCH
+
+/**
+ * Threaded interpreter.
+ *
+ * Every one of the 256 instruction bytes gets its own label calling the
+ * matching specialised handler, so an instruction is decoded exactly once and
+ * each label has its own indirect branch to predict. With GCC
+ * or Clang the labels are chained through a computed goto table, otherwise
+ * (or when built with UXN_NO_COMPUTED_GOTO) the same labels become the cases
+ * of a single switch.
+ */
+
+#if defined(__GNUC__) && !defined(UXN_NO_COMPUTED_GOTO)
+#define UXN_COMPUTED_GOTO
+#endif
+
+#ifdef UXN_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+#define DISPATCH() goto *dispatch_table[uxn_mem_read(uxn, pc++)]
+#define DISPATCH_BEGIN DISPATCH();
+#define DISPATCH_END
+#define NEXT                                                                   \
+  COUNT_DISPATCH();                                                         \
+  DISPATCH()
+#define OPCODE(byte, label) label:
+
+#define TABLE_ENTRY(code, name, mode, suffix, k, r, s)                         \
+  [(code) | (mode)] = &&do_##name##suffix,
+#define TABLE_MODE(mode, suffix, k, r, s)                                      \
+  UXN_MODED_OPS(TABLE_ENTRY, mode, suffix, k, r, s)
+
+#else
+
+#define DISPATCH_BEGIN                                                         \
+  for (;;) {                                                                   \
+    switch (uxn_mem_read(uxn, pc++)) {
+#define DISPATCH_END                                                           \
+  }                                                                            \
+  }
+#define NEXT                                                                   \
+  COUNT_DISPATCH();                                                         \
+  continue
+#define OPCODE(byte, label) case byte:
+
+#endif
+
+// The fuse check is only compiled into the labels that can start an idiom
+#define MODED_OPCODE(code, name, mode, suffix, k, r, s)                        \
+  OPCODE((code) | (mode), do_##name##suffix)                                   \
+  pc = UXN_FUSE_START((code) | (mode))                                         \
+           ? uxn_eval_fused(uxn, pc, op_##name##suffix)                        \
+           : op_##name##suffix(uxn, pc);                                       \
+  NEXT;
+#define MODED_OPCODES(mode, suffix, k, r, s)                                   \
+  UXN_MODED_OPS(MODED_OPCODE, mode, suffix, k, r, s)
+
 bool uxn_eval(Uxn *uxn, Short pc) {
 
   if (!pc) return 1;
 
-  bool continue_execution = true;
-
-  while (continue_execution) {
-    Byte full_op = uxn_mem_read(uxn, pc);
-    pc += 1;
-
-    Byte keep_mode = is_keep_mode(full_op);
-    Byte ret_mode = is_return_mode(full_op);
-    Byte short_mode = is_short_mode(full_op);
-    Byte op = opcode(full_op);
-
-    // Immediate ops
-    switch (full_op) {
-    case 0x00:
-      continue_execution = false;
-      continue; // BRK
-    case 0x20:
-      pc = op_jci(uxn, pc);
-      continue;
-    case 0x40:
-      pc = op_jmi(uxn, pc);
-      continue;
-    case 0x60:
-      pc = op_jsi(uxn, pc);
-      continue;
-    case 0x80:
-      pc = op_lit(uxn, pc, false, false);
-      continue;
-    case 0xa0:
-      pc = op_lit(uxn, pc, false, true);
-      continue;
-    case 0xc0:
-      pc = op_lit(uxn, pc, true, false);
-      continue;
-    case 0xe0:
-      pc = op_lit(uxn, pc, true, true);
-      continue;
-    default:
-      break;
-    }
+  // Checked once per vector so that the loops below stay untouched
+  if (uxn->profile) return profile_eval(uxn, pc);
 
-    switch (op) {
-    case 0x01:
-      pc = op_inc(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x02:
-      pc = op_pop(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x03:
-      pc = op_nip(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x04:
-      pc = op_swp(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x05:
-      pc = op_rot(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x06:
-      pc = op_dup(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x07:
-      pc = op_ovr(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x08:
-      pc = op_equ(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x09:
-      pc = op_neq(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x0a:
-      pc = op_gth(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x0b:
-      pc = op_lth(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x0c:
-      pc = op_jmp(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x0d:
-      pc = op_jcn(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x0e:
-      pc = op_jsr(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x0f:
-      pc = op_sth(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x10:
-      pc = op_ldz(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x11:
-      pc = op_stz(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x12:
-      pc = op_ldr(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x13:
-      pc = op_str(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x14:
-      pc = op_lda(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x15:
-      pc = op_sta(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x16:
-      pc = op_dei(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x17:
-      pc = op_deo(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x18:
-      pc = op_add(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x19:
-      pc = op_sub(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x1a:
-      pc = op_mul(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x1b:
-      pc = op_div(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x1c:
-      pc = op_and(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x1d:
-      pc = op_ora(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x1e:
-      pc = op_eor(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    case 0x1f:
-      pc = op_sft(uxn, pc, keep_mode, ret_mode, short_mode);
-      break;
-    default:
-      break;
-    }
+#ifdef UXN_JIT
+  return jit_eval(uxn, pc);
+#endif
+
+#ifdef UXN_STATS
+  uint64_t dispatches = 0;
+#endif
+
+#ifdef UXN_COMPUTED_GOTO
+  static void *const dispatch_table[256] = {
+      [0x00] = &&do_brk, [0x20] = &&do_jci,  [0x40] = &&do_jmi,
+      [0x60] = &&do_jsi, [0x80] = &&do_lit,  [0xa0] = &&do_lit2,
+      [0xc0] = &&do_litr, [0xe0] = &&do_lit2r,
+      UXN_OP_MODES(TABLE_MODE)};
+#endif
+
+  DISPATCH_BEGIN
+
+  // Immediate ops
+  OPCODE(0x00, do_brk)
+  FLUSH_DISPATCHES();
+  return 0;
+  OPCODE(0x20, do_jci)
+  pc = op_jci(uxn, pc);
+  NEXT;
+  OPCODE(0x40, do_jmi)
+  pc = op_jmi(uxn, pc);
+  NEXT;
+  OPCODE(0x60, do_jsi)
+  pc = op_jsi(uxn, pc);
+  NEXT;
+  OPCODE(0x80, do_lit)
+  pc = uxn_eval_fused(uxn, pc, op_lit);
+  NEXT;
+  OPCODE(0xa0, do_lit2)
+  pc = uxn_eval_fused(uxn, pc, op_lit_2);
+  NEXT;
+  OPCODE(0xc0, do_litr)
+  pc = op_lit_r(uxn, pc);
+  NEXT;
+  OPCODE(0xe0, do_lit2r)
+  pc = op_lit_r_2(uxn, pc);
+  NEXT;
+
+  UXN_OP_MODES(MODED_OPCODES)
+
+  DISPATCH_END
+}
+
+#ifdef UXN_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+#else
+
+bool uxn_eval(Uxn *uxn, Short pc) {
+
+  if (!pc) return 1;
+
+  // Checked once per vector so that the loops below stay untouched
+  if (uxn->profile) return profile_eval(uxn, pc);
+
+#ifdef UXN_JIT
+  return jit_eval(uxn, pc);
+#endif
+
+#ifdef UXN_STATS
+  uint64_t dispatches = 0;
+#endif
+
+  Byte op;
+  while ((op = uxn_mem_read(uxn, pc++))) {
+    pc = uxn_eval_ops[op](uxn, pc);
+    COUNT_DISPATCH();
   }
 
+  FLUSH_DISPATCHES();
   return 0;
 }
 
+#endif // UXN_THREADED_DISPATCH
+
 void uxn_dump(Uxn *uxn) {
   if (uxn) {
-    Stack_dump(uxn->work, "WST");
-    Stack_dump(uxn->ret, "RST");
+    Stack_dump(&uxn->work, "WST");
+    Stack_dump(&uxn->ret, "RST");
   }
 }
 
@@ -366,7 +550,7 @@ void uxn_dump_page(Uxn *uxn, Short page) {
   if (uxn) {
     printf("Page %d\n", page);
     for (size_t i = 0; i < RAM_PAGE_SIZE; i++) {
-      printf("%02x ", uxn->ram[PAGE_ADDR(page, i)]);
+      printf("%02x ", uxn_page_read(uxn, page, i));
     }
     printf("\n\n");
   }
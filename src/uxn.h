@@ -1,5 +1,6 @@
 #include "common.h"
 #include "stack.h"
+#include <sys/types.h>
 
 #ifndef uxn_h
 #define uxn_h
@@ -8,6 +9,58 @@
 
 typedef struct T T;
 
+/**
+ * Handlers for reads from and writes to one device port, see uxn_set_dei and
+ * uxn_set_deo.
+ */
+typedef Byte (*UxnDei)(T *uxn, Byte addr);
+typedef void (*UxnDeo)(T *uxn, Byte addr);
+
+/**
+ * Part of a file loaded into a bank by uxn_page_load_file, read in when the
+ * bank is first accessed.
+ */
+typedef struct UxnFileBank {
+  // The VM's own duplicate of the file descriptor, -1 when there is nothing
+  // left to read
+  int fd;
+  off_t offset;
+  size_t length;
+} UxnFileBank;
+
+struct T {
+  Stack work;
+  Stack ret;
+  Byte dev[DEV_PAGE_SIZE];
+  // Handler for each port, NULL where reading or writing the port has no
+  // side effects and DEI/DEO only touch dev
+  UxnDei dei[DEV_PAGE_SIZE];
+  UxnDeo deo[DEV_PAGE_SIZE];
+  // Page 0, which programs run from
+  Byte ram[RAM_PAGE_SIZE];
+  // Pages 1 to RAM_PAGES - 1, allocated on the first write or load into
+  // them and read as zeros until then. banks[0] is always NULL.
+  Byte *banks[RAM_PAGES];
+  // Banks loaded from a file that haven't been accessed yet
+  UxnFileBank file_banks[RAM_PAGES];
+  void *screen;
+  void *open_files;
+  void *profile;
+  // Compiled code, see jit.h
+  void *jit;
+  // Superinstruction starting at each address of page 0, see fuse.h. Shares
+  // the empty uxn_fused_none until code with an idiom in it is loaded.
+  const Byte *fused;
+  // Write generation and number of cached decodings of each code page, see
+  // code.h
+  uint32_t code_generations[CODE_PAGES];
+  uint16_t code_watchers[CODE_PAGES];
+  // Instructions executed and handlers dispatched by uxn_eval, only counted
+  // when built with UXN_STATS
+  uint64_t instructions;
+  uint64_t dispatches;
+};
+
 // Lifecycle management
 void uxn_init(T *uxn, void *screen);
 void uxn_destroy(T *uxn);
@@ -15,12 +68,21 @@ T *uxn_new(void *screen);
 void uxn_delete(T *uxn);
 
 // Stack operations
+//
+// These are defined inline here since every instruction goes through them.
+
+static inline void uxn_stack_zero(T *uxn) {
+  uxn->work.ptr = 0;
+  uxn->ret.ptr = 0;
+}
+
+static inline Byte uxn_work_ptr(T *uxn) { return uxn->work.ptr; }
+
+static inline Byte uxn_ret_ptr(T *uxn) { return uxn->ret.ptr; }
+
+static inline void uxn_set_work_ptr(T *uxn, Byte ptr) { uxn->work.ptr = ptr; }
 
-void uxn_stack_zero(T *uxn);
-Byte uxn_work_ptr(T *uxn);
-Byte uxn_ret_ptr(T *uxn);
-void uxn_set_work_ptr(T *uxn, Byte ptr);
-void uxn_set_ret_ptr(T *uxn, Byte ptr);
+static inline void uxn_set_ret_ptr(T *uxn, Byte ptr) { uxn->ret.ptr = ptr; }
 
 /**
  * Pushes a value onto the working stack of the given Uxn instance.
@@ -28,7 +90,9 @@ void uxn_set_ret_ptr(T *uxn, Byte ptr);
  * @param uxn Pointer to the Uxn instance.
  * @param value The byte value to be pushed onto the working stack.
  */
-void uxn_push_work(T *uxn, Byte value);
+static inline void uxn_push_work(T *uxn, Byte value) {
+  uxn->work.data[uxn->work.ptr++] = value;
+}
 
 /**
  * Pops a value from the working stack of the given Uxn instance.
@@ -37,7 +101,9 @@ void uxn_push_work(T *uxn, Byte value);
  *
  * @return The byte value popped from the working stack.
  */
-Byte uxn_pop_work(T *uxn);
+static inline Byte uxn_pop_work(T *uxn) {
+  return uxn->work.data[--uxn->work.ptr];
+}
 
 /**
  * Peeks at a byte from the working stack at a given offset from the top.
@@ -48,7 +114,9 @@ Byte uxn_pop_work(T *uxn);
  *
  * @return The byte value at the specified offset in the working stack.
  */
-Byte uxn_peek_work_offset(T *uxn, Byte offset);
+static inline Byte uxn_peek_work_offset(T *uxn, Byte offset) {
+  return uxn->work.data[(Byte)(uxn->work.ptr - (offset + 1))];
+}
 
 /**
  * Peeks at the top value in the working stack without removing it.
@@ -57,7 +125,7 @@ Byte uxn_peek_work_offset(T *uxn, Byte offset);
  *
  * @return The byte value at the top of the working stack.
  */
-Byte uxn_peek_work(T *uxn);
+static inline Byte uxn_peek_work(T *uxn) { return uxn_peek_work_offset(uxn, 0); }
 
 /**
  * Push a value onto the Return stack
@@ -65,7 +133,9 @@ Byte uxn_peek_work(T *uxn);
  * @param uxn Pointer to the Uxn virtual machine instance
  * @param value The byte value to push onto the Return stack
  */
-void uxn_push_ret(T *uxn, Byte value);
+static inline void uxn_push_ret(T *uxn, Byte value) {
+  uxn->ret.data[uxn->ret.ptr++] = value;
+}
 
 /**
  * Pops and returns a value from the return stack of the Uxn virtual machine.
@@ -74,7 +144,7 @@ void uxn_push_ret(T *uxn, Byte value);
  *
  * @return The byte value popped from the return stack
  */
-Byte uxn_pop_ret(T *uxn);
+static inline Byte uxn_pop_ret(T *uxn) { return uxn->ret.data[--uxn->ret.ptr]; }
 
 /**
  * Peeks at the top value in the return stack without removing it.
@@ -83,12 +153,30 @@ Byte uxn_pop_ret(T *uxn);
  *
  * @return The byte value at the top of the return stack
  */
-Byte uxn_peek_ret(T *uxn);
+static inline Byte uxn_peek_ret(T *uxn) {
+  return uxn->ret.data[(Byte)(uxn->ret.ptr - 1)];
+}
 
-void uxn_push(Uxn *uxn, Byte value, bool to_return_stack);
-Byte uxn_pop(Uxn *uxn, bool from_return_stack);
-Short uxn_pop_short(Uxn *uxn, bool from_return_stack);
-void uxn_push_short(Uxn *uxn, Short value, bool to_return_stack);
+static inline void uxn_push(T *uxn, Byte value, bool to_return_stack) {
+  Stack *stack = to_return_stack ? &uxn->ret : &uxn->work;
+  stack->data[stack->ptr++] = value;
+}
+
+static inline Byte uxn_pop(T *uxn, bool from_return_stack) {
+  Stack *stack = from_return_stack ? &uxn->ret : &uxn->work;
+  return stack->data[--stack->ptr];
+}
+
+static inline Short uxn_pop_short(T *uxn, bool from_return_stack) {
+  Byte low = uxn_pop(uxn, from_return_stack);
+  Byte high = uxn_pop(uxn, from_return_stack);
+  return (high << 8) | low;
+}
+
+static inline void uxn_push_short(T *uxn, Short value, bool to_return_stack) {
+  uxn_push(uxn, value >> 8, to_return_stack);
+  uxn_push(uxn, value & 0xff, to_return_stack);
+}
 
 // Memory operations
 
@@ -103,9 +191,60 @@ void uxn_mem_buffer_read(Uxn *uxn, Short size, Byte buffer[size],  size_t addr);
 void uxn_mem_write(T *uxn, size_t addr, Byte value);
 void uxn_mem_write_short(Uxn *uxn, size_t addr, Short value);
 
+/**
+ * Pages past RAM_PAGES read as zeros and drop writes. An address past the end
+ * of its page carries on into the next one.
+ */
 Byte uxn_page_read(T *uxn, Short page, size_t addr);
 void uxn_page_write(T *uxn, Short page, size_t addr, Byte value);
-void uxn_page_load(Uxn *uxn, Byte program[], unsigned long size, size_t page, size_t addr);
+// Returns false if part of the program was dropped, for want of memory or pages
+bool uxn_page_load(Uxn *uxn, Byte program[], unsigned long size, size_t page, size_t addr);
+
+/**
+ * Loads length bytes of an open file into a page, and zeros the rest of the
+ * page after them.
+ *
+ * Pages other than page 0 are only read from the file when addr is 0 once
+ * they are first accessed, so loading them costs the same however many there
+ * are, and banks the ROM never touches never come off the disk. The file must
+ * not change while the VM runs: a bank read after the file shrinks is zeros
+ * past its new end, and one read after it is rewritten holds the new bytes.
+ * Page 0 is always read straight away, as programs run from it.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param page Page to load into, below RAM_PAGES.
+ * @param addr Address in the page of the first byte.
+ * @param fd File to load from.
+ * @param offset Position in the file of the first byte.
+ * @param length Bytes to load, at most RAM_PAGE_SIZE - addr.
+ * @return false when the file couldn't be read or there was no memory for
+ * the page. Banks read later read as zeros where the file has come up short,
+ * and as zeros until a later access when there's no memory for them yet.
+ */
+bool uxn_page_load_file(T *uxn, size_t page, size_t addr, int fd, off_t offset,
+                        size_t length);
+
+/**
+ * Returns the memory of a page, reading it from its file first if it was
+ * loaded by uxn_page_load_file and hasn't been accessed since. NULL for pages
+ * that read as zeros and for pages past RAM_PAGES.
+ */
+const Byte *uxn_page_memory(T *uxn, size_t page);
+
+/**
+ * Sets length bytes of a page to value, wrapping around the end of the page.
+ * Does nothing for pages past RAM_PAGES.
+ */
+void uxn_page_fill(T *uxn, Short page, Short addr, Short length, Byte value);
+
+/**
+ * Copies length bytes between pages, wrapping both addresses around the end
+ * of their page. The result is the same as copying one byte at a time from
+ * the first byte, or from the last one when backwards, including when the
+ * two ranges overlap. Does nothing for destination pages past RAM_PAGES.
+ */
+void uxn_page_copy(T *uxn, Short dst_page, Short dst_addr, Short src_page,
+                   Short src_addr, Short length, bool backwards);
 
 Byte uxn_zero_page_read(Uxn *uxn, Byte addr);
 Short uxn_zero_page_read_short(Uxn *uxn, Byte addr);
@@ -120,11 +259,44 @@ void uxn_dev_write(T *uxn, Byte addr, Byte value);
 void uxn_dev_write_short(T *uxn, Byte addr, Short value);
 void uxn_dev_zero(Uxn *uxn);
 
+/**
+ * Makes DEI read a port through a handler rather than straight from the
+ * device page. Devices register the ports they compute at boot.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param addr Port to handle.
+ * @param dei Handler returning the port's value, or NULL to read dev.
+ */
+void uxn_set_dei(T *uxn, Byte addr, UxnDei dei);
+
+/**
+ * Makes DEO call a handler after writing a port to the device page.
+ *
+ * @param uxn Pointer to the Uxn instance.
+ * @param addr Port to handle.
+ * @param deo Handler acting on the written value, or NULL for none.
+ */
+void uxn_set_deo(T *uxn, Byte addr, UxnDeo deo);
+
+static inline Byte uxn_dei(T *uxn, Byte addr) {
+  UxnDei dei = uxn->dei[addr];
+  return dei ? dei(uxn, addr) : uxn->dev[addr];
+}
+
+static inline void uxn_deo(T *uxn, Byte addr) {
+  UxnDeo deo = uxn->deo[addr];
+  if (deo)
+    deo(uxn, addr);
+}
+
 void *uxn_get_screen(T *uxn);
 
 void *uxn_get_open_files(T *uxn);
 void uxn_set_open_files(T *uxn, void *files);
 
+void *uxn_get_profile(T *uxn);
+void uxn_set_profile(T *uxn, void *profile);
+
 /**
  * Evaluates the instruction at the given program counter.
  *
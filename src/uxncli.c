@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "device/console.h"
+#include "device/datetime.h"
+#include "device/file.h"
+#include "device/system.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "uxn.h"
+
+/**
+ * Headless emulator.
+ *
+ * Only the system, console, file and datetime devices are wired up, so no
+ * window or GL context is ever created. The ROM runs until its console input
+ * has been drained or it sets the System/state port.
+ */
+
+static bool halted(Uxn *uxn) { return uxn_dev_read(uxn, SYSTEM_STATE_PORT) != 0; }
+
+int main(int argc, char *argv[]) {
+
+  const char *profile_path = NULL;
+  const char *boot_snapshot = NULL;
+  const char *save_snapshot = NULL;
+
+  // Stop at the ROM so that its own arguments are passed through untouched
+  int opt;
+  while ((opt = getopt(argc, argv, "+p:b:S:")) != -1) {
+    switch (opt) {
+    case 'p':
+      profile_path = optarg;
+      break;
+    case 'b':
+      boot_snapshot = optarg;
+      break;
+    case 'S':
+      save_snapshot = optarg;
+      break;
+    default:
+      optind = argc;
+      break;
+    }
+  }
+
+  if (optind >= argc) {
+    printf("Usage: %s [-p profile.folded] [-b snapshot] [-S snapshot] <rom> "
+           "[args...]\n",
+           argv[0]);
+    return 1;
+  }
+
+  const char *rom_filename = argv[optind];
+
+  Uxn *uxn = uxn_new(NULL);
+  system_register(uxn);
+  console_register(uxn);
+  file_register(uxn);
+  datetime_register(uxn);
+
+  if (profile_path) {
+    Profile *profile = profile_new(profile_path);
+    profile_load_symbols(profile, rom_filename);
+    uxn_set_profile(uxn, profile);
+  }
+
+  // A snapshot taken after the reset vector stands in for the ROM and for
+  // running the reset vector again
+  const SnapshotDevice devices[] = {file_snapshot};
+  bool booted = boot_snapshot
+                    ? uxn_snapshot_load(uxn, boot_snapshot, devices, 1)
+                    : system_boot(uxn, (char *)rom_filename);
+  if (booted && !boot_snapshot)
+    uxn_eval(uxn, RESET_VECTOR);
+  if (booted && save_snapshot)
+    booted = uxn_snapshot_save(uxn, save_snapshot, devices, 1);
+
+  if (!booted) {
+    profile_delete(uxn_get_profile(uxn));
+    uxn_delete(uxn);
+    return 1;
+  }
+
+  for (int i = optind + 1; i < argc && !halted(uxn); i++) {
+    char *p = argv[i];
+    while (*p) {
+      console_input_event(uxn, *p++, CONSOLE_TYPE_ARG);
+    }
+    console_input_event(uxn, '\n',
+                        i == argc - 1 ? CONSOLE_TYPE_ARG_END
+                                      : CONSOLE_TYPE_ARG_SPACER);
+  }
+
+  // Only wait on stdin if the ROM is listening to the console
+  bool listening = uxn_dev_read_short(uxn, CONSOLE_VECTOR_PORT) != 0;
+
+  int c;
+  while (listening && !halted(uxn) && (c = fgetc(stdin)) != EOF) {
+    console_input_event(uxn, c, CONSOLE_TYPE_STDIN);
+  }
+
+  int status = uxn_dev_read(uxn, SYSTEM_STATE_PORT) & 0x7f;
+
+  profile_report(uxn);
+  profile_delete(uxn_get_profile(uxn));
+  uxn_delete(uxn);
+
+  return status;
+}
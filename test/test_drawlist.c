@@ -0,0 +1,207 @@
+#include "../src/common.h"
+#include "../src/device/drawlist.h"
+#include "../src/device/framebuffer.h"
+#include "../src/device/raster.h"
+#include "greatest.h"
+#include <stdlib.h>
+#include <string.h>
+
+SUITE(drawlist);
+
+TEST test_coalesce_and_cull() {
+  Framebuffer *fb = framebuffer_new(64, 64);
+  DrawList *list = drawlist_new();
+  Byte sprite[SPRITE_2BPP_BUFFER_SIZE] = {0};
+
+  // A row of tiles, then a column going up, then one off the screen
+  for (int i = 0; i < 8; i++) {
+    drawlist_sprite(list, fb, BG_LAYER, i * 8, 0, sprite, true, 1, false,
+                    false);
+  }
+  for (int i = 0; i < 4; i++) {
+    drawlist_sprite(list, fb, BG_LAYER, 0, 32 - i * 8, sprite, true, 1, false,
+                    false);
+  }
+  drawlist_sprite(list, fb, BG_LAYER, 64, 0, sprite, true, 1, false, false);
+
+  // Pixels left to right join into one fill
+  for (int x = 10; x < 20; x++) {
+    drawlist_pixel(list, fb, FG_LAYER, x, 5, 2);
+  }
+
+  ASSERT_EQ(3, list->length);
+  ASSERT_EQ(8, list->commands[0].count);
+  ASSERT_EQ(8, list->commands[0].width);
+  ASSERT_EQ(4, list->commands[1].count);
+  ASSERT_EQ(-8, list->commands[1].height);
+  ASSERT_EQ(10, list->commands[2].width);
+  ASSERT_EQ(12, list->sprites);
+  ASSERT_EQ(1, list->culled);
+
+  drawlist_flush(list, fb);
+  ASSERT_EQ(0, list->length);
+
+  drawlist_delete(list);
+  framebuffer_delete(fb);
+
+  PASS();
+}
+
+TEST test_fill_covers() {
+  Framebuffer *fb = framebuffer_new(64, 64);
+  DrawList *list = drawlist_new();
+  Byte sprite[SPRITE_1BPP_BUFFER_SIZE] = {0};
+
+  drawlist_sprite(list, fb, FG_LAYER, 0, 0, sprite, false, 1, false, false);
+  drawlist_sprite(list, fb, BG_LAYER, 8, 8, sprite, false, 1, false, false);
+  drawlist_fill(list, fb, BG_LAYER, 20, 20, 10, 10, 1);
+  // Hangs off the bottom right, covering the bg sprite and the first fill
+  drawlist_fill(list, fb, BG_LAYER, 4, 4, 100, 100, 2);
+  drawlist_fill(list, fb, BG_LAYER, 4, 4, 100, 100, 2);
+
+  ASSERT_EQ(2, list->length);
+  ASSERT_EQ(DRAW_SPRITES, list->commands[0].kind);
+  ASSERT_EQ(DRAW_FILL, list->commands[1].kind);
+  ASSERT_EQ(3, list->covered);
+  ASSERT_EQ(SPRITE_1BPP_BUFFER_SIZE, list->data_length);
+
+  drawlist_delete(list);
+  framebuffer_delete(fb);
+
+  PASS();
+}
+
+TEST test_clear_covers_everything() {
+  Framebuffer *fb = framebuffer_new(64, 64);
+  DrawList *list = drawlist_new();
+  Byte sprite[SPRITE_1BPP_BUFFER_SIZE] = {0};
+
+  // Far more commands than a fill looks back over, then a clear of the layer
+  drawlist_sprite(list, fb, FG_LAYER, 0, 0, sprite, false, 1, false, false);
+  for (int i = 0; i < 1000; i++) {
+    drawlist_fill(list, fb, BG_LAYER, i % 60, i % 50, 2, 2, 1);
+    drawlist_sprite(list, fb, BG_LAYER, i % 50, i % 60, sprite, false, 1,
+                    false, false);
+  }
+  drawlist_fill(list, fb, BG_LAYER, 0, 0, 64, 64, 0);
+
+  ASSERT_EQ(2000, list->covered);
+  ASSERT_EQ(2, list->length);
+  ASSERT_EQ(SPRITE_1BPP_BUFFER_SIZE, list->data_length);
+
+  // The next clear only has the last one to cover
+  drawlist_fill(list, fb, BG_LAYER, -8, -8, 80, 80, 0);
+  ASSERT_EQ(2001, list->covered);
+  ASSERT_EQ(2, list->length);
+  ASSERT_EQ(DRAW_SPRITES, list->commands[0].kind);
+
+  drawlist_delete(list);
+  framebuffer_delete(fb);
+
+  PASS();
+}
+
+// Draws the same random commands into `immediate` and records them in `list`
+static void random_commands(Framebuffer *immediate, DrawList *list,
+                            Framebuffer *recorded, int count) {
+  for (int i = 0; i < count; i++) {
+    DrawLayer layer = rand() & 1 ? FG_LAYER : BG_LAYER;
+    int x = rand() % (immediate->width + 16) - 8;
+    int y = rand() % (immediate->height + 16) - 8;
+    Byte color = rand();
+
+    switch (rand() % 3) {
+    case 0:
+      framebuffer_pixel(immediate, layer, x, y, color & 0x03);
+      drawlist_pixel(list, recorded, layer, x, y, color);
+      break;
+    case 1: {
+      int width = rand() % 8;
+      int height = rand() % 8;
+      framebuffer_fill(immediate, layer, x, y, width, height, color & 0x03);
+      drawlist_fill(list, recorded, layer, x, y, width, height, color);
+      break;
+    }
+    default: {
+      Byte sprite[SPRITE_2BPP_BUFFER_SIZE];
+      for (size_t j = 0; j < sizeof(sprite); j++) {
+        sprite[j] = rand();
+      }
+      // Runs of tiles as well as scattered sprites
+      if (rand() & 1) {
+        x = x / 8 * 8;
+        y = y / 8 * 8;
+      }
+      framebuffer_sprite(immediate, layer, x, y, sprite, color & 0x80,
+                         color & 0x0f, color & 0x10, color & 0x20);
+      drawlist_sprite(list, recorded, layer, x, y, sprite, color & 0x80,
+                      color & 0x0f, color & 0x10, color & 0x20);
+      break;
+    }
+    }
+  }
+}
+
+// Whether two framebuffers show the same pixels. The padding at the end of
+// each row is left out, as full row fills write it and single pixels don't.
+static bool same_pixels(Framebuffer *a, Framebuffer *b) {
+  for (int layer = BG_LAYER; layer <= FG_LAYER; layer++) {
+    for (int y = 0; y < a->height; y++) {
+      for (int x = 0; x < a->width; x++) {
+        if (framebuffer_get(a, layer, x, y) != framebuffer_get(b, layer, x, y))
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+TEST test_matches_immediate() {
+  Framebuffer *immediate = framebuffer_new(40, 30);
+  Framebuffer *recorded = framebuffer_new(40, 30);
+  DrawList *list = drawlist_new();
+  srand(7);
+
+  random_commands(immediate, list, recorded, 2000);
+  drawlist_flush(list, recorded);
+
+  ASSERT(same_pixels(immediate, recorded));
+
+  drawlist_delete(list);
+  framebuffer_delete(recorded);
+  framebuffer_delete(immediate);
+
+  PASS();
+}
+
+TEST test_rasterizer_matches_immediate() {
+  // Bands of 10 and 11 rows, which split sprites and fills
+  Framebuffer *immediate = framebuffer_new(37, 31);
+  Framebuffer *recorded = framebuffer_new(37, 31);
+  DrawList *list = drawlist_new();
+  Rasterizer *raster = rasterizer_new(3);
+  srand(11);
+
+  for (int frame = 0; frame < 4; frame++) {
+    random_commands(immediate, list, recorded, 1000);
+    rasterizer_flush(raster, list, recorded);
+  }
+
+  ASSERT(same_pixels(immediate, recorded));
+  ASSERT_EQ(0, list->length);
+
+  rasterizer_delete(raster);
+  drawlist_delete(list);
+  framebuffer_delete(recorded);
+  framebuffer_delete(immediate);
+
+  PASS();
+}
+
+SUITE(drawlist) {
+  RUN_TEST(test_coalesce_and_cull);
+  RUN_TEST(test_fill_covers);
+  RUN_TEST(test_clear_covers_everything);
+  RUN_TEST(test_matches_immediate);
+  RUN_TEST(test_rasterizer_matches_immediate);
+}
@@ -0,0 +1,129 @@
+#include "../src/common.h"
+#include "../src/device/framebuffer.h"
+#include "greatest.h"
+
+SUITE(framebuffer);
+
+TEST test_sprite_1bpp() {
+  Framebuffer *fb = framebuffer_new(10, 10);
+  // Top row set, the rest of the sprite clear
+  Byte sprite[SPRITE_1BPP_BUFFER_SIZE] = {0xff};
+
+  // Colour 1 draws set pixels with index 1 and clears the others to 0
+  framebuffer_fill(fb, BG_LAYER, 0, 0, 10, 10, 3);
+  framebuffer_sprite(fb, BG_LAYER, 4, 4, sprite, false, 0x01, false, false);
+
+  ASSERT_EQ(1, framebuffer_get(fb, BG_LAYER, 4, 4));
+  ASSERT_EQ(1, framebuffer_get(fb, BG_LAYER, 9, 4));
+  ASSERT_EQ(0, framebuffer_get(fb, BG_LAYER, 4, 5));
+  ASSERT_EQ(3, framebuffer_get(fb, BG_LAYER, 3, 4));
+
+  // Colour 5 leaves the clear pixels alone, and flip_y moves the top row down
+  framebuffer_sprite(fb, BG_LAYER, 0, 0, sprite, false, 0x05, false, true);
+
+  ASSERT_EQ(1, framebuffer_get(fb, BG_LAYER, 0, 7));
+  ASSERT_EQ(3, framebuffer_get(fb, BG_LAYER, 0, 0));
+
+  framebuffer_delete(fb);
+
+  PASS();
+}
+
+TEST test_sprite_2bpp_flip_x() {
+  Framebuffer *fb = framebuffer_new(8, 8);
+  // Leftmost pixel uses sprite colour 1, the next one colour 2
+  Byte sprite[SPRITE_2BPP_BUFFER_SIZE] = {0x80};
+  sprite[SPRITE_BUFFER_SIZE] = 0x40;
+
+  framebuffer_sprite(fb, FG_LAYER, 0, 0, sprite, true, 0x01, true, false);
+
+  ASSERT_EQ(1, framebuffer_get(fb, FG_LAYER, 7, 0));
+  ASSERT_EQ(2, framebuffer_get(fb, FG_LAYER, 6, 0));
+  ASSERT_EQ(0, framebuffer_get(fb, FG_LAYER, 0, 0));
+
+  framebuffer_delete(fb);
+
+  PASS();
+}
+
+TEST test_composite_palette() {
+  Framebuffer *fb = framebuffer_new(3, 1);
+  uint32_t pixels[3];
+  uint32_t palette[4] = {10, 11, 12, 13};
+
+  framebuffer_pixel(fb, BG_LAYER, 0, 0, 2);
+  framebuffer_pixel(fb, BG_LAYER, 1, 0, 2);
+  framebuffer_pixel(fb, FG_LAYER, 1, 0, 3);
+  // Off the edge
+  framebuffer_pixel(fb, FG_LAYER, 3, 0, 3);
+
+  framebuffer_composite(fb, palette, (FramebufferRect){0, 0, 3, 1}, pixels);
+
+  ASSERT_EQ(12, pixels[0]);
+  ASSERT_EQ(13, pixels[1]);
+  ASSERT_EQ(10, pixels[2]);
+
+  // Already drawn pixels pick up a new palette
+  palette[2] = 20;
+  framebuffer_composite(fb, palette, (FramebufferRect){0, 0, 3, 1}, pixels);
+
+  ASSERT_EQ(20, pixels[0]);
+
+  framebuffer_delete(fb);
+
+  PASS();
+}
+
+TEST test_indices() {
+  Framebuffer *fb = framebuffer_new(6, 2);
+  Byte indices[4];
+
+  framebuffer_pixel(fb, BG_LAYER, 4, 1, 2);
+  framebuffer_pixel(fb, FG_LAYER, 4, 1, 3);
+  framebuffer_pixel(fb, BG_LAYER, 5, 1, 1);
+
+  // Straddles the byte boundary between pixels 3 and 4
+  framebuffer_indices(fb, (FramebufferRect){3, 1, 3, 1}, indices);
+
+  ASSERT_EQ(0x00, indices[0]);
+  ASSERT_EQ(0x0e, indices[1]);
+  ASSERT_EQ(0x01, indices[2]);
+
+  framebuffer_delete(fb);
+
+  PASS();
+}
+
+TEST test_dirty_rect() {
+  Framebuffer *fb = framebuffer_new(16, 16);
+  Byte sprite[SPRITE_1BPP_BUFFER_SIZE] = {0};
+
+  FramebufferRect dirty = framebuffer_dirty(fb);
+  ASSERT_EQ(16, dirty.width);
+  ASSERT_EQ(16, dirty.height);
+
+  framebuffer_clean(fb);
+  dirty = framebuffer_dirty(fb);
+  ASSERT_EQ(0, dirty.width);
+
+  // Clipped to the framebuffer, and grown across both layers
+  framebuffer_sprite(fb, BG_LAYER, -4, 2, sprite, false, 0x01, false, false);
+  framebuffer_pixel(fb, FG_LAYER, 9, 12, 1);
+  dirty = framebuffer_dirty(fb);
+  ASSERT_EQ(0, dirty.x);
+  ASSERT_EQ(2, dirty.y);
+  ASSERT_EQ(10, dirty.width);
+  ASSERT_EQ(11, dirty.height);
+
+  framebuffer_delete(fb);
+
+  PASS();
+}
+
+SUITE(framebuffer) {
+  RUN_TEST(test_sprite_1bpp);
+  RUN_TEST(test_sprite_2bpp_flip_x);
+  RUN_TEST(test_composite_palette);
+  RUN_TEST(test_indices);
+  RUN_TEST(test_dirty_rect);
+}
@@ -0,0 +1,157 @@
+#include "../src/common.h"
+#include "../src/device/frames.h"
+#include "../src/device/input.h"
+#include "../src/device/offscreen.h"
+#include "greatest.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+SUITE(frames);
+
+// Copies a framebuffer into the back frame and publishes it, like the screen
+static void publish(FrameExchange *frames, Framebuffer *fb) {
+  framebuffer_copy(frames_back(frames)->framebuffer, fb);
+  framebuffer_clean(fb);
+  frames_publish(frames);
+}
+
+TEST test_skipped_frames_stay_dirty() {
+  Framebuffer *fb = framebuffer_new(16, 16);
+  FrameExchange *frames = frames_new(16, 16);
+
+  ASSERT_EQ(NULL, frames_take(frames));
+
+  publish(frames, fb);
+  Frame *frame = frames_take(frames);
+  ASSERT(frame);
+  ASSERT_EQ(16, framebuffer_dirty(frame->framebuffer).width);
+  framebuffer_clean(frame->framebuffer);
+  ASSERT_EQ(NULL, frames_take(frames));
+
+  // Two frames drawn between takes, only the second is seen
+  framebuffer_pixel(fb, BG_LAYER, 1, 1, 3);
+  publish(frames, fb);
+  framebuffer_pixel(fb, FG_LAYER, 8, 8, 2);
+  publish(frames, fb);
+
+  frame = frames_take(frames);
+  FramebufferRect dirty = framebuffer_dirty(frame->framebuffer);
+  ASSERT_EQ(1, dirty.x);
+  ASSERT_EQ(1, dirty.y);
+  ASSERT_EQ(8, dirty.width);
+  ASSERT_EQ(8, dirty.height);
+  ASSERT_EQ(3, framebuffer_get(frame->framebuffer, BG_LAYER, 1, 1));
+  ASSERT_EQ(2, framebuffer_get(frame->framebuffer, FG_LAYER, 8, 8));
+  framebuffer_clean(frame->framebuffer);
+
+  // Once a frame is taken, the next one is only dirty where it was drawn on
+  framebuffer_pixel(fb, BG_LAYER, 4, 4, 1);
+  publish(frames, fb);
+  publish(frames, fb);
+  frame = frames_take(frames);
+  dirty = framebuffer_dirty(frame->framebuffer);
+  ASSERT_EQ(4, dirty.x);
+  ASSERT_EQ(1, dirty.width);
+
+  frames_delete(frames);
+  framebuffer_delete(fb);
+
+  PASS();
+}
+
+#define QUEUE_EVENTS 100000
+
+static void *produce(void *arg) {
+  InputQueue *queue = arg;
+  for (int i = 0; i < QUEUE_EVENTS; i++) {
+    InputEvent event = {.kind = INPUT_MOUSE_MOVE, .x = i, .y = i >> 16};
+    // Let the consumer run when it shares a core with us
+    while (!input_push(queue, event))
+      sched_yield();
+  }
+  return NULL;
+}
+
+TEST test_input_queue_order() {
+  InputQueue *queue = input_new();
+  InputEvent event;
+
+  ASSERT_FALSE(input_pop(queue, &event));
+
+  pthread_t producer;
+  pthread_create(&producer, NULL, produce, queue);
+
+  for (int i = 0; i < QUEUE_EVENTS; i++) {
+    while (!input_pop(queue, &event))
+      sched_yield();
+    ASSERT_EQ((Short)i, event.x);
+    ASSERT_EQ((Short)(i >> 16), event.y);
+  }
+
+  pthread_join(producer, NULL);
+  ASSERT_FALSE(input_pop(queue, &event));
+
+  // A full queue drops events rather than overwriting them
+  for (int i = 0; i < INPUT_QUEUE_SIZE; i++) {
+    ASSERT(input_push(queue, (InputEvent){.kind = INPUT_KEY, .value = i}));
+  }
+  ASSERT_FALSE(input_push(queue, (InputEvent){.kind = INPUT_QUIT}));
+  ASSERT(input_pop(queue, &event));
+  ASSERT_EQ(0, event.value);
+
+  input_delete(queue);
+
+  PASS();
+}
+
+TEST test_offscreen_files() {
+  Framebuffer *fb = framebuffer_new(4, 2);
+  framebuffer_pixel(fb, BG_LAYER, 1, 0, 2);
+  framebuffer_pixel(fb, FG_LAYER, 1, 0, 3);
+  framebuffer_pixel(fb, BG_LAYER, 3, 1, 1);
+
+  FILE *out = tmpfile();
+  ASSERT(offscreen_write_raw(fb, out));
+  Byte raw[9];
+  rewind(out);
+  ASSERT_EQ(8, fread(raw, 1, sizeof(raw), out));
+  fclose(out);
+
+  const Byte expected[8] = {0, 3 << 2 | 2, 0, 0, 0, 0, 0, 1};
+  ASSERT_MEM_EQ(expected, raw, sizeof(expected));
+
+  // Rows are stored uncompressed, so the front layer wins in the pixel data
+  const uint32_t palette[4] = {0x11111111, 0x22222222, 0x33333333,
+                               0x44444444};
+  out = tmpfile();
+  ASSERT(offscreen_write_png(fb, palette, out));
+  Byte png[256];
+  rewind(out);
+  size_t length = fread(png, 1, sizeof(png), out);
+  fclose(out);
+
+  ASSERT_MEM_EQ("\x89PNG\r\n\x1a\n", png, 8);
+  ASSERT_MEM_EQ("IHDR\0\0\0\x04\0\0\0\x02\x08\x03", png + 12, 14);
+  ASSERT_MEM_EQ("IEND", png + length - 8, 4);
+
+  // Palette, then the two rows after the zlib and stored block headers
+  const Byte *plte = png + 8 + 25;
+  ASSERT_MEM_EQ("PLTE", plte + 4, 4);
+  ASSERT_EQ(0x11, plte[8]);
+  ASSERT_EQ(0x44, plte[8 + 9]);
+  const Byte *idat = plte + 12 + 12;
+  ASSERT_MEM_EQ("IDAT", idat + 4, 4);
+  const Byte rows[10] = {0, 0, 3, 0, 0, 0, 0, 0, 0, 1};
+  ASSERT_MEM_EQ(rows, idat + 8 + 2 + 5, sizeof(rows));
+
+  framebuffer_delete(fb);
+
+  PASS();
+}
+
+SUITE(frames) {
+  RUN_TEST(test_skipped_frames_stay_dirty);
+  RUN_TEST(test_input_queue_order);
+  RUN_TEST(test_offscreen_files);
+}
@@ -4,15 +4,18 @@
 
 SUITE_EXTERN(stack);
 SUITE_EXTERN(uxn);
+SUITE_EXTERN(framebuffer);
+SUITE_EXTERN(drawlist);
+SUITE_EXTERN(frames);
 
 GREATEST_MAIN_DEFS();
 
-void uxn_dei_dispatch(Uxn *uxn, Byte addr) {}
-Byte uxn_deo_dispatch(Uxn *uxn, Byte addr) { return 0; }
-
 int main(int argc, char **argv) {
   GREATEST_MAIN_BEGIN();
   RUN_SUITE(stack);
   RUN_SUITE(uxn);
+  RUN_SUITE(framebuffer);
+  RUN_SUITE(drawlist);
+  RUN_SUITE(frames);
   GREATEST_MAIN_END();
 }
\ No newline at end of file
@@ -1,7 +1,15 @@
+#include "../src/code.h"
 #include "../src/common.h"
+#include "../src/device/system.h"
+#include "../src/fuse.h"
+#include "../src/snapshot.h"
 #include "../src/uxn.h"
 #include "greatest.h"
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 SUITE(uxn);
 
@@ -52,9 +60,415 @@ TEST test_pop_ret() {
   PASS();
 }
 
+TEST test_eval_short_mode() {
+  Uxn *uxn = uxn_new(NULL);
+  // LIT2 0003 LIT2 0004 ADD2 BRK
+  Byte program[] = {0xa0, 0x00, 0x03, 0xa0, 0x00, 0x04, 0x38, 0x00};
+  uxn_mem_load(uxn, program, sizeof(program), RESET_VECTOR);
+  uxn_eval(uxn, RESET_VECTOR);
+
+  ASSERT_EQ(2, uxn_work_ptr(uxn));
+  ASSERT_EQ(0x07, uxn_peek_work_offset(uxn, 0));
+  ASSERT_EQ(0x00, uxn_peek_work_offset(uxn, 1));
+
+  uxn_delete(uxn);
+
+  PASS();
+}
+
+TEST test_eval_keep_return_mode() {
+  Uxn *uxn = uxn_new(NULL);
+  // LITr 05 LITr 02 SUBkr STHr BRK
+  Byte program[] = {0xc0, 0x05, 0xc0, 0x02, 0xd9, 0x4f, 0x00};
+  uxn_mem_load(uxn, program, sizeof(program), RESET_VECTOR);
+  uxn_eval(uxn, RESET_VECTOR);
+
+  ASSERT_EQ(1, uxn_work_ptr(uxn));
+  ASSERT_EQ(0x03, uxn_peek_work(uxn));
+  ASSERT_EQ(2, uxn_ret_ptr(uxn));
+  ASSERT_EQ(0x02, uxn_peek_ret(uxn));
+
+  uxn_delete(uxn);
+
+  PASS();
+}
+
+TEST test_eval_fused_self_modify() {
+  Uxn *uxn = uxn_new(NULL);
+  ASSERT_EQ(uxn_fused_none, uxn->fused);
+
+  // LIT 03 LIT 04 ADD BRK, where LIT 04 ADD runs as one superinstruction
+  Byte program[] = {0x80, 0x03, 0x80, 0x04, 0x18, 0x00};
+  uxn_mem_load(uxn, program, sizeof(program), RESET_VECTOR);
+  ASSERT(uxn->fused != uxn_fused_none);
+  uxn_eval(uxn, RESET_VECTOR);
+
+  ASSERT_EQ(1, uxn_work_ptr(uxn));
+  ASSERT_EQ(0x07, uxn_peek_work(uxn));
+
+  // Rewrite the ADD to a SUB
+  uxn_mem_write(uxn, RESET_VECTOR + 4, 0x19);
+  uxn_stack_zero(uxn);
+  uxn_eval(uxn, RESET_VECTOR);
+
+  ASSERT_EQ(1, uxn_work_ptr(uxn));
+  ASSERT_EQ(0xff, uxn_peek_work(uxn));
+
+  uxn_delete(uxn);
+
+  PASS();
+}
+
+TEST test_code_generations() {
+  Uxn *uxn = uxn_new(NULL);
+  uint32_t reset = uxn_code_generation(uxn, RESET_VECTOR);
+  uint32_t zero = uxn_code_generation(uxn, 0x0000);
+
+  uxn_mem_write(uxn, RESET_VECTOR, 0x01);
+  ASSERT(uxn_code_generation(uxn, RESET_VECTOR) != reset);
+  ASSERT_EQ(zero, uxn_code_generation(uxn, 0x0000));
+
+  // Pages other than page 0 never hold code
+  reset = uxn_code_generation(uxn, RESET_VECTOR);
+  uxn_page_write(uxn, 1, RESET_VECTOR, 0x01);
+  ASSERT_EQ(reset, uxn_code_generation(uxn, RESET_VECTOR));
+
+  // A zero page short at 0xff wraps around to 0x00
+  uint32_t last = uxn_code_generation(uxn, 0x00ff);
+  uxn_zero_page_write_short(uxn, 0xff, 0x1234);
+  ASSERT(uxn_code_generation(uxn, 0x00ff) != last);
+  ASSERT(uxn_code_generation(uxn, 0x0000) != zero);
+  ASSERT_EQ(reset, uxn_code_generation(uxn, RESET_VECTOR));
+
+  uxn_delete(uxn);
+
+  PASS();
+}
+
+TEST test_banks_allocated_on_write() {
+  Uxn *uxn = uxn_new(NULL);
+
+  for (int page = 0; page < RAM_PAGES; page++) {
+    ASSERT_EQ(NULL, uxn->banks[page]);
+  }
+  ASSERT_EQ(0, uxn_page_read(uxn, 3, 0x1234));
+  ASSERT_EQ(NULL, uxn->banks[3]);
+
+  uxn_page_write(uxn, 3, 0x1234, 0xab);
+  ASSERT(uxn->banks[3]);
+  ASSERT_EQ(0xab, uxn_page_read(uxn, 3, 0x1234));
+  ASSERT_EQ(NULL, uxn->banks[2]);
+  ASSERT_EQ(NULL, uxn->banks[4]);
+
+  // Loads carry on into the next page, and pages past the end drop writes
+  Byte data[] = {0x01, 0x02, 0x03};
+  uxn_page_load(uxn, data, sizeof(data), 5, 0xffff);
+  ASSERT_EQ(0x01, uxn_page_read(uxn, 5, 0xffff));
+  ASSERT_EQ(0x03, uxn_page_read(uxn, 6, 0x0001));
+  uxn_page_write(uxn, RAM_PAGES, 0, 0xff);
+  ASSERT_EQ(0, uxn_page_read(uxn, RAM_PAGES, 0));
+
+  uxn_mem_zero(uxn, false);
+  ASSERT_EQ(NULL, uxn->banks[3]);
+  ASSERT_EQ(0, uxn_page_read(uxn, 3, 0x1234));
+
+  uxn_delete(uxn);
+
+  PASS();
+}
+
+static int deo_calls;
+
+static Byte dei_doubled(Uxn *uxn, Byte addr) { return uxn_dev_read(uxn, addr) * 2; }
+
+static void deo_counted(Uxn *uxn, Byte addr) {
+  (void)uxn;
+  (void)addr;
+  deo_calls++;
+}
+
+TEST test_device_handlers() {
+  Uxn *uxn = uxn_new(NULL);
+  deo_calls = 0;
+  uxn_set_dei(uxn, 0x12, dei_doubled);
+  uxn_set_deo(uxn, 0x18, deo_counted);
+
+  // #15 #12 DEO #12 DEI #2118 DEO2 #0a18 DEO BRK
+  Byte program[] = {0x80, 0x15, 0x80, 0x12, 0x17, 0x80, 0x12, 0x16, 0xa0,
+                    0x21, 0x18, 0x80, 0x19, 0x37, 0x80, 0x0a, 0x80, 0x18,
+                    0x17, 0x00};
+  uxn_mem_load(uxn, program, sizeof(program), RESET_VECTOR);
+  uxn_eval(uxn, RESET_VECTOR);
+
+  ASSERT_EQ(0x2a, uxn_peek_work(uxn));
+  ASSERT_EQ(0x0a, uxn_dev_read(uxn, 0x18));
+  ASSERT_EQ(0x18, uxn_dev_read(uxn, 0x1a));
+  // Only writes reaching port 0x18 call its handler, 0x19 and 0x1a have none
+  ASSERT_EQ(1, deo_calls);
+
+  uxn_delete(uxn);
+
+  PASS();
+}
+
+// Byte at a time reference for uxn_page_copy, with addresses wrapping around
+// the end of their bank rather than running into the next one
+static void copy_bytewise(Uxn *uxn, Short dst_page, Short dst_addr,
+                          Short src_page, Short src_addr, Short length,
+                          bool backwards) {
+  for (int n = 0; n < length; n++) {
+    Short i = backwards ? length - 1 - n : n;
+    Byte value = uxn_page_read(uxn, src_page, (Short)(src_addr + i));
+    uxn_page_write(uxn, dst_page, (Short)(dst_addr + i), value);
+  }
+}
+
+#define COPY_TESTS 300
+
+TEST test_page_copy_matches_bytewise() {
+  Uxn *fast = uxn_new(NULL);
+  Uxn *slow = uxn_new(NULL);
+  srand(23);
+
+  for (int page = 0; page < 3; page++) {
+    for (int addr = 0; addr < RAM_PAGE_SIZE; addr++) {
+      Byte value = rand();
+      uxn_page_write(fast, page, addr, value);
+      uxn_page_write(slow, page, addr, value);
+    }
+  }
+
+  for (int test = 0; test < COPY_TESTS; test++) {
+    // Mostly nearby and overlapping ranges, some near the end of the page
+    Short src_page = rand() % 4, dst_page = rand() % 4;
+    Short src_addr = rand() & 1 ? rand() : 0xffff - rand() % 64;
+    Short dst_addr = rand() & 1 ? src_addr + rand() % 32 - 16 : rand();
+    Short length = rand() & 1 ? rand() % 64 : rand();
+    bool backwards = rand() & 1;
+
+    if (rand() % 4 == 0) {
+      Byte value = rand();
+      uxn_page_fill(fast, dst_page, dst_addr, length, value);
+      for (int i = 0; i < length; i++) {
+        uxn_page_write(slow, dst_page, (Short)(dst_addr + i), value);
+      }
+    } else {
+      uxn_page_copy(fast, dst_page, dst_addr, src_page, src_addr, length,
+                    backwards);
+      copy_bytewise(slow, dst_page, dst_addr, src_page, src_addr, length,
+                    backwards);
+    }
+
+    for (int page = 0; page < 4; page++) {
+      ASSERT_EQ(slow->banks[page] != NULL, fast->banks[page] != NULL);
+      Byte *a = page ? slow->banks[page] : slow->ram;
+      Byte *b = page ? fast->banks[page] : fast->ram;
+      if (a)
+        ASSERT_MEM_EQ(a, b, RAM_PAGE_SIZE);
+    }
+  }
+
+  uxn_delete(fast);
+  uxn_delete(slow);
+
+  PASS();
+}
+
+TEST test_page_load_file() {
+  // A ROM reaching 0x123 bytes into bank 2
+  FILE *rom = tmpfile();
+  size_t size = RAM_PAGE_SIZE - RESET_VECTOR + RAM_PAGE_SIZE + 0x123;
+  for (size_t i = 0; i < size; i++) {
+    fputc(i * 7 >> 8, rom);
+  }
+  fflush(rom);
+  int fd = fileno(rom);
+
+  Uxn *uxn = uxn_new(NULL);
+  uxn_page_write(uxn, 2, 0x8000, 0xff);
+  ASSERT(uxn_page_load_file(uxn, 0, RESET_VECTOR, fd, 0, 0xff00));
+  ASSERT(uxn_page_load_file(uxn, 1, 0, fd, 0xff00, RAM_PAGE_SIZE));
+  ASSERT(uxn_page_load_file(uxn, 2, 0, fd, 0x1ff00, 0x123));
+
+  // Banks aren't read until they are accessed
+  ASSERT_EQ(NULL, uxn->banks[1]);
+  ASSERT(uxn->file_banks[1].fd >= 0);
+  ASSERT_EQ((Byte)(5 * 7 >> 8), uxn_mem_read(uxn, RESET_VECTOR + 5));
+  ASSERT_EQ((Byte)(0xff00 * 7 >> 8), uxn_page_read(uxn, 1, 0));
+  ASSERT_EQ((Byte)(0x1feff * 7 >> 8), uxn_page_read(uxn, 1, 0xffff));
+  ASSERT_EQ((Byte)(0x20022 * 7 >> 8), uxn_page_read(uxn, 2, 0x122));
+  // The end of the last bank is zeros, whatever was there before
+  ASSERT_EQ(0, uxn_page_read(uxn, 2, 0x123));
+  ASSERT_EQ(0, uxn_page_read(uxn, 2, 0x8000));
+
+  // Writes stay in memory
+  uxn_page_write(uxn, 1, 0, 0xab);
+  ASSERT_EQ(0xab, uxn_page_read(uxn, 1, 0));
+  Byte first;
+  ASSERT_EQ(1, pread(fd, &first, 1, 0xff00));
+  ASSERT_EQ((Byte)(0xff00 * 7 >> 8), first);
+
+  // A bank first read after the file shrinks is zeros past its new end
+  ASSERT(uxn_page_load_file(uxn, 2, 0, fd, 0x1ff00, 0x123));
+  ASSERT(uxn_page_load_file(uxn, 3, 0, fd, 0x1ff00, 0x123));
+  ASSERT_EQ(0, ftruncate(fd, 0x1ff10));
+  ASSERT_EQ((Byte)(0x1ff0f * 7 >> 8), uxn_page_read(uxn, 2, 0x0f));
+  ASSERT_EQ(0, uxn_page_read(uxn, 2, 0x10));
+
+  uxn_mem_zero(uxn, false);
+  ASSERT_EQ(NULL, uxn->banks[1]);
+  ASSERT_EQ(NULL, uxn->banks[3]);
+  ASSERT_EQ(-1, uxn->file_banks[3].fd);
+
+  uxn_delete(uxn);
+  fclose(rom);
+
+  PASS();
+}
+
+// A ROM reaching 0x123 bytes into bank 1, more than a pipe holds at once
+#define PIPED_ROM_SIZE (RAM_PAGE_SIZE - RESET_VECTOR + 0x123)
+
+static void *write_rom(void *arg) {
+  int fd = *(int *)arg;
+  for (size_t i = 0; i < PIPED_ROM_SIZE; i++) {
+    Byte value = i * 7 >> 8;
+    if (write(fd, &value, 1) != 1)
+      break;
+  }
+  close(fd);
+  return NULL;
+}
+
+TEST test_boot_from_pipe() {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  pthread_t writer;
+  pthread_create(&writer, NULL, write_rom, &fds[1]);
+
+  Uxn *uxn = uxn_new(NULL);
+  uxn_page_write(uxn, 1, 0x8000, 0xff);
+  char path[32];
+  snprintf(path, sizeof(path), "/dev/fd/%d", fds[0]);
+  ASSERT_EQ(1, system_boot(uxn, path));
+  pthread_join(writer, NULL);
+  close(fds[0]);
+
+  // A pipe can't be read later, so every bank is read while booting
+  ASSERT(uxn->banks[1] != NULL);
+  ASSERT_EQ(-1, uxn->file_banks[1].fd);
+  ASSERT_EQ((Byte)(5 * 7 >> 8), uxn_mem_read(uxn, RESET_VECTOR + 5));
+  ASSERT_EQ((Byte)(0xfeff * 7 >> 8), uxn_mem_read(uxn, 0xffff));
+  ASSERT_EQ((Byte)(0xff00 * 7 >> 8), uxn_page_read(uxn, 1, 0));
+  ASSERT_EQ((Byte)(0x10022 * 7 >> 8), uxn_page_read(uxn, 1, 0x122));
+  ASSERT_EQ(0, uxn_page_read(uxn, 1, 0x123));
+  ASSERT_EQ(0, uxn_page_read(uxn, 1, 0x8000));
+  ASSERT_EQ(NULL, uxn->banks[2]);
+
+  uxn_delete(uxn);
+
+  PASS();
+}
+
+// A device section that is just a byte
+static Byte fake_state;
+
+static bool fake_save(Uxn *uxn, FILE *out) {
+  (void)uxn;
+  return snapshot_write_byte(out, fake_state);
+}
+
+static bool fake_load(Uxn *uxn, FILE *in, uint32_t length) {
+  (void)uxn;
+  return length == 1 && snapshot_read_byte(in, &fake_state);
+}
+
+TEST test_snapshot_round_trip() {
+  char path[] = "/tmp/uxn-snapshot-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT(fd >= 0);
+  close(fd);
+
+  const SnapshotDevice fake = {{'F', 'A', 'K', 'E'}, fake_save, fake_load};
+  const SnapshotDevice other = {{'O', 'T', 'H', 'R'}, fake_save, fake_load};
+
+  Uxn *uxn = uxn_new(NULL);
+  uxn_mem_write(uxn, RESET_VECTOR, 0x80);
+  uxn_mem_write(uxn, 0xffff, 0x42);
+  uxn_page_write(uxn, 3, 0x1234, 0x56);
+  uxn_push_work(uxn, 0x12);
+  uxn_push_ret(uxn, 0x34);
+  uxn_push_ret(uxn, 0x35);
+  uxn_dev_write(uxn, 0x10, 0x77);
+  fake_state = 0x99;
+  const SnapshotDevice saved[] = {fake, other};
+  ASSERT(uxn_snapshot_save(uxn, path, saved, 2));
+
+  // Loading replaces everything, and skips the section it doesn't know
+  Uxn *loaded = uxn_new(NULL);
+  uxn_mem_write(loaded, 0x200, 0xee);
+  uxn_page_write(loaded, 4, 0, 0xee);
+  uxn_push_work(loaded, 0xee);
+  uxn_push_work(loaded, 0xee);
+  fake_state = 0;
+  ASSERT(uxn_snapshot_load(loaded, path, &fake, 1));
+
+  ASSERT_EQ(0x99, fake_state);
+  ASSERT_EQ(0, memcmp(uxn->ram, loaded->ram, RAM_PAGE_SIZE));
+  ASSERT_EQ(0x56, uxn_page_read(loaded, 3, 0x1234));
+  ASSERT_EQ(NULL, loaded->banks[4]);
+  ASSERT_EQ(1, loaded->work.ptr);
+  ASSERT_EQ(0x12, uxn_pop_work(loaded));
+  ASSERT_EQ(2, loaded->ret.ptr);
+  ASSERT_EQ(0x35, uxn_pop_ret(loaded));
+  ASSERT_EQ(0x77, uxn_dev_read(loaded, 0x10));
+
+  // Anything else is refused: other files, files that end partway through a
+  // tag or a section, and snapshots without stacks or devices
+  static const struct {
+    const char *data;
+    size_t length;
+  } damaged[] = {
+      {"UXNROM", 6},
+      {"UXNSNAP\x01STK", 11},
+      {"UXNSNAP\x01ZZZZ\0\0\0\x10", 16},
+      {"UXNSNAP\x01", 8},
+  };
+  for (size_t i = 0; i < sizeof(damaged) / sizeof(damaged[0]); i++) {
+    FILE *junk = fopen(path, "wb");
+    fwrite(damaged[i].data, 1, damaged[i].length, junk);
+    fclose(junk);
+    ASSERT_FALSE(uxn_snapshot_load(loaded, path, &fake, 1));
+  }
+
+  FILE *stacks_only = fopen(path, "wb");
+  fwrite("UXNSNAP\x01STKS\0\0\x02\x02", 1, 16, stacks_only);
+  for (int i = 0; i < 2 * (STACK_SIZE + 1); i++) {
+    fputc(0, stacks_only);
+  }
+  fclose(stacks_only);
+  ASSERT_FALSE(uxn_snapshot_load(loaded, path, &fake, 1));
+
+  uxn_delete(loaded);
+  uxn_delete(uxn);
+  unlink(path);
+
+  PASS();
+}
+
 SUITE(uxn) {
   RUN_TEST(test_push_work);
   RUN_TEST(test_pop_work);
   RUN_TEST(test_push_ret);
   RUN_TEST(test_pop_ret);
+  RUN_TEST(test_eval_short_mode);
+  RUN_TEST(test_eval_keep_return_mode);
+  RUN_TEST(test_eval_fused_self_modify);
+  RUN_TEST(test_code_generations);
+  RUN_TEST(test_banks_allocated_on_write);
+  RUN_TEST(test_device_handlers);
+  RUN_TEST(test_page_copy_matches_bytewise);
+  RUN_TEST(test_page_load_file);
+  RUN_TEST(test_boot_from_pipe);
+  RUN_TEST(test_snapshot_round_trip);
 }